@@ -1,6 +1,9 @@
 #ifdef __OPEN_SSL__
 #include "tcp/KOpenSSL.h"
 #include "tcp/KTcpConnection.hpp"
+#if defined(WIN32)
+#include <io.h>
+#endif
 namespace klib
 {
 
@@ -15,11 +18,18 @@ namespace klib
         /* 载入所有SSL 错误消息 */
         SSL_load_error_strings();
 
-        /* 以SSL V2 和V3 标准兼容方式产生一个SSL_CTX ，即SSL Content Text */
+        /* 以版本协商方式产生一个SSL_CTX ，具体协议范围由SetProtocols限定 */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        if (isServer)
+            *ctx = SSL_CTX_new(TLS_server_method());
+        else
+            *ctx = SSL_CTX_new(TLS_client_method());
+#else
         if (isServer)
             *ctx = SSL_CTX_new(SSLv23_server_method());
         else
             *ctx = SSL_CTX_new(SSLv23_client_method());
+#endif
 
         /* 也可以用SSLv2_server_method() 或SSLv3_server_method() 单独表示V2 或V3
          * 标准 */
@@ -56,7 +66,66 @@ namespace klib
             return false;
         }
 
-        SSL_CTX_set_cipher_list(*ctx, "RC4-MD5");
+        /* 协议版本、加密套件和曲线 */
+        if (!SetProtocols(conf, *ctx))
+            return false;
+
+        /* 服务端按自己的套件顺序选择，关闭压缩 */
+        long opts = SSL_OP_NO_COMPRESSION;
+        if (isServer)
+            opts |= SSL_OP_CIPHER_SERVER_PREFERENCE;
+#ifdef SSL_OP_ENABLE_KTLS
+        /* 握手完成后将记录层加解密交给内核 */
+        if (conf.enableKtls)
+            opts |= SSL_OP_ENABLE_KTLS;
+#else
+        if (conf.enableKtls)
+            printf("<%s> kTLS is not supported by this OpenSSL build\n", __FUNCTION__);
+#endif
+        SSL_CTX_set_options(*ctx, opts);
+        return true;
+    }
+
+    bool KOpenSSL::SetProtocols(const KOpenSSLConfig& conf, SSL_CTX* ctx)
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+        if ((conf.minProtocol > 0 && SSL_CTX_set_min_proto_version(ctx, conf.minProtocol) != 1)
+            || (conf.maxProtocol > 0 && SSL_CTX_set_max_proto_version(ctx, conf.maxProtocol) != 1))
+        {
+            printf("<%s> %s\n", __FUNCTION__, ERR_error_string(ERR_get_error(), NULL));
+            return false;
+        }
+#else
+        /* 老版本只能逐个禁用 */
+        long opts = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3;
+        if (conf.minProtocol > TLS1_VERSION)
+            opts |= SSL_OP_NO_TLSv1;
+        if (conf.minProtocol > TLS1_1_VERSION)
+            opts |= SSL_OP_NO_TLSv1_1;
+        SSL_CTX_set_options(ctx, opts);
+#endif
+
+        if (!conf.cipherList.empty() && SSL_CTX_set_cipher_list(ctx, conf.cipherList.c_str()) != 1)
+        {
+            printf("<%s> cipher list:[%s] %s\n", __FUNCTION__, conf.cipherList.c_str(), ERR_error_string(ERR_get_error(), NULL));
+            return false;
+        }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+        if (!conf.cipherSuites.empty() && SSL_CTX_set_ciphersuites(ctx, conf.cipherSuites.c_str()) != 1)
+        {
+            printf("<%s> cipher suites:[%s] %s\n", __FUNCTION__, conf.cipherSuites.c_str(), ERR_error_string(ERR_get_error(), NULL));
+            return false;
+        }
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+        if (!conf.curves.empty() && SSL_CTX_set1_curves_list(ctx, conf.curves.c_str()) != 1)
+        {
+            printf("<%s> curves:[%s] %s\n", __FUNCTION__, conf.curves.c_str(), ERR_error_string(ERR_get_error(), NULL));
+            return false;
+        }
+#endif
         return true;
     }
 
@@ -113,6 +182,9 @@ namespace klib
                 }
                 else
                     printf("no certificate\n");
+
+                if (IsKtlsSend(ssl))
+                    printf("ktls send enabled, cipher:[%s]\n", SSL_get_cipher(ssl));
                 return ssl;
             };
         };
@@ -161,6 +233,9 @@ namespace klib
                 }
                 else
                     printf("no certificate\n");
+
+                if (IsKtlsSend(ssl))
+                    printf("ktls send enabled, cipher:[%s]\n", SSL_get_cipher(ssl));
                 return ssl;
             };
         };
@@ -243,6 +318,123 @@ namespace klib
         return sent;
     }
 
+    int KOpenSSL::WriteSocket(SSL* ssl, const std::vector<KBuffer>& dats)
+    {
+        if (ssl == NULL)
+            return 0;
+
+        /* 记录缓存，每满一个记录调用一次SSL_write，减少记录头/MAC开销和系统调用 */
+        char record[SSLRecordSize];
+        size_t used = 0;
+        int sent = 0;
+        std::vector<KBuffer>::const_iterator it = dats.begin();
+        while (it != dats.end())
+        {
+            const char* dat = it->GetData();
+            size_t sz = it->GetSize();
+            if (dat != NULL && sz > 0)
+            {
+                /* 缓存为空且数据已经够一个记录，直接发送，避免拷贝 */
+                if (used == 0 && sz >= SSLRecordSize)
+                {
+                    size_t whole = sz - sz % SSLRecordSize;
+                    if (WriteSocket(ssl, dat, whole) < 0)
+                        return -1;
+                    sent += whole;
+                    dat += whole;
+                    sz -= whole;
+                }
+
+                while (sz > 0)
+                {
+                    size_t len = SSLRecordSize - used;
+                    if (len > sz)
+                        len = sz;
+                    memcpy(record + used, dat, len);
+                    used += len;
+                    dat += len;
+                    sz -= len;
+                    if (used == SSLRecordSize)
+                    {
+                        if (WriteSocket(ssl, record, used) < 0)
+                            return -1;
+                        sent += used;
+                        used = 0;
+                    }
+                }
+            }
+            ++it;
+        }
+
+        if (used > 0)
+        {
+            if (WriteSocket(ssl, record, used) < 0)
+                return -1;
+            sent += used;
+        }
+        return sent;
+    }
+
+    int KOpenSSL::SendFile(SSL* ssl, int fd, int64_t offset, size_t sz)
+    {
+        if (sz < 1 || fd < 0 || ssl == NULL)
+            return 0;
+
+        size_t sent = 0;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS) && defined(LINUX)
+        if (IsKtlsSend(ssl))
+        {
+            while (sent != sz)
+            {
+                ossl_ssize_t rc = SSL_sendfile(ssl, fd, off_t(offset + int64_t(sent)), sz - sent, 0);
+                if (rc > 0)
+                    sent += size_t(rc);
+                else
+                {
+                    int err = SSL_get_error(ssl, int(rc));
+                    if (SSL_ERROR_WANT_WRITE == err)
+                    {
+                        KTime::MSleep(6);
+                        continue;
+                    }
+                    printf("SendFile rc:[%d] err:[%d]\n", int(rc), err);
+                    return -1;
+                }
+            }
+            return int(sent);
+        }
+#endif
+        /* 未启用kTLS则读出后走普通SSL_write */
+        char buf[SSLBlockSize];
+        while (sent != sz)
+        {
+            size_t len = sz - sent;
+            if (len > SSLBlockSize)
+                len = SSLBlockSize;
+#if defined(WIN32)
+            _lseeki64(fd, offset + int64_t(sent), SEEK_SET);
+            int rc = _read(fd, buf, unsigned(len));
+#else
+            ssize_t rc = pread(fd, buf, len, off_t(offset + int64_t(sent)));
+#endif
+            if (rc <= 0 || WriteSocket(ssl, buf, size_t(rc)) < 0)
+                return -1;
+            sent += size_t(rc);
+        }
+        return int(sent);
+    }
+
+    bool KOpenSSL::IsKtlsSend(SSL* ssl)
+    {
+        if (ssl == NULL)
+            return false;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_NO_KTLS)
+        return BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+#else
+        return false;
+#endif
+    }
+
 };
 
 #endif
\ No newline at end of file
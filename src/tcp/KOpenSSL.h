@@ -8,7 +8,18 @@
 #include "util/KTime.h"
 #include "thread/KBuffer.h"
 #include <vector>
+#include <stdint.h>
 #define SSLBlockSize 40960
+// 单个TLS记录最大明文长度 //
+#define SSLRecordSize 16384
+// TLS1.2及以下的默认AEAD套件，优先AES-GCM(AES-NI和kTLS均支持) //
+#define SSLDefaultCipherList "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:" \
+    "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:" \
+    "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305"
+// TLS1.3的默认套件 //
+#define SSLDefaultCipherSuites "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256"
+// 默认椭圆曲线 //
+#define SSLDefaultCurves "X25519:P-256:P-384"
 namespace klib
 {
     struct KOpenSSLConfig
@@ -16,6 +27,25 @@ namespace klib
         std::string caFile;
         std::string certFile;
         std::string privateKeyFile;
+        // 最低/最高协议版本，如TLS1_2_VERSION，0表示库支持的最低/最高版本 //
+        int minProtocol;
+        int maxProtocol;
+        // TLS1.2及以下的加密套件 //
+        std::string cipherList;
+        // TLS1.3的加密套件 //
+        std::string cipherSuites;
+        // 椭圆曲线，冒号分隔 //
+        std::string curves;
+        // 是否启用内核TLS(linux kTLS)，握手后由内核完成加密 //
+        bool enableKtls;
+
+        KOpenSSLConfig()
+            :minProtocol(TLS1_2_VERSION), maxProtocol(0),
+            cipherList(SSLDefaultCipherList), cipherSuites(SSLDefaultCipherSuites),
+            curves(SSLDefaultCurves), enableKtls(false)
+        {
+
+        }
     };
 
     class KOpenSSL
@@ -34,6 +64,34 @@ namespace klib
         static int ReadSocket(SSL* ssl, std::vector<KBuffer>& dat);
 
         static int WriteSocket(SSL* ssl, const char* dat, size_t sz);
+
+        /************************************
+        * Method:    批量写socket，小块数据先拼成满16K的TLS记录再加密发送
+        * Returns:   返回发送字节数，失败返回-1
+        * Parameter: ssl
+        * Parameter: dats 待发送的数据
+        *************************************/
+        static int WriteSocket(SSL* ssl, const std::vector<KBuffer>& dats);
+
+        /************************************
+        * Method:    发送文件内容，启用kTLS时走SSL_sendfile零拷贝
+        * Returns:   返回发送字节数，失败返回-1
+        * Parameter: ssl
+        * Parameter: fd 文件描述符
+        * Parameter: offset 文件偏移
+        * Parameter: sz 发送长度
+        *************************************/
+        static int SendFile(SSL* ssl, int fd, int64_t offset, size_t sz);
+
+        /************************************
+        * Method:    发送方向是否已由内核TLS接管
+        * Returns:   是返回true否则返回false
+        * Parameter: ssl
+        *************************************/
+        static bool IsKtlsSend(SSL* ssl);
+
+    private:
+        static bool SetProtocols(const KOpenSSLConfig& conf, SSL_CTX* ctx);
     };
 
 };
@@ -49,6 +49,18 @@ struct KOpenSSLConfig
 	std::string caFile;
 	std::string certFile;
 	std::string privateKeyFile;
+	int minProtocol;
+	int maxProtocol;
+	std::string cipherList;
+	std::string cipherSuites;
+	std::string curves;
+	bool enableKtls;
+
+	KOpenSSLConfig()
+		:minProtocol(0), maxProtocol(0), enableKtls(false)
+	{
+
+	}
 };
 #endif
 /**
@@ -761,22 +773,22 @@ namespace klib {
                             }
                         }
 
+#ifdef __OPEN_SSL__
+                        // ssl 合并成整记录后发送 //
+                        if (!bufs.empty() && m_poller->IsSslEnabled())
+                        {
+                            if (KOpenSSL::WriteSocket(ev.ssl, bufs) < 0)
+                                m_poller->Disconnect(fd);
+                        }
+                        else
+#endif
                         if (!bufs.empty())
                         {
                             std::vector<KBuffer >::iterator it = bufs.begin();
                             while (it != bufs.end())
                             {
                                 KBuffer& buf = *it;
-
-                                int rc = 0;
-#ifdef __OPEN_SSL__
-                                if (m_poller->IsSslEnabled())
-                                    rc = KOpenSSL::WriteSocket(ev.ssl, buf.GetData(), buf.GetSize());
-                                else
-#endif
-                                    rc = KTcpUtil::WriteSocket(fd, buf.GetData(), buf.GetSize());
-
-                                if (rc < 0)
+                                if (KTcpUtil::WriteSocket(fd, buf.GetData(), buf.GetSize()) < 0)
                                 {
                                     m_poller->Disconnect(fd);
                                     break;
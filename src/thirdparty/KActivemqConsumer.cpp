@@ -1,14 +1,71 @@
 #include "KActivemqConsumer.h"
 #include "util/KTime.h"
 namespace thirdparty {
-    KActivemqConsumer::KActivemqConsumer(const std::vector<std::string>& brokers, const std::string& destURI)
+    KActivemqSession::~KActivemqSession()
+    {
+        KActivemqConsumer::Release(m_last);
+    }
+
+    void KActivemqSession::onMessage(const Message* message)
+    {
+        m_owner.Dispatch(*this, message);
+    }
+
+    void KActivemqSession::Acknowledge(const Message* msg, uint64_t now)
+    {
+        klib::KLockGuard<klib::KMutex> lock(m_mtx);
+        if (m_unacked++ == 0)
+            m_firstUnacked = now;
+        if (m_unacked >= m_owner.m_opts.ackBatchSize || now - m_firstUnacked >= m_owner.m_opts.ackIntervalMs)
+        {
+            msg->acknowledge();
+            m_unacked = 0;
+            KActivemqConsumer::Release(m_last);
+            return;
+        }
+
+        // 消息只在回调中有效，保留副本供定时确认 //
+        KActivemqConsumer::Release(m_last);
+        m_last = msg->clone();
+    }
+
+    void KActivemqSession::Flush(uint64_t now, uint32_t intervalMs)
+    {
+        klib::KLockGuard<klib::KMutex> lock(m_mtx);
+        if (m_unacked == 0 || m_last == NULL || now - m_firstUnacked < intervalMs)
+            return;
+
+        try {
+            m_last->acknowledge();
+        }
+        catch (CMSException& e)
+        {
+            printf("<%s> session:[%d] acknowledge Exception:[%s].\n", __FUNCTION__, int(m_index), e.what());
+        }
+        m_unacked = 0;
+        KActivemqConsumer::Release(m_last);
+    }
+
+    void KActivemqWorker::ProcessEvent(const std::string& ev)
+    {
+        m_owner.OnTextAsync(ev);
+    }
+
+    KActivemqConsumer::KActivemqConsumer(const std::vector<std::string>& brokers, const std::string& destURI,
+        const ActivemqConsumerOptions& opts)
         : m_connection(NULL),
         m_session(NULL),
         m_destination(NULL),
         m_destURI(destURI),
         m_consumer(NULL),
-        m_state(CSDisconnected)
+        m_state(CSDisconnected),
+        m_opts(opts),
+        m_ackThread("KActivemqConsumer ack thread"),
+        m_acking(false),
+        m_generation(0)
     {
+        if (m_opts.sessions == 0)
+            m_opts.sessions = 1;
         m_brokerURI = GetBrokerUrl(brokers);
         printf("<%s> broker url:[%s]\n", __FUNCTION__,m_brokerURI.c_str());
     }
@@ -25,42 +82,74 @@ namespace thirdparty {
 
     void KActivemqConsumer::Cleanup()
     {
+        {
+            // 之后不再确认本连接收到的消息 //
+            klib::KLockGuard<klib::KMutex> lock(m_sessionMtx);
+            ++m_generation;
+        }
+
         // Close open resources.
         try {
             if (m_connection != NULL)
-            {
                 m_connection->stop();
-                m_connection->close();
-                printf("<%s> Dest:[%s], connection closed.\n"
-                    , __FUNCTION__, m_destURI.c_str());
-            }
         }
         catch (CMSException& e) {}
 
+        // 停止分发后确认批量中剩余的消息 //
+        FlushAcks(true);
+
         try {
-            if (m_session != NULL)
+            if (m_connection != NULL)
             {
-                m_session->close();
-                printf("<%s> Dest:[%s], session closed.\n"
+                m_connection->close();
+                printf("<%s> Dest:[%s], connection closed.\n"
                     , __FUNCTION__, m_destURI.c_str());
             }
         }
         catch (CMSException& e) {}
 
-        try {
-            if (m_consumer != NULL)
-            {
-                m_consumer->close();
-                printf("<%s> Consumer stopping.\n", __FUNCTION__);
+        std::vector<KActivemqSession*>::iterator it = m_sessions.begin();
+        while (it != m_sessions.end())
+        {
+            KActivemqSession* s = *it;
+            try {
+                if (s->m_session != NULL)
+                {
+                    s->m_session->close();
+                    printf("<%s> Dest:[%s], session:[%d] closed.\n"
+                        , __FUNCTION__, m_destURI.c_str(), int(s->m_index));
+                }
+            }
+            catch (CMSException& e) {}
+
+            try {
+                if (s->m_consumer != NULL)
+                {
+                    s->m_consumer->close();
+                    printf("<%s> Consumer stopping.\n", __FUNCTION__);
+                }
             }
+            catch (CMSException& e) {}
+            ++it;
         }
-        catch (CMSException& e) {}
 
         // Destroy resources.
         Release(m_destination);
-        Release(m_session);
+        {
+            klib::KLockGuard<klib::KMutex> lock(m_sessionMtx);
+            it = m_sessions.begin();
+            while (it != m_sessions.end())
+            {
+                Release((*it)->m_consumer);
+                Release((*it)->m_session);
+                delete *it;
+                ++it;
+            }
+            m_sessions.clear();
+        }
+        m_session = NULL;
+        m_consumer = NULL;
         Release(m_connection);
-        Release(m_consumer);
         printf("<%s> Consumer stopped.\n", __FUNCTION__);
         m_state = CSDisconnected;
     }
@@ -72,7 +161,7 @@ namespace thirdparty {
         std::vector<std::string>::const_iterator it = ips.begin();
         while (it != ips.end())
         {
-            os << "tcp://" << *it << ":61616?jms.prefetchPolicy.all=10";
+            os << "tcp://" << *it << ":61616?jms.prefetchPolicy.all=" << m_opts.prefetch;
             if (++it != ips.end())
                 os << ",";
         }
@@ -103,6 +192,7 @@ namespace thirdparty {
                 factory = new ActiveMQConnectionFactory(m_brokerURI);
                 RedeliveryPolicy* policy = factory->getRedeliveryPolicy();
                 policy->setMaximumRedeliveries(3);
+                factory->setOptimizeAcknowledge(m_opts.ackMode == AckOptimistic);
                 m_connection = factory->createConnection();
 
                 ActiveMQConnection* amqConnection = dynamic_cast<ActiveMQConnection*>(m_connection);
@@ -117,12 +207,47 @@ namespace thirdparty {
 
                 m_connection->start();
                 m_connection->setExceptionListener(this);
-                m_session = m_connection->createSession(Session::INDIVIDUAL_ACKNOWLEDGE);
-                m_destination = m_session->createQueue(m_destURI);
-                m_consumer = m_session->createConsumer(m_destination);
-                m_consumer->setMessageListener(this);
-                m_session->recover();
-                printf("<%s> Consumer Started.\n", __FUNCTION__);
+                if (m_workers.empty())
+                {
+                    for (size_t i = 0; i < m_opts.workers; ++i)
+                    {
+                        KActivemqWorker* worker = new KActivemqWorker(*this, m_opts.workerQueueSize);
+                        worker->Start();
+                        m_workers.push_back(worker);
+                    }
+                }
+
+                Session::AcknowledgeMode mode = Session::INDIVIDUAL_ACKNOWLEDGE;
+                if (m_opts.ackMode == AckBatch)
+                    mode = Session::CLIENT_ACKNOWLEDGE;
+                else if (m_opts.ackMode == AckOptimistic)
+                    mode = Session::DUPS_OK_ACKNOWLEDGE;
+
+                // 每个会话有自己的分发线程，多个会话并行消费 //
+                for (size_t i = 0; i < m_opts.sessions; ++i)
+                {
+                    KActivemqSession* s = new KActivemqSession(*this, i);
+                    {
+                        klib::KLockGuard<klib::KMutex> lock(m_sessionMtx);
+                        m_sessions.push_back(s);
+                    }
+                    s->m_session = m_connection->createSession(mode);
+                    if (m_destination == NULL)
+                        m_destination = s->m_session->createQueue(m_destURI);
+                    s->m_consumer = s->m_session->createConsumer(m_destination);
+                    s->m_consumer->setMessageListener(s);
+                    s->m_session->recover();
+                }
+                m_session = m_sessions[0]->m_session;
+                m_consumer = m_sessions[0]->m_consumer;
+                // 空闲时定时确认批量中剩余的消息 //
+                if (m_opts.ackMode == AckBatch && !m_acking)
+                {
+                    m_acking = true;
+                    if (m_ackThread.Run(this, &KActivemqConsumer::AckLoop, 0) != klib::KPthread::Success)
+                        m_acking = false;
+                }
+                printf("<%s> Consumer Started, sessions:[%d].\n", __FUNCTION__, int(m_sessions.size()));
                 m_state = CSConnected;
                 rc = true;
             }
@@ -150,6 +275,12 @@ namespace thirdparty {
 
     void KActivemqConsumer::Stop()
     {
+        if (m_acking)
+        {
+            m_acking = false;
+            m_ackThread.Join();
+        }
+
         switch (m_state)
         {
         case CSException:
@@ -161,20 +292,98 @@ namespace thirdparty {
         default:
             break;
         }
+        StopWorkers();
+    }
+
+    void KActivemqConsumer::StopWorkers()
+    {
+        klib::DrainAndRelease(m_workers);
+    }
+
+    bool KActivemqConsumer::Acknowledge(const Message* msg, uint32_t generation)
+    {
+        klib::KLockGuard<klib::KMutex> lock(m_sessionMtx);
+        if (generation != m_generation || m_sessions.empty())
+            return false;
+
+        try {
+            msg->acknowledge();
+        }
+        catch (CMSException& e)
+        {
+            printf("<%s> Dest:[%s] acknowledge Exception:[%s].\n", __FUNCTION__, m_destURI.c_str(), e.what());
+            return false;
+        }
+        return true;
+    }
+
+    void KActivemqConsumer::FlushAcks(bool all)
+    {
+        uint64_t now = 0;
+        klib::KTime::NowMillisecond(now);
+        klib::KLockGuard<klib::KMutex> lock(m_sessionMtx);
+        std::vector<KActivemqSession*>::iterator it = m_sessions.begin();
+        while (it != m_sessions.end())
+        {
+            (*it)->Flush(now, all ? 0 : m_opts.ackIntervalMs);
+            ++it;
+        }
+    }
+
+    int KActivemqConsumer::AckLoop(int)
+    {
+        uint32_t interval = (m_opts.ackIntervalMs > 0 && m_opts.ackIntervalMs < 100 ? m_opts.ackIntervalMs : 100);
+        while (m_acking)
+        {
+            klib::KTime::MSleep(interval);
+            if (m_state == CSConnected)
+                FlushAcks(false);
+        }
+        return 0;
     }
 
     void KActivemqConsumer::onMessage(const Message* msg)
+    {
+        if (!m_sessions.empty())
+            Dispatch(*m_sessions[0], msg);
+    }
+
+    void KActivemqConsumer::Dispatch(KActivemqSession& s, const Message* msg)
     {
         bool rc = true;
         const TextMessage* tmsg = dynamic_cast<const TextMessage*>(msg);
-        if (tmsg != NULL)
-            rc = OnText(tmsg);
-        else// 非法消息
+        if (tmsg == NULL)// 非法消息
             printf("<%s> Not text message.\n", __FUNCTION__);
-
-        if (rc)
-            msg->acknowledge();
+        else if (m_workers.empty())
+            rc = OnText(tmsg);
         else
+        {
+            // 处理线程队列满时阻塞分发线程，由预取窗口限制broker发送 //
+            std::string text = tmsg->getText();
+            KActivemqWorker* worker = m_workers[s.m_index % m_workers.size()];
+            while (!(rc = worker->Post(text)) && m_state == CSConnected)
+                klib::KTime::MSleep(1);
+        }
+
+        // 处理失败或未交给处理线程的消息不确认，等待重新投递 //
+        if (!rc)
             throw decaf::lang::exceptions::RuntimeException();
+
+        switch (m_opts.ackMode)
+        {
+        case AckIndividual:
+            msg->acknowledge();
+            break;
+        case AckBatch:
+        {
+            // CLIENT_ACKNOWLEDGE确认会话中之前所有的消息 //
+            uint64_t now = 0;
+            klib::KTime::NowMillisecond(now);
+            s.Acknowledge(msg, now);
+            break;
+        }
+        default:
+            break;
+        }
     }
 };
\ No newline at end of file
@@ -15,7 +15,12 @@
 #include <activemq/library/ActiveMQCPP.h>
 
 #include "thread/KAtomic.h"
+#include "thread/KEventObject.h"
+#include "thread/KMutex.h"
+#include "thread/KLockGuard.h"
+#include "thread/KPthread.h"
 #include <stdint.h>
+#include <vector>
 using namespace activemq;
 using namespace activemq::core;
 using namespace activemq::transport;
@@ -25,6 +30,101 @@ using namespace decaf::util::concurrent;
 using namespace cms;
 
 namespace thirdparty {
+    // 确认方式 //
+    enum ActivemqAckMode
+    {
+        // 每条消息单独确认 //
+        AckIndividual = 0,
+        // 每ackBatchSize条或ackIntervalMs确认一次，定时确认空闲时剩余的消息，未确认的在重连后重新投递 //
+        AckBatch = 1,
+        // 由客户端批量延迟确认(optimizeAcknowledge)，可能重复 //
+        AckOptimistic = 2,
+        // OnText返回后不确认，处理完成后由子类调用Acknowledge，未确认的在重连后重新投递 //
+        AckDeferred = 3
+    };
+
+    struct ActivemqConsumerOptions
+    {
+        // 预取消息数 //
+        int prefetch;
+        // 同一队列上的会话数，每个会话一个分发线程 //
+        size_t sessions;
+        ActivemqAckMode ackMode;
+        uint32_t ackBatchSize;
+        uint32_t ackIntervalMs;
+        // 大于0时消息复制后交给处理线程，OnTextAsync在处理线程中调用，同一会话的消息顺序不变 //
+        size_t workers;
+        size_t workerQueueSize;
+
+        ActivemqConsumerOptions()
+            :prefetch(10), sessions(1), ackMode(AckIndividual), ackBatchSize(100), ackIntervalMs(100),
+            workers(0), workerQueueSize(10000)
+        {
+
+        }
+    };
+
+    class KActivemqConsumer;
+
+    // 会话的消息回调，记录批量确认状态 //
+    class KActivemqSession :public cms::MessageListener
+    {
+    public:
+        KActivemqSession(KActivemqConsumer& owner, size_t index)
+            :m_owner(owner), m_index(index), m_session(NULL), m_consumer(NULL), m_unacked(0), m_firstUnacked(0),
+            m_last(NULL)
+        {
+
+        }
+
+        virtual ~KActivemqSession();
+
+        virtual void onMessage(const Message* message);
+
+        /************************************
+        * Method:    批量确认，未确认的消息超过ackBatchSize或ackIntervalMs时确认
+        * Returns:
+        * Parameter: msg 收到的消息
+        * Parameter: now
+        *************************************/
+        void Acknowledge(const Message* msg, uint64_t now);
+
+        /************************************
+        * Method:    确认最后收到的消息，同时确认之前的
+        * Returns:
+        * Parameter: now
+        * Parameter: intervalMs 第一条未确认的消息等待超过该时间才确认，0为立即确认
+        *************************************/
+        void Flush(uint64_t now, uint32_t intervalMs);
+
+    public:
+        KActivemqConsumer& m_owner;
+        size_t m_index;
+        Session* m_session;
+        MessageConsumer* m_consumer;
+        uint32_t m_unacked;
+        uint64_t m_firstUnacked;
+        // 最后一条未确认消息的副本，用于定时确认 //
+        Message* m_last;
+        klib::KMutex m_mtx;
+    };
+
+    // 消息处理线程 //
+    class KActivemqWorker :public klib::KEventObject<std::string>
+    {
+    public:
+        KActivemqWorker(KActivemqConsumer& owner, size_t maxSize)
+            :klib::KEventObject<std::string>("KActivemqWorker Thread", maxSize), m_owner(owner)
+        {
+
+        }
+
+    protected:
+        virtual void ProcessEvent(const std::string& ev);
+
+    private:
+        KActivemqConsumer& m_owner;
+    };
 
     class KActivemqConsumer:public cms::ExceptionListener,
         public cms::MessageListener,
@@ -32,7 +132,11 @@ namespace thirdparty {
     {
     public:
         enum ConsumerState { CSDisconnected = 0, CSConnected = 1, CSException = 2 };
-        KActivemqConsumer(const std::vector<std::string>& brokers, const std::string& destURI);
+        friend class KActivemqSession;
+        friend class KActivemqWorker;
+    public:
+        KActivemqConsumer(const std::vector<std::string>& brokers, const std::string& destURI,
+            const ActivemqConsumerOptions& opts = ActivemqConsumerOptions());
 
         static void Initialize();
         static void Shutdown();
@@ -55,8 +159,30 @@ namespace thirdparty {
     protected:
         virtual bool OnText(const TextMessage* msg) { return true; }
 
+        // workers大于0时在处理线程中调用，消息已确认 //
+        virtual void OnTextAsync(const std::string& /*text*/) {}
+
+        /************************************
+        * Method:    AckDeferred时确认单条消息，可在其他线程调用
+        * Returns:   连接已重建或确认失败时返回false，消息会重新投递
+        * Parameter: msg OnText中收到的消息的副本
+        * Parameter: generation 收到消息时的GetGeneration()
+        *************************************/
+        bool Acknowledge(const Message* msg, uint32_t generation);
+
+        // 连接代数，每次Cleanup后加1 //
+        inline uint32_t GetGeneration() const { return m_generation; }
+
         virtual void onMessage(const Message* message);
 
+        /************************************
+        * Method:    处理一条消息并按确认方式确认
+        * Returns:
+        * Parameter: s 收到消息的会话
+        * Parameter: msg
+        *************************************/
+        void Dispatch(KActivemqSession& s, const Message* msg);
+
         virtual void onException(const CMSException& ex)
         {
             m_state = CSException;
@@ -77,6 +203,15 @@ namespace thirdparty {
         virtual void Cleanup();
         std::string GetBrokerUrl(const std::vector<std::string>& ips) const;
 
+        // 停止处理线程，等待已收到的消息处理完成 //
+        void StopWorkers();
+
+        // 确认各会话中等待批量确认的消息，all为true时不检查时间 //
+        void FlushAcks(bool all);
+
+        // 定时确认线程 //
+        int AckLoop(int);
+
     protected:
         Connection* m_connection;
         Session* m_session;
@@ -85,6 +220,16 @@ namespace thirdparty {
         std::string m_destURI;
         MessageConsumer* m_consumer;
         klib::AtomicInteger<int32_t> m_state;
+        ActivemqConsumerOptions m_opts;
+        // m_session和m_consumer为第一个会话的 //
+        std::vector<KActivemqSession*> m_sessions;
+        std::vector<KActivemqWorker*> m_workers;
+        // 保护m_sessions，定时确认线程和重连时使用 //
+        klib::KMutex m_sessionMtx;
+        klib::KPthread m_ackThread;
+        volatile bool m_acking;
+        // 会话释放后之前收到的消息不能再确认 //
+        klib::AtomicInteger<uint32_t> m_generation;
     };
 };
 
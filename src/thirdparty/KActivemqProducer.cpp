@@ -0,0 +1,284 @@
+#include "KActivemqProducer.h"
+#include "util/KTime.h"
+#include <sstream>
+
+#define ActivemqReconnectInterval 3000
+
+namespace thirdparty {
+    KActivemqProducer::KActivemqProducer(const std::vector<std::string>& brokers, const std::string& destURI,
+        const ActivemqProducerOptions& opts)
+        :klib::KEventObject<ActivemqOutMessage>("KActivemqProducer Thread", opts.queueSize),
+        m_connection(NULL),
+        m_session(NULL),
+        m_producer(NULL),
+        m_destination(NULL),
+        m_destURI(destURI),
+        m_opts(opts),
+        m_state(PSDisconnected),
+        m_lastConnect(0),
+        m_uncommitted(0),
+        m_sent(0),
+        m_failed(0)
+    {
+        m_brokerURI = GetBrokerUrl(brokers);
+        printf("<%s> broker url:[%s]\n", __FUNCTION__, m_brokerURI.c_str());
+    }
+
+    KActivemqProducer::~KActivemqProducer()
+    {
+        Stop();
+    }
+
+    bool KActivemqProducer::Start()
+    {
+        if (IsRunning())
+            return true;
+        return klib::KEventObject<ActivemqOutMessage>::Start();
+    }
+
+    void KActivemqProducer::Stop(int ms)
+    {
+        if (!IsRunning())
+            return;
+
+        uint64_t begin = 0, now = 0;
+        klib::KTime::NowMillisecond(begin);
+        now = begin;
+        while (!IsEmpty() && m_state == PSConnected && now - begin < uint64_t(ms))
+        {
+            klib::KTime::MSleep(1);
+            klib::KTime::NowMillisecond(now);
+        }
+
+        klib::KEventObject<ActivemqOutMessage>::Stop();
+        klib::KEventObject<ActivemqOutMessage>::WaitForStop();
+        std::vector<ActivemqOutMessage> rest;
+        Flush(rest);
+        m_failed += rest.size();
+        for (size_t i = 0; i < rest.size(); ++i)
+            Complete(rest[i].cb, rest[i].param, false, "producer stopped");
+
+        if (m_state == PSConnected)
+            Commit();
+        Cleanup();
+    }
+
+    bool KActivemqProducer::Send(const std::string& text)
+    {
+        ActivemqOutMessage msg;
+        msg.text = text;
+        return Post(msg);
+    }
+
+    bool KActivemqProducer::Send(const std::string& dest, const std::string& text)
+    {
+        ActivemqOutMessage msg;
+        msg.dest = dest;
+        msg.text = text;
+        return Post(msg);
+    }
+
+    bool KActivemqProducer::Send(const std::string& dest, const std::string& text, ActivemqSendCb cb, void* param)
+    {
+        ActivemqOutMessage msg;
+        msg.dest = dest;
+        msg.text = text;
+        msg.cb = cb;
+        msg.param = param;
+        return Post(msg);
+    }
+
+    void KActivemqProducer::ProcessEvent(const ActivemqOutMessage& ev)
+    {
+        // 断开时在发送线程中重连，期间消息在队列中等待 //
+        while (IsRunning() && !Connect())
+            klib::KTime::MSleep(100);
+        if (m_state != PSConnected)
+        {
+            ++m_failed;
+            Complete(ev.cb, ev.param, false, "not connected");
+            return;
+        }
+
+        const std::string& dest = (ev.dest.empty() ? m_destURI : ev.dest);
+        if (dest.empty())
+        {
+            ++m_failed;
+            Complete(ev.cb, ev.param, false, "no destination");
+            return;
+        }
+
+        cms::TextMessage* msg = NULL;
+        try {
+            msg = m_session->createTextMessage(ev.text);
+            m_producer->send(GetDestination(dest), msg);
+            delete msg;
+
+            if (m_opts.batchSize == 0)
+            {
+                ++m_sent;
+                Complete(ev.cb, ev.param, true, std::string());
+                return;
+            }
+
+            // 批量提交，队列空时不再等待，提交后回调 //
+            if (ev.cb)
+                m_callbacks.push_back(std::make_pair(ev.cb, ev.param));
+            if (++m_uncommitted >= m_opts.batchSize || IsEmpty())
+                Commit();
+        }
+        catch (cms::CMSException& e)
+        {
+            printf("<%s> Producer send Exception:[%s].\n", __FUNCTION__, e.what());
+            Release(msg);
+            m_failed += m_uncommitted + 1;
+            m_uncommitted = 0;
+            m_state = PSException;
+            CompleteUncommitted(false, e.what());
+            Complete(ev.cb, ev.param, false, e.what());
+        }
+    }
+
+    void KActivemqProducer::Commit()
+    {
+        if (m_uncommitted == 0 || m_session == NULL)
+            return;
+
+        try {
+            m_session->commit();
+            m_sent += m_uncommitted;
+            CompleteUncommitted(true, std::string());
+        }
+        catch (cms::CMSException& e)
+        {
+            printf("<%s> Producer commit Exception:[%s].\n", __FUNCTION__, e.what());
+            m_failed += m_uncommitted;
+            m_state = PSException;
+            CompleteUncommitted(false, e.what());
+        }
+        m_uncommitted = 0;
+    }
+
+    void KActivemqProducer::CompleteUncommitted(bool success, const std::string& error)
+    {
+        std::vector<std::pair<ActivemqSendCb, void*> > callbacks;
+        callbacks.swap(m_callbacks);
+        for (size_t i = 0; i < callbacks.size(); ++i)
+            Complete(callbacks[i].first, callbacks[i].second, success, error);
+    }
+
+    void KActivemqProducer::Complete(ActivemqSendCb cb, void* param, bool success, const std::string& error)
+    {
+        if (cb)
+            cb(success, error, param);
+    }
+
+    bool KActivemqProducer::Connect()
+    {
+        if (m_state == PSConnected)
+            return true;
+
+        uint64_t now = 0;
+        klib::KTime::NowMillisecond(now);
+        if (now - m_lastConnect < ActivemqReconnectInterval)
+            return false;
+        m_lastConnect = now;
+
+        Cleanup();
+        activemq::core::ActiveMQConnectionFactory* factory = NULL;
+        bool rc = false;
+        try {
+            printf("<%s> Producer Starting.\n", __FUNCTION__);
+            factory = new activemq::core::ActiveMQConnectionFactory(m_brokerURI);
+            factory->setUseAsyncSend(m_opts.asyncSend);
+            if (m_opts.windowSize > 0)
+                factory->setProducerWindowSize(m_opts.windowSize);
+            m_connection = factory->createConnection();
+
+            activemq::core::ActiveMQConnection* amqConnection =
+                dynamic_cast<activemq::core::ActiveMQConnection*>(m_connection);
+            if (amqConnection != NULL)
+                amqConnection->addTransportListener(this);
+
+            m_connection->start();
+            m_connection->setExceptionListener(this);
+            m_session = m_connection->createSession(m_opts.batchSize > 0
+                ? cms::Session::SESSION_TRANSACTED : cms::Session::AUTO_ACKNOWLEDGE);
+            if (!m_destURI.empty())
+                m_destination = GetDestination(m_destURI);
+            // 不绑定目的地，可以发送到不同的目的地 //
+            m_producer = m_session->createProducer(NULL);
+            m_producer->setDeliveryMode(m_opts.persistent
+                ? cms::DeliveryMode::PERSISTENT : cms::DeliveryMode::NON_PERSISTENT);
+            m_producer->setDisableMessageTimeStamp(true);
+            printf("<%s> Producer Started.\n", __FUNCTION__);
+            m_state = PSConnected;
+            rc = true;
+        }
+        catch (cms::CMSException& e)
+        {
+            printf("<%s> Producer Exception:[%s].\n", __FUNCTION__, e.what());
+            m_state = PSException;
+        }
+
+        if (factory)
+            delete factory;
+        return rc;
+    }
+
+    void KActivemqProducer::Cleanup()
+    {
+        try {
+            if (m_connection != NULL)
+                m_connection->close();
+        }
+        catch (cms::CMSException& e) {}
+
+        std::map<std::string, cms::Destination*>::iterator it = m_destinations.begin();
+        while (it != m_destinations.end())
+        {
+            Release(it->second);
+            ++it;
+        }
+        m_destinations.clear();
+        m_destination = NULL;
+        Release(m_producer);
+        Release(m_session);
+        Release(m_connection);
+        CompleteUncommitted(false, "connection closed");
+        m_uncommitted = 0;
+        m_state = PSDisconnected;
+    }
+
+    cms::Destination* KActivemqProducer::GetDestination(const std::string& dest)
+    {
+        std::map<std::string, cms::Destination*>::iterator it = m_destinations.find(dest);
+        if (it != m_destinations.end())
+            return it->second;
+
+        cms::Destination* d = (m_opts.topic
+            ? static_cast<cms::Destination*>(m_session->createTopic(dest))
+            : static_cast<cms::Destination*>(m_session->createQueue(dest)));
+        m_destinations[dest] = d;
+        return d;
+    }
+
+    std::string KActivemqProducer::GetBrokerUrl(const std::vector<std::string>& ips) const
+    {
+        std::ostringstream os;
+        os << "failover:(";
+        std::vector<std::string>::const_iterator it = ips.begin();
+        while (it != ips.end())
+        {
+            os << "tcp://" << *it << ":61616";
+            if (++it != ips.end())
+                os << ",";
+        }
+        os << ")?";
+        os << "randomize=false&nested.wireFormat.maxInactivityDuration=3000&nested.connectionTimeout=2000"
+            << "&maxReconnectAttempts=2&timeout=2000&initialReconnectDelay=50&startupMaxReconnectAttempts=2"
+            << "&maxReconnectDelay=100";
+
+        return os.str();
+    }
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cms/Connection.h>
+#include <cms/Session.h>
+#include <cms/Destination.h>
+#include <cms/ExceptionListener.h>
+#include <cms/MessageProducer.h>
+#include <cms/CMSException.h>
+#include <cms/TextMessage.h>
+#include <cms/DeliveryMode.h>
+#include <activemq/transport/DefaultTransportListener.h>
+#include <activemq/core/ActiveMQConnectionFactory.h>
+#include <activemq/core/ActiveMQConnection.h>
+
+#include "thread/KAtomic.h"
+#include "thread/KEventObject.h"
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+namespace thirdparty {
+    /************************************
+    * Method:    发送结果回调，在发送线程中执行
+    * Parameter: success 非事务时为发送完成，事务时为提交完成
+    * Parameter: error 失败时的错误信息
+    * Parameter: param 发送时传入的参数
+    *************************************/
+    typedef void (*ActivemqSendCb)(bool success, const std::string& error, void* param);
+
+    struct ActivemqOutMessage
+    {
+        // 为空时发送到默认目的地 //
+        std::string dest;
+        std::string text;
+        ActivemqSendCb cb;
+        void* param;
+
+        ActivemqOutMessage()
+            :cb(NULL), param(NULL)
+        {
+
+        }
+    };
+
+    struct ActivemqProducerOptions
+    {
+        // 异步发送，不等待broker确认 //
+        bool asyncSend;
+        // 异步发送时未确认的最大字节数，超过时阻塞，0为不限制 //
+        unsigned int windowSize;
+        // 大于0时使用事务会话，每batchSize条或队列空时提交一次 //
+        size_t batchSize;
+        bool persistent;
+        // 目的地是否为topic //
+        bool topic;
+        size_t queueSize;
+
+        ActivemqProducerOptions()
+            :asyncSend(true), windowSize(1024 * 1024), batchSize(0), persistent(true), topic(false), queueSize(100000)
+        {
+
+        }
+    };
+
+    // 消息入队后由发送线程发送，连接和会话只在发送线程中使用，可以多线程调用Send //
+    // 使用前需要调用KActivemqConsumer::Initialize初始化库 //
+    class KActivemqProducer :public klib::KEventObject<ActivemqOutMessage>,
+        public cms::ExceptionListener,
+        public activemq::transport::DefaultTransportListener
+    {
+    public:
+        enum ProducerState { PSDisconnected = 0, PSConnected = 1, PSException = 2 };
+        KActivemqProducer(const std::vector<std::string>& brokers, const std::string& destURI,
+            const ActivemqProducerOptions& opts = ActivemqProducerOptions());
+
+        virtual ~KActivemqProducer();
+
+        virtual bool Start();
+
+        /************************************
+        * Method:    停止，等待队列中的消息发送
+        * Returns:
+        * Parameter: ms 最长等待时间
+        *************************************/
+        virtual void Stop(int ms);
+
+        virtual void Stop() { Stop(3000); }
+
+        // 队列满或未启动时返回false //
+        bool Send(const std::string& text);
+
+        bool Send(const std::string& dest, const std::string& text);
+
+        // 返回true时cb一定会被调用，停止时队列中未发送的以失败回调 //
+        bool Send(const std::string& dest, const std::string& text, ActivemqSendCb cb, void* param);
+
+        inline bool IsConnected() const { return m_state == PSConnected; }
+
+        inline uint64_t Sent() const { return m_sent; }
+
+        inline uint64_t Failed() const { return m_failed; }
+
+    protected:
+        virtual void ProcessEvent(const ActivemqOutMessage& ev);
+
+        virtual void onException(const cms::CMSException& ex)
+        {
+            m_state = PSException;
+            printf("CMS Exception occurred:[%s].\n", ex.what());
+        }
+
+        virtual void transportInterrupted()
+        {
+            printf("The Producer's Transport has been Interrupted.\n");
+        }
+
+        virtual void transportResumed()
+        {
+            printf("The Producer's Transport has been Restored.\n");
+        }
+
+    private:
+        bool Connect();
+
+        void Cleanup();
+
+        // 提交事务，失败时未提交的消息计为失败 //
+        void Commit();
+
+        // 回调事务中未提交的消息 //
+        void CompleteUncommitted(bool success, const std::string& error);
+
+        static void Complete(ActivemqSendCb cb, void* param, bool success, const std::string& error);
+
+        cms::Destination* GetDestination(const std::string& dest);
+
+        template<typename PointerType>
+        static void Release(PointerType*& p)
+        {
+            try {
+                if (p != NULL) delete p;
+            }
+            catch (cms::CMSException& e) {}
+            p = NULL;
+        }
+
+        std::string GetBrokerUrl(const std::vector<std::string>& ips) const;
+
+    private:
+        cms::Connection* m_connection;
+        cms::Session* m_session;
+        cms::MessageProducer* m_producer;
+        // 默认目的地，在m_destinations中 //
+        cms::Destination* m_destination;
+        std::map<std::string, cms::Destination*> m_destinations;
+        std::string m_brokerURI;
+        std::string m_destURI;
+        ActivemqProducerOptions m_opts;
+        klib::AtomicInteger<int32_t> m_state;
+        uint64_t m_lastConnect;
+        size_t m_uncommitted;
+        // 未提交消息的回调 //
+        std::vector<std::pair<ActivemqSendCb, void*> > m_callbacks;
+
+        klib::AtomicInteger<uint64_t> m_sent;
+        klib::AtomicInteger<uint64_t> m_failed;
+    };
+};
@@ -0,0 +1,417 @@
+#include "thirdparty/KInfluxDbAsyncClient.h"
+
+namespace thirdparty {
+    KInfluxFuture::~KInfluxFuture()
+    {
+        Reset();
+    }
+
+    long KInfluxFuture::GetStatus() const
+    {
+        InfluxResult r;
+        Get(r);
+        return r.status;
+    }
+
+    bool KInfluxFuture::IsSuccess() const
+    {
+        InfluxResult r;
+        return Get(r) && r.status / 100 == 2;
+    }
+
+    long KInfluxFuture::GetResponse(std::string& resp) const
+    {
+        InfluxResult r;
+        if (Get(r))
+            resp.swap(r.resp);
+        return r.status;
+    }
+
+    void KInfluxFuture::Reset()
+    {
+        InfluxResult old;
+        KFuture<InfluxResult>::Reset(old);
+    }
+
+    void KInfluxFuture::Complete(long status, std::string& resp)
+    {
+        InfluxResult r;
+        r.status = status;
+        r.resp.swap(resp);
+        KFuture<InfluxResult>::Complete(r);
+    }
+
+    KInfluxDbAsyncClient::KInfluxDbAsyncClient()
+        :m_requests(NULL), m_nextNode(0), m_gzipLevel(0), m_multi(NULL), m_gzipHeaders(NULL), m_maxInflight(0), m_inflight(0),
+        m_running(false), m_loopThread("KInfluxDbAsyncClient loop thread")
+    {
+
+    }
+
+    KInfluxDbAsyncClient::~KInfluxDbAsyncClient()
+    {
+        Stop();
+    }
+
+    bool KInfluxDbAsyncClient::Start(const std::vector<KInfluxDbClient>& nodes, uint16_t connections, size_t maxPending)
+    {
+        if (m_running || nodes.empty())
+            return false;
+
+        m_nodes.clear();
+        m_gzipLevel = 0;
+        std::vector<KInfluxDbClient>::const_iterator it = nodes.begin();
+        while (it != nodes.end())
+        {
+            if (!it->GetWriteUrl().empty())
+            {
+                InfluxNode node;
+                node.writeurl = it->GetWriteUrl();
+                node.queryurl = it->GetQueryUrl();
+                node.downUntil = 0;
+                // 请求在选择节点前压缩且可能转到其它节点，所有节点都开启压缩时才压缩，取最小级别 //
+                int level = it->GetCompression();
+                if (m_nodes.empty() || level < m_gzipLevel)
+                    m_gzipLevel = level;
+                m_nodes.push_back(node);
+            }
+            ++it;
+        }
+        if (m_nodes.empty())
+            return false;
+
+        if (connections == 0)
+            connections = 1;
+        m_multi = curl_multi_init();
+        if (m_multi == NULL)
+            return false;
+        // 连接由multi句柄缓存，请求结束后保持keep-alive供后续请求复用 //
+        curl_multi_setopt(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, long(connections));
+        curl_multi_setopt(m_multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, long(connections * m_nodes.size()));
+        curl_multi_setopt(m_multi, CURLMOPT_MAXCONNECTS, long(connections * m_nodes.size()));
+        m_gzipHeaders = curl_slist_append(NULL, "Content-Encoding: gzip");
+        m_maxInflight = connections * m_nodes.size() * 2;
+        m_requests = new KQueue<InfluxAsyncRequest*>(maxPending > 0 ? maxPending : 1);
+
+        m_running = true;
+        if (m_loopThread.Run(this, &KInfluxDbAsyncClient::Loop, 0) != KPthread::Success)
+        {
+            m_running = false;
+            Stop();
+            return false;
+        }
+        return true;
+    }
+
+    void KInfluxDbAsyncClient::Stop()
+    {
+        bool running = false;
+        {
+            // 与Submit互斥，之后的请求都被拒绝，不会在队列释放后入队 //
+            KLockGuard<KMutex> lock(m_submitMtx);
+            running = m_running;
+            m_running = false;
+        }
+
+        if (running)
+        {
+#if LIBCURL_VERSION_NUM >= 0x074400
+            curl_multi_wakeup(m_multi);
+#endif
+            m_loopThread.Join();
+        }
+
+        if (m_requests)
+        {
+            std::deque<InfluxAsyncRequest*> left;
+            m_requests->GetAll(left);
+            std::deque<InfluxAsyncRequest*>::iterator it = left.begin();
+            while (it != left.end())
+            {
+                Complete(*it, 0);
+                ++it;
+            }
+            delete m_requests;
+            m_requests = NULL;
+        }
+
+        std::vector<CURL*>::iterator it = m_idle.begin();
+        while (it != m_idle.end())
+        {
+            curl_easy_cleanup(*it);
+            ++it;
+        }
+        m_idle.clear();
+
+        if (m_multi)
+        {
+            curl_multi_cleanup(m_multi);
+            m_multi = NULL;
+        }
+
+        if (m_gzipHeaders)
+        {
+            curl_slist_free_all(m_gzipHeaders);
+            m_gzipHeaders = NULL;
+        }
+    }
+
+    bool KInfluxDbAsyncClient::Write(const std::string& lines, KInfluxFuture& future)
+    {
+        future.Reset();
+        InfluxAsyncRequest* req = new InfluxAsyncRequest;
+        req->write = true;
+        req->future = &future;
+        future.SetSubmitted(true);
+        if (!Submit(req, lines))
+        {
+            future.SetSubmitted(false);
+            return false;
+        }
+        return true;
+    }
+
+    bool KInfluxDbAsyncClient::Write(const std::string& lines, InfluxResponseCb cb, void* param)
+    {
+        InfluxAsyncRequest* req = new InfluxAsyncRequest;
+        req->write = true;
+        req->cb = cb;
+        req->param = param;
+        return Submit(req, lines);
+    }
+
+    bool KInfluxDbAsyncClient::Query(const std::string& sql, KInfluxFuture& future)
+    {
+        future.Reset();
+        InfluxAsyncRequest* req = new InfluxAsyncRequest;
+        req->future = &future;
+        future.SetSubmitted(true);
+        if (!Submit(req, std::string("q=") + sql))
+        {
+            future.SetSubmitted(false);
+            return false;
+        }
+        return true;
+    }
+
+    bool KInfluxDbAsyncClient::Query(const std::string& sql, InfluxResponseCb cb, void* param)
+    {
+        InfluxAsyncRequest* req = new InfluxAsyncRequest;
+        req->cb = cb;
+        req->param = param;
+        return Submit(req, std::string("q=") + sql);
+    }
+
+    size_t KInfluxDbAsyncClient::Pending() const
+    {
+        return m_inflight + (m_requests ? m_requests->Size() : 0);
+    }
+
+    bool KInfluxDbAsyncClient::Submit(InfluxAsyncRequest* req, const std::string& body)
+    {
+        if (!m_running)
+        {
+            delete req;
+            return false;
+        }
+
+        // 在调用线程中压缩，分散压缩的开销 //
+        if (req->write && m_gzipLevel > 0 && body.size() >= InfluxGzipMinBytes
+            && KInfluxDbClient::Gzip(body.c_str(), body.size(), req->body, m_gzipLevel))
+            req->gzip = true;
+        else
+            req->body = body;
+
+        KLockGuard<KMutex> lock(m_submitMtx);
+        if (!m_running || !m_requests->PushBack(req))
+        {
+            delete req;
+            return false;
+        }
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_wakeup(m_multi);
+#endif
+        return true;
+    }
+
+    int KInfluxDbAsyncClient::Loop(int)
+    {
+        std::deque<InfluxAsyncRequest*> reqs;
+        while (m_running)
+        {
+            if (m_inflight < m_maxInflight)
+            {
+                reqs.clear();
+                m_requests->GetPart(m_maxInflight - m_inflight, reqs);
+                std::deque<InfluxAsyncRequest*>::iterator it = reqs.begin();
+                while (it != reqs.end())
+                {
+                    Dispatch(*it);
+                    ++it;
+                }
+            }
+
+            int running = 0;
+            curl_multi_perform(m_multi, &running);
+
+            int left = 0;
+            CURLMsg* msg = NULL;
+            while ((msg = curl_multi_info_read(m_multi, &left)) != NULL)
+            {
+                if (msg->msg == CURLMSG_DONE)
+                    Done(msg->easy_handle, msg->data.result);
+            }
+
+            // 有请求排队且未达到上限时不等待 //
+            if (m_inflight < m_maxInflight && !m_requests->IsEmpty())
+                continue;
+#if LIBCURL_VERSION_NUM >= 0x074400
+            curl_multi_poll(m_multi, NULL, 0, 100, NULL);
+#else
+            int numfds = 0;
+            curl_multi_wait(m_multi, NULL, 0, 10, &numfds);
+#endif
+        }
+
+        // 停止时进行中的请求以状态0完成 //
+        std::set<CURL*>::iterator it = m_active.begin();
+        while (it != m_active.end())
+        {
+            InfluxAsyncRequest* req = NULL;
+            curl_easy_getinfo(*it, CURLINFO_PRIVATE, reinterpret_cast<char**>(&req));
+            curl_multi_remove_handle(m_multi, *it);
+            curl_easy_cleanup(*it);
+            if (req)
+                Complete(req, 0);
+            --m_inflight;
+            ++it;
+        }
+        m_active.clear();
+        return 0;
+    }
+
+    void KInfluxDbAsyncClient::Dispatch(InfluxAsyncRequest* req)
+    {
+        // 轮询选择节点，跳过暂停使用的，全部暂停时仍按顺序选择 //
+        uint64_t now = 0;
+        KTime::NowMillisecond(now);
+        size_t node = m_nextNode % m_nodes.size();
+        for (size_t i = 0; i < m_nodes.size(); ++i)
+        {
+            size_t n = (m_nextNode + i) % m_nodes.size();
+            if (m_nodes[n].downUntil <= now)
+            {
+                node = n;
+                break;
+            }
+        }
+        m_nextNode = node + 1;
+        req->node = node;
+
+        CURL* curl = NULL;
+        if (!m_idle.empty())
+        {
+            curl = m_idle.back();
+            m_idle.pop_back();
+            curl_easy_reset(curl);
+        }
+        else
+            curl = curl_easy_init();
+        if (curl == NULL)
+        {
+            Complete(req, 0);
+            return;
+        }
+
+        const InfluxNode& target = m_nodes[node];
+        curl_easy_setopt(curl, CURLOPT_URL, (req->write ? target.writeurl : target.queryurl).c_str());
+        curl_easy_setopt(curl, CURLOPT_POST, 1);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req->body.c_str());
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, curl_off_t(req->body.size()));
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req->gzip ? m_gzipHeaders : NULL);
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, false);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, false);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 3);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 300);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &req->resp);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, req);
+        if (curl_multi_add_handle(m_multi, curl) != CURLM_OK)
+        {
+            curl_easy_cleanup(curl);
+            Complete(req, 0);
+            return;
+        }
+        m_active.insert(curl);
+        ++m_inflight;
+    }
+
+    void KInfluxDbAsyncClient::Done(CURL* curl, CURLcode cc)
+    {
+        InfluxAsyncRequest* req = NULL;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, reinterpret_cast<char**>(&req));
+        long status = 0;
+        if (cc == CURLE_OK)
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        curl_multi_remove_handle(m_multi, curl);
+        m_active.erase(curl);
+        --m_inflight;
+
+        if (cc == CURLE_OK)
+            m_idle.push_back(curl);
+        else
+            curl_easy_cleanup(curl);
+
+        if (req == NULL)
+            return;
+
+        // 连接不上时请求还未发出，暂停该节点并转到其它节点 //
+        if (cc == CURLE_COULDNT_CONNECT || cc == CURLE_COULDNT_RESOLVE_HOST)
+        {
+            uint64_t now = 0;
+            KTime::NowMillisecond(now);
+            InfluxNode& node = m_nodes[req->node];
+            if (node.downUntil <= now)
+                printf("KInfluxDbAsyncClient node unreachable:[%s]\n", node.writeurl.c_str());
+            node.downUntil = now + InfluxNodeRetryInterval;
+            if (++req->attempts < m_nodes.size() && m_running)
+            {
+                req->resp.clear();
+                Dispatch(req);
+                return;
+            }
+        }
+        else if (cc != CURLE_OK)
+            printf("KInfluxDbAsyncClient request error:[%d]\n", cc);
+
+        Complete(req, status);
+    }
+
+    void KInfluxDbAsyncClient::Complete(InfluxAsyncRequest* req, long status)
+    {
+        if (req->future)
+            req->future->Complete(status, req->resp);
+        else if (req->cb)
+        {
+            try
+            {
+                req->cb(status, req->resp, req->param);
+            }
+            catch (const std::exception& e)
+            {
+                printf("KInfluxDbAsyncClient callback exception:[%s]\n", e.what());
+            }
+        }
+        delete req;
+    }
+
+    size_t KInfluxDbAsyncClient::AppendCallback(void* data, size_t size, size_t nmemb, void* buffer)
+    {
+        size_t sz = size * nmemb;
+        static_cast<std::string*>(buffer)->append(static_cast<const char*>(data), sz);
+        return sz;
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+#ifndef _INFLUXDB_ASYNC_HPP_
+#define _INFLUXDB_ASYNC_HPP_
+
+#include "thirdparty/KInfluxDbClient.h"
+#include "thread/KPthread.h"
+#include "thread/KQueue.h"
+#include "thread/KFuture.h"
+#include "thread/KAtomic.h"
+#include <deque>
+#include <set>
+/**
+influxdb并发请求客户端类
+一个后台线程驱动curl_multi，多个写入和查询同时在多个keep-alive连接上进行，
+支持多个节点轮询，连接失败的节点暂停使用并把请求转到其它节点，结果通过future或回调返回
+**/
+namespace thirdparty {
+    using namespace klib;
+// 连接失败的节点暂停使用的毫秒数 //
+#define InfluxNodeRetryInterval 1000
+
+    /************************************
+    * Method:    应答回调，在后台线程中执行
+    * Parameter: status HTTP状态码，连接失败为0
+    * Parameter: resp 应答内容
+    * Parameter: param 用户参数
+    *************************************/
+    typedef void (*InfluxResponseCb)(long status, const std::string& resp, void* param);
+
+    struct InfluxResult
+    {
+        // HTTP状态码，连接失败或未完成为0 //
+        long status;
+        std::string resp;
+
+        InfluxResult()
+            :status(0)
+        {
+
+        }
+    };
+
+    class KInfluxFuture :public KFuture<InfluxResult>
+    {
+    public:
+        // 析构时等待请求完成，停止时所有请求都会完成 //
+        ~KInfluxFuture();
+
+        /************************************
+        * Method:    获取HTTP状态码
+        * Returns:   连接失败或未完成为0
+        *************************************/
+        long GetStatus() const;
+
+        // 状态码为2xx //
+        bool IsSuccess() const;
+
+        /************************************
+        * Method:    获取应答内容
+        * Returns:   HTTP状态码
+        * Parameter: resp
+        *************************************/
+        long GetResponse(std::string& resp) const;
+
+        /************************************
+        * Method:    重置以便复用，未完成时等待完成
+        * Returns:
+        *************************************/
+        void Reset();
+
+    private:
+        void Complete(long status, std::string& resp);
+
+        friend class KInfluxDbAsyncClient;
+    };
+
+    struct InfluxAsyncRequest
+    {
+        bool write;
+        // 已压缩时带Content-Encoding头 //
+        bool gzip;
+        std::string body;
+        std::string resp;
+        KInfluxFuture* future;
+        InfluxResponseCb cb;
+        void* param;
+        // 发送到的节点和已尝试的节点数 //
+        size_t node;
+        size_t attempts;
+
+        InfluxAsyncRequest()
+            :write(false), gzip(false), future(NULL), cb(NULL), param(NULL), node(0), attempts(0)
+        {
+
+        }
+    };
+
+    class KInfluxDbAsyncClient
+    {
+    public:
+        KInfluxDbAsyncClient();
+
+        virtual ~KInfluxDbAsyncClient();
+
+        /************************************
+        * Method:    启动
+        * Returns:
+        * Parameter: nodes 各节点的客户端，使用它们的地址和压缩设置，所有节点都开启压缩时才压缩
+        * Parameter: connections 每个节点的最大连接数
+        * Parameter: maxPending 最大排队请求数
+        *************************************/
+        bool Start(const std::vector<KInfluxDbClient>& nodes, uint16_t connections = 8, size_t maxPending = 100000);
+
+        /************************************
+        * Method:    停止，未完成的请求以状态0完成
+        * Returns:
+        *************************************/
+        void Stop();
+
+        /************************************
+        * Method:    异步写入行协议数据
+        * Returns:   入队成功返回true
+        * Parameter: lines
+        * Parameter: future 由调用者持有直到完成
+        *************************************/
+        bool Write(const std::string& lines, KInfluxFuture& future);
+
+        bool Write(const std::string& lines, InfluxResponseCb cb, void* param);
+
+        /************************************
+        * Method:    异步查询
+        * Returns:   入队成功返回true
+        * Parameter: sql
+        * Parameter: future 应答为JSON，可用KInfluxQueryParser解析
+        *************************************/
+        bool Query(const std::string& sql, KInfluxFuture& future);
+
+        bool Query(const std::string& sql, InfluxResponseCb cb, void* param);
+
+        // 排队和进行中的请求数 //
+        size_t Pending() const;
+
+    private:
+        struct InfluxNode
+        {
+            std::string writeurl;
+            std::string queryurl;
+            // 连接失败后恢复使用的时间 //
+            uint64_t downUntil;
+        };
+
+        bool Submit(InfluxAsyncRequest* req, const std::string& body);
+
+        int Loop(int);
+
+        // 选择节点并加入multi句柄 //
+        void Dispatch(InfluxAsyncRequest* req);
+
+        // 处理完成的请求 //
+        void Done(CURL* curl, CURLcode cc);
+
+        static void Complete(InfluxAsyncRequest* req, long status);
+
+        static size_t AppendCallback(void* data, size_t size, size_t nmemb, void* buffer);
+
+    private:
+        std::vector<InfluxNode> m_nodes;
+        // 启动时按最大排队数创建 //
+        KQueue<InfluxAsyncRequest*>* m_requests;
+        size_t m_nextNode;
+        // 写入压缩级别，0不压缩 //
+        int m_gzipLevel;
+        CURLM* m_multi;
+        // 空闲的easy句柄 //
+        std::vector<CURL*> m_idle;
+        // 进行中的easy句柄 //
+        std::set<CURL*> m_active;
+        curl_slist* m_gzipHeaders;
+        // 同时进行的最大请求数，其余的在队列中等待 //
+        size_t m_maxInflight;
+        AtomicInteger<size_t> m_inflight;
+        volatile bool m_running;
+        // 入队与停止互斥 //
+        KMutex m_submitMtx;
+        KPthread m_loopThread;
+    };
+};
+#endif
@@ -1,6 +1,24 @@
 #include "thirdparty/KInfluxDbClient.h"
+#include "thirdparty/KInfluxLineBuilder.h"
+#include <zlib.h>
 
 namespace thirdparty {
+    /**
+    分块查询的上下文，按换行拆分出每一块JSON
+    **/
+    struct InfluxChunkContext
+    {
+        KInfluxDbClient* client;
+        InfluxChunkCb cb;
+        void* param;
+        // 不为空时按行流式解析，不构造DOM //
+        KInfluxQueryParser* parser;
+        std::string buf;
+        // 已查找过换行的位置 //
+        size_t scanned;
+        bool aborted;
+    };
+
     void KInfluxDbClient::Initialize(const std::string& host, const std::string& database, const std::string& username, const std::string& password)
     {
         m_host = host;
@@ -24,46 +42,33 @@ namespace thirdparty {
         const std::map<std::string, std::string>& numfields, 
         const std::map<std::string, std::string>& strfields)
     {
-        // table,tag1="1",tag2="2" field1=1,field2=2
-        // table name
-        std::string s(tablename);
-        if (!tags.empty())
-            s.push_back(',');
-
-        // tags
+        // table,tag1=1,tag2=2 field1=1,field2="2"
+        // tag值不加引号，数值字段原样输出，字符串字段加引号，按行协议转义
+        KInfluxLineBuilder builder(256);
+        builder.Measurement(tablename);
+        std::map<std::string, std::string>::const_iterator it = tags.begin();
+        while (it != tags.end())
         {
-            std::map<std::string, std::string>::const_iterator sit = tags.begin();
-            while (sit != tags.end())
-            {
-                s.append(sit->first + "=\"" + sit->second + "\",");
-                ++sit;
-            }
-            s.resize(s.length() - 1);//去掉多余的逗号
+            builder.Tag(it->first, it->second);
+            ++it;
         }
-        if (!numfields.empty() || !strfields.empty())
-            s.push_back(' ');
-        // num fields
+
+        it = numfields.begin();
+        while (it != numfields.end())
         {
-            std::map<std::string, std::string>::const_iterator nit = numfields.begin();
-            while (nit != numfields.end())
-            {
-                s.append(nit->first + "=" + nit->second + ",");
-                ++nit;
-            }
-            s.resize(s.length() - 1);
+            builder.FieldRaw(it->first, it->second);
+            ++it;
         }
 
-        // str fields
+        it = strfields.begin();
+        while (it != strfields.end())
         {
-            std::map<std::string, std::string>::const_iterator nit = strfields.begin();
-            while (nit != strfields.end())
-            {
-                s.append(nit->first + "=\"" + nit->second + "\",");
-                ++nit;
-            }
-            s.resize(s.length() - 1);
+            builder.Field(it->first, it->second);
+            ++it;
         }
-        return s;
+
+        const std::string& line = builder.Str();
+        return line.empty() ? line : line.substr(0, line.size() - 1);
     }
 
     bool KInfluxDbClient::CreateDB(const std::string& database)
@@ -89,7 +94,7 @@ namespace thirdparty {
     bool KInfluxDbClient::InsertPoint(const std::string& sql)
     {
         std::string resp;
-        return Post(m_writeurl, sql, resp);
+        return Perform(m_writeurl, sql, WriteCallback, &resp, m_gzipLevel > 0);
     }
 
     bool KInfluxDbClient::QueryMesurement(const std::string& sql, std::string& tablename, QueryResult& qr)
@@ -100,6 +105,84 @@ namespace thirdparty {
         return false;
     }
 
+    bool KInfluxDbClient::QueryChunked(const std::string& sql, InfluxChunkCb cb, void* param, uint32_t chunkSize)
+    {
+        InfluxChunkContext ctx;
+        ctx.client = this;
+        ctx.cb = cb;
+        ctx.param = param;
+        ctx.parser = NULL;
+        ctx.scanned = 0;
+        ctx.aborted = false;
+        return Chunked(sql, ctx, chunkSize);
+    }
+
+    bool KInfluxDbClient::QueryRows(const std::string& sql, KInfluxRowHandler& handler, uint32_t chunkSize)
+    {
+        KInfluxQueryParser parser(handler);
+        InfluxChunkContext ctx;
+        ctx.client = this;
+        ctx.cb = NULL;
+        ctx.param = NULL;
+        ctx.parser = &parser;
+        ctx.scanned = 0;
+        ctx.aborted = false;
+        return Chunked(sql, ctx, chunkSize);
+    }
+
+    bool KInfluxDbClient::Chunked(const std::string& sql, InfluxChunkContext& ctx, uint32_t chunkSize)
+    {
+        char num[24];
+        std::string url = m_queryurl + "&chunked=true&chunk_size=";
+        url.append(num, KStringUtility::FormatInt64(chunkSize, num));
+        bool rc = Perform(url, std::string("q=") + sql, ChunkCallback, &ctx, false);
+        // 最后一块可能没有换行 //
+        if (rc && !ctx.aborted && !ctx.buf.empty())
+            rc = ProcessChunk(ctx, ctx.buf.c_str(), ctx.buf.size());
+        return rc && !ctx.aborted;
+    }
+
+    bool KInfluxDbClient::ProcessChunk(InfluxChunkContext& ctx, const char* dat, size_t sz)
+    {
+        if (ctx.parser)
+        {
+            if (ctx.parser->Parse(dat, sz))
+                return true;
+            if (!ctx.parser->IsAborted())
+                printf("KInfluxdbCli query error:[%s]\n", ctx.parser->GetError().c_str());
+            ctx.aborted = true;
+            return false;
+        }
+
+        std::string tablename;
+        QueryResult qr;
+        if (ParseResponse(std::string(dat, sz), tablename, qr) && !ctx.cb(tablename, qr, ctx.param))
+        {
+            ctx.aborted = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool KInfluxDbClient::Gzip(const char* dat, size_t sz, std::string& out, int level)
+    {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        // windowBits加16输出gzip格式 //
+        if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+
+        out.resize(deflateBound(&zs, uLong(sz)) + 32);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(dat));
+        zs.avail_in = uInt(sz);
+        zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        zs.avail_out = uInt(out.size());
+        int rc = deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        return rc == Z_STREAM_END;
+    }
+
     void KInfluxDbClient::SetEasyOpt(const std::string& url, CURL* curl, std::string* resp) const
     {
         // set opts  
@@ -114,6 +197,8 @@ namespace thirdparty {
         curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
         curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 3);
         curl_easy_setopt(curl, CURLOPT_TIMEOUT, 300);
+        // 空字符串表示接受curl支持的所有压缩格式，自动解压 //
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
 
         //curl_slist *headers = NULL;
         //headers = curl_slist_append(headers, "Content-Type:application/octet-stream; charset=UTF-8");
@@ -123,28 +208,29 @@ namespace thirdparty {
 
     bool KInfluxDbClient::ParseResponse(const std::string& resp, std::string& tablename, QueryResult& qr)
     {
-        rapidjson::Document doc;
+        // 直接解析到结果的文档中，列和行移动出来，不再复制 //
+        rapidjson::Document& doc = qr.doc;
         doc.Parse(resp);
         if (!doc.HasParseError() && doc.HasMember("results"))
         {
-            const rapidjson::Value& rval = doc["results"];
+            rapidjson::Value& rval = doc["results"];
             if (rval.IsArray())
             {
-                const rapidjson::Value& sval = rval[rval.Size() - 1];
+                rapidjson::Value& sval = rval[rval.Size() - 1];
                 if (sval.HasMember("series"))
                 {
-                    const rapidjson::Value& series = sval["series"];
+                    rapidjson::Value& series = sval["series"];
                     if (series.IsArray())
                     {
-                        const rapidjson::Value& last = series[series.Size() - 1];
+                        rapidjson::Value& last = series[series.Size() - 1];
                         if (last.HasMember("name"))
                         {
                             tablename = last["name"].GetString();
                         }
-                        qr.fields.CopyFrom(last["columns"], qr.doc.GetAllocator());
+                        qr.fields = last["columns"];
                         if (last.HasMember("values"))
                         {
-                            qr.rows.CopyFrom(last["values"], qr.doc.GetAllocator());
+                            qr.rows = last["values"];
                         }
                         return true;
                     }
@@ -154,6 +240,27 @@ namespace thirdparty {
         return false;
     }
 
+    size_t KInfluxDbClient::ChunkCallback(void* data, size_t size, size_t nmemb, void* buffer)
+    {
+        InfluxChunkContext* ctx = static_cast<InfluxChunkContext*>(buffer);
+        size_t sz = size * nmemb;
+        ctx->buf.append(static_cast<const char*>(data), sz);
+
+        // 每一块是一行完整的JSON //
+        size_t start = 0;
+        size_t pos = 0;
+        while ((pos = ctx->buf.find('\n', std::max(start, ctx->scanned))) != std::string::npos)
+        {
+            // 返回值与数据长度不同时curl中止传输 //
+            if (pos > start && !ctx->client->ProcessChunk(*ctx, ctx->buf.c_str() + start, pos - start))
+                return 0;
+            start = pos + 1;
+        }
+        ctx->buf.erase(0, start);
+        ctx->scanned = ctx->buf.size();
+        return sz;
+    }
+
     size_t KInfluxDbClient::WriteCallback(void* data, size_t size, size_t nmemb, void* buffer)
     {
         std::string* resp = static_cast<std::string*>(buffer);
@@ -166,6 +273,11 @@ namespace thirdparty {
     bool KInfluxDbClient::Post(const std::string& url, const std::string& dat, std::string& resp)
     {
         resp.clear();
+        return Perform(url, dat, WriteCallback, &resp, false);
+    }
+
+    bool KInfluxDbClient::Perform(const std::string& url, const std::string& dat, WriteFunc cb, void* userdata, bool gzip)
+    {
         if (m_host.empty())
             return false;
         long rc = 0;
@@ -174,15 +286,31 @@ namespace thirdparty {
             CURL* curl = curl_easy_init();
             if (curl)
             {
-                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, dat.c_str()); // data  
+                std::string zipped;
+                const std::string* body = &dat;
+                curl_slist* headers = NULL;
+                if (gzip && dat.size() >= InfluxGzipMinBytes && Gzip(dat.c_str(), dat.size(), zipped, m_gzipLevel))
+                {
+                    body = &zipped;
+                    headers = curl_slist_append(headers, "Content-Encoding: gzip");
+                }
+
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->c_str()); // data  
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, curl_off_t(body->size()));
                 curl_easy_setopt(curl, CURLOPT_POST, 1); // post req 
-                SetEasyOpt(url, curl, &resp);
+                SetEasyOpt(url, curl, NULL);
+                curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, cb);
+                curl_easy_setopt(curl, CURLOPT_WRITEDATA, userdata);
+                if (headers)
+                    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
                 CURLcode cc;
                 if (CURLE_OK == (cc = curl_easy_perform(curl)))
                     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &rc);
                 else
                     printf("error code:[%d]\n", cc);
                 curl_easy_cleanup(curl);
+                if (headers)
+                    curl_slist_free_all(headers);
             }
         }
         catch (const std::exception& e)
@@ -13,9 +13,14 @@
 #include "rapidjson/rapidjson.h"
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
+#include "thirdparty/KInfluxQueryParser.h"
 
 namespace thirdparty {
     using namespace klib;
+// 小于该大小的写入不压缩 //
+#define InfluxGzipMinBytes 1024
+// 分块查询默认每块的行数 //
+#define InfluxChunkSize 10000
 
     struct Measurement
     {
@@ -57,11 +62,22 @@ namespace thirdparty {
         rapidjson::Document doc;
     };
 
+    /************************************
+    * Method:    分块查询回调，每收到一块调用一次
+    * Returns:   返回false停止查询
+    * Parameter: tablename
+    * Parameter: qr 本块的数据
+    * Parameter: param 用户参数
+    *************************************/
+    typedef bool (*InfluxChunkCb)(const std::string& tablename, const QueryResult& qr, void* param);
+
+    struct InfluxChunkContext;
+
     class KInfluxDbClient
     {
     public:
         KInfluxDbClient()
-            :m_rp("autogen")
+            :m_rp("autogen"), m_gzipLevel(1)
         {
 
         }
@@ -70,6 +86,7 @@ namespace thirdparty {
 
         bool Ping();
 
+        // 单个点转换为行协议，大量写入使用KInfluxLineBuilder //
         std::string DumpToInfluxdbPoint(const std::string& tablename,
             const std::map<std::string, std::string>& tags,
             const std::map<std::string, std::string>& numfields,
@@ -94,7 +111,51 @@ namespace thirdparty {
 
         bool QueryMesurement(const std::string& sql, std::string& tablename, QueryResult& qr);
 
+        /************************************
+        * Method:    分块查询，服务端按chunk_size分块返回，收到一块处理一块，不需要缓存整个结果
+        * Returns:   查询成功且没有被回调中止返回true
+        * Parameter: sql
+        * Parameter: cb
+        * Parameter: param
+        * Parameter: chunkSize 每块的行数
+        *************************************/
+        bool QueryChunked(const std::string& sql, InfluxChunkCb cb, void* param, uint32_t chunkSize = InfluxChunkSize);
+
+        /************************************
+        * Method:    流式查询，分块请求并用SAX逐行解析，不构造DOM，适合大结果集
+        * Returns:   查询成功且没有被回调中止返回true
+        * Parameter: sql
+        * Parameter: handler 逐行回调，可使用KInfluxColumnCollector按列收集
+        * Parameter: chunkSize 每块的行数
+        *************************************/
+        bool QueryRows(const std::string& sql, KInfluxRowHandler& handler, uint32_t chunkSize = InfluxChunkSize);
+
+        /************************************
+        * Method:    设置写入的gzip压缩级别
+        * Returns:
+        * Parameter: level 0不压缩，1-9
+        *************************************/
+        inline void SetCompression(int level) { m_gzipLevel = level; }
+
+        /************************************
+        * Method:    gzip压缩
+        * Returns:
+        * Parameter: dat
+        * Parameter: sz
+        * Parameter: out
+        * Parameter: level
+        *************************************/
+        static bool Gzip(const char* dat, size_t sz, std::string& out, int level);
+
+        inline const std::string& GetWriteUrl() const { return m_writeurl; }
+
+        inline const std::string& GetQueryUrl() const { return m_queryurl; }
+
+        inline int GetCompression() const { return m_gzipLevel; }
+
     private:
+        typedef size_t (*WriteFunc)(void* data, size_t size, size_t nmemb, void* buffer);
+
         void SetEasyOpt(const std::string& url, CURL* curl, std::string* resp) const;
 
         bool ParseResponse(const std::string& resp, std::string& tablename, QueryResult& qr);
@@ -103,6 +164,24 @@ namespace thirdparty {
 
         bool Post(const std::string& url, const std::string& dat, std::string& resp);
 
+        /************************************
+        * Method:    发送POST请求
+        * Returns:   返回2xx时为true
+        * Parameter: url
+        * Parameter: dat
+        * Parameter: cb 应答数据回调
+        * Parameter: userdata 回调参数
+        * Parameter: gzip 是否压缩请求
+        *************************************/
+        bool Perform(const std::string& url, const std::string& dat, WriteFunc cb, void* userdata, bool gzip);
+
+        bool Chunked(const std::string& sql, InfluxChunkContext& ctx, uint32_t chunkSize);
+
+        // 处理一块数据，返回false中止查询 //
+        bool ProcessChunk(InfluxChunkContext& ctx, const char* dat, size_t sz);
+
+        static size_t ChunkCallback(void* data, size_t size, size_t nmemb, void* buffer);
+
     private:
         std::string m_database;
         std::string m_host;
@@ -112,5 +191,6 @@ namespace thirdparty {
         std::string m_writeurl;
         std::string m_queryurl;
         std::string m_rp;
+        int m_gzipLevel;
     };
 };
@@ -0,0 +1,377 @@
+#include "thirdparty/KInfluxDbWriter.h"
+
+namespace thirdparty {
+    KInfluxDbWriter::KInfluxDbWriter()
+        :m_buffered(0), m_curl(NULL), m_gzipHeaders(NULL), m_running(false), m_urgent(false),
+        m_flushThread("KInfluxDbWriter flush thread"), m_spillSize(0), m_nextReplay(0),
+        m_sentBytes(0), m_sentBatches(0), m_failedBatches(0), m_spilledBytes(0), m_droppedBytes(0)
+    {
+
+    }
+
+    KInfluxDbWriter::~KInfluxDbWriter()
+    {
+        Stop();
+        std::vector<Stripe*>::iterator it = m_stripes.begin();
+        while (it != m_stripes.end())
+        {
+            delete *it;
+            ++it;
+        }
+        m_stripes.clear();
+    }
+
+    bool KInfluxDbWriter::Start(const KInfluxDbClient& client, const InfluxWriterOptions& opts)
+    {
+        if (m_running || client.GetWriteUrl().empty())
+            return false;
+
+        m_url = client.GetWriteUrl();
+        m_opts = opts;
+        if (m_opts.stripes == 0)
+            m_opts.stripes = 1;
+        if (m_opts.batchBytes == 0)
+            m_opts.batchBytes = 1024 * 1024;
+        while (m_stripes.size() < m_opts.stripes)
+            m_stripes.push_back(new Stripe);
+
+        if (!m_opts.spillPath.empty())
+        {
+            // 上次补发中断的数据放回文件 //
+            std::string replay = m_opts.spillPath + ".replay";
+            FILE* f = fopen(replay.c_str(), "rb");
+            if (f)
+            {
+                std::string chunk;
+                Respill(f, chunk);
+                fclose(f);
+                remove(replay.c_str());
+            }
+
+            f = fopen(m_opts.spillPath.c_str(), "rb");
+            if (f)
+            {
+                fseek(f, 0, SEEK_END);
+                long sz = ftell(f);
+                m_spillSize = (sz > 0 ? uint64_t(sz) : 0);
+                fclose(f);
+            }
+        }
+
+        m_running = true;
+        if (m_flushThread.Run(this, &KInfluxDbWriter::FlushLoop, 0) != KPthread::Success)
+        {
+            m_running = false;
+            return false;
+        }
+        return true;
+    }
+
+    void KInfluxDbWriter::Stop()
+    {
+        if (!m_running)
+            return;
+
+        m_running = false;
+        m_flushCond.NotifyAll();
+        m_flushThread.Join();
+        if (m_curl)
+        {
+            curl_easy_cleanup(m_curl);
+            m_curl = NULL;
+        }
+        if (m_gzipHeaders)
+        {
+            curl_slist_free_all(m_gzipHeaders);
+            m_gzipHeaders = NULL;
+        }
+    }
+
+    bool KInfluxDbWriter::Write(const std::string& lines)
+    {
+        return Write(lines.c_str(), lines.size());
+    }
+
+    bool KInfluxDbWriter::Write(KInfluxLineBuilder& points)
+    {
+        const std::string& lines = points.Str();
+        return Write(lines.c_str(), lines.size());
+    }
+
+    bool KInfluxDbWriter::Write(const char* lines, size_t sz)
+    {
+        if (!m_running || sz == 0)
+            return false;
+
+        bool newline = (lines[sz - 1] != '\n');
+        size_t added = sz + (newline ? 1 : 0);
+        if (size_t(m_buffered) + added > m_opts.maxBufferBytes)
+        {
+            // 发送跟不上时直接写磁盘 //
+            if (m_opts.spillPath.empty())
+            {
+                m_droppedBytes += added;
+                return false;
+            }
+            std::string dat(lines, sz);
+            if (newline)
+                dat.push_back('\n');
+            return Spill(dat.c_str(), dat.size());
+        }
+
+        // 按线程分散到不同分片，减少锁竞争 //
+        Stripe& stripe = *m_stripes[KPthread::GetThreadId() % m_stripes.size()];
+        size_t size = 0;
+        {
+            KLockGuard<KMutex> lock(stripe.mtx);
+            stripe.buf.append(lines, sz);
+            if (newline)
+                stripe.buf.push_back('\n');
+            size = stripe.buf.size();
+        }
+        m_buffered += added;
+
+        if (size >= m_opts.batchBytes)
+            Flush();
+        return true;
+    }
+
+    void KInfluxDbWriter::Flush()
+    {
+        m_urgent = true;
+        m_flushCond.Notify();
+    }
+
+    InfluxWriterStats KInfluxDbWriter::GetStats() const
+    {
+        InfluxWriterStats stats;
+        stats.sentBytes = m_sentBytes;
+        stats.sentBatches = m_sentBatches;
+        stats.failedBatches = m_failedBatches;
+        stats.spilledBytes = m_spilledBytes;
+        stats.droppedBytes = m_droppedBytes;
+        stats.bufferedBytes = m_buffered;
+        return stats;
+    }
+
+    int KInfluxDbWriter::FlushLoop(int)
+    {
+        std::string batch;
+        while (true)
+        {
+            {
+                KLockGuard<KMutex> lock(m_flushMtx);
+                if (m_running && !m_urgent)
+                    m_flushCond.TimedWait(lock, m_opts.lingerMs);
+                m_urgent = false;
+            }
+
+            // 停止时最后发送一次，不重试 //
+            bool running = m_running;
+            batch.clear();
+            Collect(batch);
+            uint64_t now = 0;
+            KTime::NowMillisecond(now);
+            if (!batch.empty())
+            {
+                if (!Send(batch, running))
+                {
+                    Spill(batch.c_str(), batch.size());
+                    m_nextReplay = now + m_opts.retryMaxMs;
+                }
+                else if (running)
+                    Replay();
+            }
+            else if (running && now >= m_nextReplay && !Replay())
+                m_nextReplay = now + m_opts.retryMaxMs;
+
+            if (!running)
+                break;
+        }
+        return 0;
+    }
+
+    void KInfluxDbWriter::Collect(std::string& batch)
+    {
+        std::vector<Stripe*>::iterator it = m_stripes.begin();
+        while (it != m_stripes.end())
+        {
+            KLockGuard<KMutex> lock((*it)->mtx);
+            if (!(*it)->buf.empty())
+            {
+                batch.append((*it)->buf);
+                // 保留容量，避免下次写入重新分配 //
+                (*it)->buf.clear();
+            }
+            ++it;
+        }
+        m_buffered -= batch.size();
+    }
+
+    bool KInfluxDbWriter::Send(const std::string& batch, bool retry)
+    {
+        uint32_t wait = m_opts.retryBaseMs;
+        for (uint16_t i = 0; ; ++i)
+        {
+            long rc = PostOnce(batch);
+            if (rc / 100 == 2)
+            {
+                m_sentBytes += batch.size();
+                ++m_sentBatches;
+                return true;
+            }
+
+            // 数据格式错误，重试也不会成功 //
+            if (rc / 100 == 4)
+            {
+                printf("KInfluxDbWriter batch rejected:[%ld], bytes:[%d]\n", rc, int(batch.size()));
+                ++m_failedBatches;
+                return true;
+            }
+
+            if (!retry || i >= m_opts.maxRetries || !m_running)
+                break;
+
+            // 分段等待，停止时尽快退出 //
+            for (uint32_t slept = 0; slept < wait && m_running; slept += 50)
+                KTime::MSleep(50);
+            wait = std::min(wait * 2, m_opts.retryMaxMs);
+        }
+        ++m_failedBatches;
+        return false;
+    }
+
+    long KInfluxDbWriter::PostOnce(const std::string& batch)
+    {
+        if (m_curl == NULL)
+        {
+            // 句柄保持不释放，连接保持keep-alive复用 //
+            m_curl = curl_easy_init();
+            if (m_curl == NULL)
+                return 0;
+            curl_easy_setopt(m_curl, CURLOPT_URL, m_url.c_str());
+            curl_easy_setopt(m_curl, CURLOPT_POST, 1);
+            curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYPEER, false);
+            curl_easy_setopt(m_curl, CURLOPT_SSL_VERIFYHOST, false);
+            curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, DiscardCallback);
+            curl_easy_setopt(m_curl, CURLOPT_NOSIGNAL, 1);
+            curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT, 3);
+            curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, 30);
+            curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        }
+
+        const std::string* body = &batch;
+        curl_slist* headers = NULL;
+        if (m_opts.gzipLevel > 0 && batch.size() >= InfluxGzipMinBytes
+            && KInfluxDbClient::Gzip(batch.c_str(), batch.size(), m_zipped, m_opts.gzipLevel))
+        {
+            if (m_gzipHeaders == NULL)
+                m_gzipHeaders = curl_slist_append(NULL, "Content-Encoding: gzip");
+            body = &m_zipped;
+            headers = m_gzipHeaders;
+        }
+
+        curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(m_curl, CURLOPT_POSTFIELDS, body->c_str());
+        curl_easy_setopt(m_curl, CURLOPT_POSTFIELDSIZE_LARGE, curl_off_t(body->size()));
+        long rc = 0;
+        CURLcode cc = curl_easy_perform(m_curl);
+        if (cc == CURLE_OK)
+            curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &rc);
+        else
+        {
+            printf("KInfluxDbWriter post error:[%d]\n", cc);
+            // 连接出错时重建句柄 //
+            curl_easy_cleanup(m_curl);
+            m_curl = NULL;
+        }
+        return rc;
+    }
+
+    bool KInfluxDbWriter::Spill(const char* dat, size_t sz)
+    {
+        KLockGuard<KMutex> lock(m_spillMtx);
+        if (m_opts.spillPath.empty() || m_spillSize + sz > m_opts.maxSpillBytes)
+        {
+            m_droppedBytes += sz;
+            return false;
+        }
+
+        FILE* f = fopen(m_opts.spillPath.c_str(), "ab");
+        if (f == NULL)
+        {
+            m_droppedBytes += sz;
+            return false;
+        }
+        size_t n = fwrite(dat, 1, sz, f);
+        fclose(f);
+        m_spillSize += n;
+        m_spilledBytes += n;
+        if (n < sz)
+            m_droppedBytes += sz - n;
+        return n == sz;
+    }
+
+    void KInfluxDbWriter::Respill(FILE* f, std::string& chunk)
+    {
+        std::vector<char> buf(m_opts.batchBytes);
+        size_t n = 0;
+        while ((n = fread(&buf[0], 1, buf.size(), f)) > 0)
+            chunk.append(&buf[0], n);
+        if (!chunk.empty())
+            Spill(chunk.c_str(), chunk.size());
+        chunk.clear();
+    }
+
+    bool KInfluxDbWriter::Replay()
+    {
+        if (m_opts.spillPath.empty())
+            return true;
+
+        // 改名后补发，补发期间新的失败数据写入新文件 //
+        std::string replay = m_opts.spillPath + ".replay";
+        {
+            KLockGuard<KMutex> lock(m_spillMtx);
+            if (m_spillSize == 0)
+                return true;
+            if (rename(m_opts.spillPath.c_str(), replay.c_str()) != 0)
+                return false;
+            m_spillSize = 0;
+        }
+
+        FILE* f = fopen(replay.c_str(), "rb");
+        if (f == NULL)
+            return false;
+
+        bool ok = true;
+        std::string chunk;
+        std::vector<char> buf(m_opts.batchBytes);
+        while (ok && m_running)
+        {
+            size_t n = fread(&buf[0], 1, buf.size(), f);
+            if (n == 0)
+                break;
+            chunk.append(&buf[0], n);
+            // 按整行发送 //
+            size_t pos = chunk.rfind('\n');
+            if (pos == std::string::npos)
+                continue;
+
+            std::string lines(chunk, 0, pos + 1);
+            ok = Send(lines, false);
+            if (ok)
+                chunk.erase(0, pos + 1);
+        }
+
+        // 未发送的部分写回文件 //
+        Respill(f, chunk);
+        fclose(f);
+        remove(replay.c_str());
+        return ok;
+    }
+
+    size_t KInfluxDbWriter::DiscardCallback(void* /*data*/, size_t size, size_t nmemb, void* /*buffer*/)
+    {
+        return size * nmemb;
+    }
+};
@@ -0,0 +1,171 @@
+#pragma once
+#ifndef _INFLUXDB_WRITER_HPP_
+#define _INFLUXDB_WRITER_HPP_
+
+#include "thirdparty/KInfluxDbClient.h"
+#include "thirdparty/KInfluxLineBuilder.h"
+#include "thread/KPthread.h"
+#include "thread/KMutex.h"
+#include "thread/KLockGuard.h"
+#include "thread/KCondVariable.h"
+#include "thread/KAtomic.h"
+#include <algorithm>
+/**
+influxdb异步批量写入类
+多个线程写入的行协议数据按线程分散到多个缓存，后台线程按大小或等待时间合并发送，
+复用keep-alive连接，失败按指数退避重试，仍然失败时写入磁盘，恢复后补发
+**/
+namespace thirdparty {
+    using namespace klib;
+
+    struct InfluxWriterOptions
+    {
+        // 缓存达到该大小时立即发送 //
+        size_t batchBytes;
+        // 最长等待毫秒数 //
+        uint32_t lingerMs;
+        // 内存中最多缓存的字节数，超过时直接写磁盘，未配置磁盘时丢弃 //
+        size_t maxBufferBytes;
+        // 重试次数 //
+        uint16_t maxRetries;
+        // 首次重试等待毫秒数，之后每次翻倍 //
+        uint32_t retryBaseMs;
+        uint32_t retryMaxMs;
+        // 写失败的数据保存的文件，为空不保存 //
+        std::string spillPath;
+        // 文件最大字节数，超过后丢弃 //
+        uint64_t maxSpillBytes;
+        // 缓存分片个数 //
+        uint16_t stripes;
+        // gzip压缩级别，0不压缩 //
+        int gzipLevel;
+
+        InfluxWriterOptions()
+            :batchBytes(1024 * 1024), lingerMs(100), maxBufferBytes(64 * 1024 * 1024),
+            maxRetries(5), retryBaseMs(100), retryMaxMs(10000),
+            maxSpillBytes(uint64_t(1024) * 1024 * 1024), stripes(8), gzipLevel(1)
+        {
+
+        }
+    };
+
+    struct InfluxWriterStats
+    {
+        uint64_t sentBytes;
+        uint64_t sentBatches;
+        uint64_t failedBatches;
+        uint64_t spilledBytes;
+        uint64_t droppedBytes;
+        size_t bufferedBytes;
+    };
+
+    class KInfluxDbWriter
+    {
+    public:
+        KInfluxDbWriter();
+
+        ~KInfluxDbWriter();
+
+        /************************************
+        * Method:    启动后台发送线程
+        * Returns:
+        * Parameter: client 使用它的写入地址
+        * Parameter: opts
+        *************************************/
+        bool Start(const KInfluxDbClient& client, const InfluxWriterOptions& opts = InfluxWriterOptions());
+
+        /************************************
+        * Method:    停止，发送剩余数据，发送失败的写入磁盘
+        * Returns:
+        *************************************/
+        void Stop();
+
+        /************************************
+        * Method:    写入一行或多行行协议数据，可以多线程调用
+        * Returns:   未运行或缓存满且不能写磁盘时返回false
+        * Parameter: lines 不需要以换行结尾
+        *************************************/
+        bool Write(const std::string& lines);
+
+        bool Write(const char* lines, size_t sz);
+
+        /************************************
+        * Method:    写入构造好的点，调用者可以Clear后复用
+        * Returns:
+        * Parameter: points
+        *************************************/
+        bool Write(KInfluxLineBuilder& points);
+
+        /************************************
+        * Method:    唤醒后台线程立即发送
+        * Returns:
+        *************************************/
+        void Flush();
+
+        InfluxWriterStats GetStats() const;
+
+    private:
+        struct Stripe
+        {
+            KMutex mtx;
+            std::string buf;
+        };
+
+        int FlushLoop(int);
+
+        // 取出所有分片的数据 //
+        void Collect(std::string& batch);
+
+        /************************************
+        * Method:    发送，失败时按退避重试
+        * Returns:   成功或数据错误(4xx，重试无意义)返回true
+        * Parameter: batch
+        * Parameter: retry 是否重试
+        *************************************/
+        bool Send(const std::string& batch, bool retry);
+
+        /************************************
+        * Method:    发送一次
+        * Returns:   HTTP状态码，连接失败返回0
+        * Parameter: batch
+        *************************************/
+        long PostOnce(const std::string& batch);
+
+        bool Spill(const char* dat, size_t sz);
+
+        // chunk和文件剩余的数据写回磁盘 //
+        void Respill(FILE* f, std::string& chunk);
+
+        // 补发磁盘中的数据，全部成功返回true //
+        bool Replay();
+
+        static size_t DiscardCallback(void* data, size_t size, size_t nmemb, void* buffer);
+
+    private:
+        InfluxWriterOptions m_opts;
+        std::string m_url;
+        std::vector<Stripe*> m_stripes;
+        AtomicInteger<size_t> m_buffered;
+        // 复用的连接 //
+        CURL* m_curl;
+        // 压缩请求的头部和复用的压缩缓存 //
+        curl_slist* m_gzipHeaders;
+        std::string m_zipped;
+        KMutex m_flushMtx;
+        KCondVariable m_flushCond;
+        volatile bool m_running;
+        volatile bool m_urgent;
+        KPthread m_flushThread;
+        KMutex m_spillMtx;
+        uint64_t m_spillSize;
+        // 空闲时下次补发的时间 //
+        uint64_t m_nextReplay;
+
+        AtomicInteger<uint64_t> m_sentBytes;
+        AtomicInteger<uint64_t> m_sentBatches;
+        AtomicInteger<uint64_t> m_failedBatches;
+        AtomicInteger<uint64_t> m_spilledBytes;
+        AtomicInteger<uint64_t> m_droppedBytes;
+    };
+};
+#endif
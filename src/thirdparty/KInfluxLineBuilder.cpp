@@ -0,0 +1,212 @@
+#include "thirdparty/KInfluxLineBuilder.h"
+#include <cstdio>
+#include <cstdlib>
+
+namespace thirdparty {
+    // measurement只转义逗号和空格 //
+    static const char* MeasurementSpecials = ", ";
+    // tag和字段名转义逗号、等号和空格 //
+    static const char* KeySpecials = ",= ";
+    // 字符串字段值转义双引号和反斜杠 //
+    static const char* StringSpecials = "\"\\";
+
+    KInfluxLineBuilder::KInfluxLineBuilder(size_t reserve)
+        :m_lineStart(0), m_state(stateNone), m_points(0)
+    {
+        m_buf.reserve(reserve);
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Measurement(const char* name, size_t sz)
+    {
+        End();
+        m_lineStart = m_buf.size();
+        AppendEscaped(name, sz, MeasurementSpecials);
+        m_state = stateTags;
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Tag(const char* key, size_t ksz, const char* val, size_t vsz)
+    {
+        // 行协议不允许空的tag值 //
+        if (m_state != stateTags || ksz == 0 || vsz == 0)
+            return *this;
+
+        m_buf.push_back(',');
+        AppendEscaped(key, ksz, KeySpecials);
+        m_buf.push_back('=');
+        AppendEscaped(val, vsz, KeySpecials);
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Field(const char* key, size_t ksz, int64_t val)
+    {
+        if (m_state == stateNone)
+            return *this;
+
+        char buf[24];
+        FieldKey(key, ksz);
+        m_buf.append(buf, KStringUtility::FormatInt64(val, buf));
+        m_buf.push_back('i');
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Field(const char* key, size_t ksz, uint64_t val)
+    {
+        // 同一字段的类型要一致，能表示为有符号整数的都按有符号输出 //
+        if (int64_t(val) >= 0)
+            return Field(key, ksz, int64_t(val));
+        if (m_state == stateNone)
+            return *this;
+
+        char buf[24];
+        char* t = buf + sizeof(buf);
+        do
+        {
+            *--t = char('0' + val % 10);
+            val /= 10;
+        } while (val != 0);
+        FieldKey(key, ksz);
+        m_buf.append(t, buf + sizeof(buf) - t);
+        m_buf.push_back('u');
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Field(const char* key, size_t ksz, double val)
+    {
+        // NaN不等于自身，无穷大减自身为NaN //
+        if (m_state == stateNone || val != val || val - val != 0)
+            return *this;
+
+        char buf[32];
+        FieldKey(key, ksz);
+        m_buf.append(buf, FormatDouble(val, buf));
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Field(const char* key, size_t ksz, bool val)
+    {
+        if (m_state == stateNone)
+            return *this;
+
+        FieldKey(key, ksz);
+        if (val)
+            m_buf.append("true", 4);
+        else
+            m_buf.append("false", 5);
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Field(const char* key, size_t ksz, const char* val, size_t vsz)
+    {
+        if (m_state == stateNone)
+            return *this;
+
+        FieldKey(key, ksz);
+        m_buf.push_back('"');
+        AppendEscaped(val, vsz, StringSpecials);
+        m_buf.push_back('"');
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::FieldRaw(const std::string& key, const std::string& val)
+    {
+        if (m_state == stateNone || val.empty())
+            return *this;
+
+        FieldKey(key.c_str(), key.size());
+        m_buf.append(val);
+        return *this;
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::Timestamp(int64_t ts)
+    {
+        if (m_state == stateFields)
+        {
+            char buf[24];
+            m_buf.push_back(' ');
+            m_buf.append(buf, KStringUtility::FormatInt64(ts, buf));
+        }
+        return End();
+    }
+
+    KInfluxLineBuilder& KInfluxLineBuilder::End()
+    {
+        if (m_state == stateFields)
+        {
+            m_buf.push_back('\n');
+            ++m_points;
+        }
+        else if (m_state == stateTags)
+        {
+            // 没有字段的点是非法的，丢弃 //
+            m_buf.resize(m_lineStart);
+        }
+        m_state = stateNone;
+        return *this;
+    }
+
+    const std::string& KInfluxLineBuilder::Str()
+    {
+        End();
+        return m_buf;
+    }
+
+    void KInfluxLineBuilder::Clear()
+    {
+        m_buf.clear();
+        m_lineStart = 0;
+        m_state = stateNone;
+        m_points = 0;
+    }
+
+    void KInfluxLineBuilder::FieldKey(const char* key, size_t ksz)
+    {
+        m_buf.push_back(m_state == stateFields ? ',' : ' ');
+        m_state = stateFields;
+        AppendEscaped(key, ksz, KeySpecials);
+        m_buf.push_back('=');
+    }
+
+    void KInfluxLineBuilder::AppendEscaped(const char* dat, size_t sz, const char* specials)
+    {
+        // 按不需要转义的片段整段追加 //
+        size_t start = 0;
+        for (size_t i = 0; i < sz; ++i)
+        {
+            if (strchr(specials, dat[i]) != NULL && dat[i] != '\0')
+            {
+                m_buf.append(dat + start, i - start);
+                m_buf.push_back('\\');
+                m_buf.push_back(dat[i]);
+                start = i + 1;
+            }
+            else if (dat[i] == '\n')
+            {
+                // 换行会截断行协议，替换为空格 //
+                m_buf.append(dat + start, i - start);
+                m_buf.push_back(' ');
+                start = i + 1;
+            }
+        }
+        m_buf.append(dat + start, sz - start);
+    }
+
+    size_t KInfluxLineBuilder::FormatDouble(double val, char* buf)
+    {
+        // 整数值走整数格式化 //
+        if (val > -1e15 && val < 1e15 && val == double(int64_t(val)))
+            return KStringUtility::FormatInt64(int64_t(val), buf);
+
+        // 15位有效数字能还原的不输出更多位数 //
+#ifdef WIN32
+        int len = sprintf_s(buf, 32, "%.15g", val);
+        if (strtod(buf, NULL) != val)
+            len = sprintf_s(buf, 32, "%.17g", val);
+#else
+        int len = sprintf(buf, "%.15g", val);
+        if (strtod(buf, NULL) != val)
+            len = sprintf(buf, "%.17g", val);
+#endif
+        return len > 0 ? size_t(len) : 0;
+    }
+};
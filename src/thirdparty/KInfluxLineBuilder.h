@@ -0,0 +1,134 @@
+#pragma once
+#ifndef _INFLUX_LINEBUILDER_HPP_
+#define _INFLUX_LINEBUILDER_HPP_
+
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include "util/KStringUtility.h"
+/**
+influxdb行协议构造类
+measurement、tag、字段和时间戳直接追加到可复用的缓存中，按行协议规则转义，
+整数、浮点、布尔和字符串字段分类型输出，Clear后保留容量，稳定后每个点不再分配内存
+measurement,tag1=v1,tag2=v2 field1=1i,field2=1.5,field3="s" 1465839830100400200
+**/
+namespace thirdparty {
+    using namespace klib;
+    class KInfluxLineBuilder
+    {
+    public:
+        KInfluxLineBuilder(size_t reserve = 4096);
+
+        /************************************
+        * Method:    开始一个点，上一个点未结束时自动结束
+        * Returns:
+        * Parameter: name
+        *************************************/
+        KInfluxLineBuilder& Measurement(const char* name, size_t sz);
+
+        inline KInfluxLineBuilder& Measurement(const std::string& name) { return Measurement(name.c_str(), name.size()); }
+
+        /************************************
+        * Method:    添加tag，必须在字段之前，值为空的tag忽略
+        * Returns:
+        * Parameter: key
+        * Parameter: val
+        *************************************/
+        KInfluxLineBuilder& Tag(const char* key, size_t ksz, const char* val, size_t vsz);
+
+        inline KInfluxLineBuilder& Tag(const std::string& key, const std::string& val) { return Tag(key.c_str(), key.size(), val.c_str(), val.size()); }
+
+        // 整数字段，输出为123i //
+        KInfluxLineBuilder& Field(const char* key, size_t ksz, int64_t val);
+
+        inline KInfluxLineBuilder& Field(const char* key, size_t ksz, int32_t val) { return Field(key, ksz, int64_t(val)); }
+
+        inline KInfluxLineBuilder& Field(const char* key, size_t ksz, uint32_t val) { return Field(key, ksz, int64_t(val)); }
+
+        // 无符号整数字段，不超过int64范围时输出为123i，否则为123u //
+        KInfluxLineBuilder& Field(const char* key, size_t ksz, uint64_t val);
+
+        // 浮点字段，NaN和无穷大不能表示，忽略 //
+        KInfluxLineBuilder& Field(const char* key, size_t ksz, double val);
+
+        KInfluxLineBuilder& Field(const char* key, size_t ksz, bool val);
+
+        // 字符串字段，加引号并转义 //
+        KInfluxLineBuilder& Field(const char* key, size_t ksz, const char* val, size_t vsz);
+
+        inline KInfluxLineBuilder& Field(const std::string& key, int64_t val) { return Field(key.c_str(), key.size(), val); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, int32_t val) { return Field(key.c_str(), key.size(), int64_t(val)); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, uint32_t val) { return Field(key.c_str(), key.size(), int64_t(val)); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, uint64_t val) { return Field(key.c_str(), key.size(), val); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, double val) { return Field(key.c_str(), key.size(), val); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, bool val) { return Field(key.c_str(), key.size(), val); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, const char* val, size_t sz) { return Field(key.c_str(), key.size(), val, sz); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, const std::string& val) { return Field(key.c_str(), key.size(), val.c_str(), val.size()); }
+
+        inline KInfluxLineBuilder& Field(const std::string& key, const char* val) { return Field(key.c_str(), key.size(), val, strlen(val)); }
+
+        /************************************
+        * Method:    已格式化的字段值，原样输出
+        * Returns:
+        * Parameter: key
+        * Parameter: val 如"1.5"、"3i"、"true"
+        *************************************/
+        KInfluxLineBuilder& FieldRaw(const std::string& key, const std::string& val);
+
+        /************************************
+        * Method:    时间戳并结束当前点
+        * Returns:
+        * Parameter: ts 精度与写入请求的precision一致
+        *************************************/
+        KInfluxLineBuilder& Timestamp(int64_t ts);
+
+        /************************************
+        * Method:    结束当前点，没有字段的点被丢弃
+        * Returns:
+        *************************************/
+        KInfluxLineBuilder& End();
+
+        // 结束当前点并返回所有数据 //
+        const std::string& Str();
+
+        inline const char* Data() const { return m_buf.c_str(); }
+
+        inline size_t Size() const { return m_buf.size(); }
+
+        inline size_t Points() const { return m_points; }
+
+        // 清空，保留容量 //
+        void Clear();
+
+        /************************************
+        * Method:    浮点转最短的可还原的十进制
+        * Returns:   写入的字节数
+        * Parameter: val
+        * Parameter: buf 至少32字节
+        *************************************/
+        static size_t FormatDouble(double val, char* buf);
+
+    private:
+        enum LineState { stateNone, stateTags, stateFields };
+
+        void FieldKey(const char* key, size_t ksz);
+
+        // 转义逗号、等号和空格 //
+        void AppendEscaped(const char* dat, size_t sz, const char* specials);
+
+    private:
+        std::string m_buf;
+        // 当前点的起始位置，没有字段时回退 //
+        size_t m_lineStart;
+        LineState m_state;
+        size_t m_points;
+    };
+};
+#endif
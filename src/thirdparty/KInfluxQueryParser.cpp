@@ -0,0 +1,309 @@
+#include "thirdparty/KInfluxQueryParser.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
+#include <cstring>
+
+namespace thirdparty {
+    KInfluxQueryParser::KInfluxQueryParser(KInfluxRowHandler& handler)
+        :m_handler(handler), m_depth(0), m_rootKey(keyOther), m_resultKey(keyOther), m_seriesKey(keyOther),
+        m_announced(false), m_col(0), m_aborted(false)
+    {
+
+    }
+
+    bool KInfluxQueryParser::Parse(const char* dat, size_t sz)
+    {
+        m_depth = 0;
+        m_rootKey = keyOther;
+        m_resultKey = keyOther;
+        m_seriesKey = keyOther;
+        m_announced = false;
+        m_error.clear();
+        m_aborted = false;
+
+        rapidjson::Reader reader;
+        rapidjson::MemoryStream ms(dat, sz);
+        rapidjson::ParseResult pr = reader.Parse(ms, *this);
+        if (pr.IsError())
+        {
+            if (!m_aborted && m_error.empty())
+                m_error = rapidjson::GetParseError_En(pr.Code());
+            return false;
+        }
+        return m_error.empty();
+    }
+
+    bool KInfluxQueryParser::Null()
+    {
+        InfluxValue val = { InfluxNull, 0, 0, NULL, 0 };
+        return Scalar(val);
+    }
+
+    bool KInfluxQueryParser::Bool(bool b)
+    {
+        InfluxValue val = { InfluxBool, b ? 1 : 0, 0, NULL, 0 };
+        return Scalar(val);
+    }
+
+    bool KInfluxQueryParser::Int(int i)
+    {
+        return Int64(i);
+    }
+
+    bool KInfluxQueryParser::Uint(unsigned u)
+    {
+        return Int64(u);
+    }
+
+    bool KInfluxQueryParser::Int64(int64_t i)
+    {
+        InfluxValue val = { InfluxInteger, i, 0, NULL, 0 };
+        return Scalar(val);
+    }
+
+    bool KInfluxQueryParser::Uint64(uint64_t u)
+    {
+        // 超出int64的按浮点数保存 //
+        if (u >> 63)
+            return Double(double(u));
+        return Int64(int64_t(u));
+    }
+
+    bool KInfluxQueryParser::Double(double d)
+    {
+        InfluxValue val = { InfluxDouble, 0, d, NULL, 0 };
+        return Scalar(val);
+    }
+
+    bool KInfluxQueryParser::String(const char* str, rapidjson::SizeType len, bool)
+    {
+        InfluxValue val = { InfluxString, 0, 0, str, len };
+        return Scalar(val);
+    }
+
+    bool KInfluxQueryParser::Key(const char* str, rapidjson::SizeType len, bool)
+    {
+        if (m_depth == 1)
+            m_rootKey = MatchKey(str, len);
+        else if (m_depth == 3)
+            m_resultKey = MatchKey(str, len);
+        else if (m_depth == 5)
+            m_seriesKey = MatchKey(str, len);
+        else if (m_depth == 6 && InSeries() && m_seriesKey == keyTags)
+            m_tagKey.assign(str, len);
+        return true;
+    }
+
+    bool KInfluxQueryParser::StartObject()
+    {
+        ++m_depth;
+        if (m_depth == 1)
+            m_rootKey = keyOther;
+        else if (m_depth == 3)
+            m_resultKey = keyOther;
+        else if (m_depth == 5 && InSeries())
+        {
+            m_seriesKey = keyOther;
+            m_name.clear();
+            m_tags.clear();
+            m_columns.clear();
+            m_announced = false;
+        }
+        return true;
+    }
+
+    bool KInfluxQueryParser::EndObject(rapidjson::SizeType)
+    {
+        // 没有数据的series也回调一次 //
+        bool ok = true;
+        if (m_depth == 5 && InSeries() && !m_announced)
+            ok = Announce();
+        --m_depth;
+        return ok;
+    }
+
+    bool KInfluxQueryParser::StartArray()
+    {
+        ++m_depth;
+        if (InRow())
+        {
+            if (!m_announced && !Announce())
+                return false;
+            m_col = 0;
+            for (size_t i = 0; i < m_row.size(); ++i)
+            {
+                m_row[i].type = InfluxNull;
+                m_row[i].str = NULL;
+                m_row[i].len = 0;
+            }
+        }
+        return true;
+    }
+
+    bool KInfluxQueryParser::EndArray(rapidjson::SizeType)
+    {
+        bool ok = true;
+        if (InRow() && !m_handler.OnRow(m_row))
+        {
+            m_aborted = true;
+            ok = false;
+        }
+        --m_depth;
+        return ok;
+    }
+
+    KInfluxQueryParser::KeyType KInfluxQueryParser::MatchKey(const char* str, size_t len)
+    {
+        static const struct { const char* name; KeyType type; } keys[] = {
+            { "results", keyResults }, { "series", keySeries }, { "error", keyError }, { "name", keyName },
+            { "tags", keyTags }, { "columns", keyColumns }, { "values", keyValues }
+        };
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
+        {
+            if (strlen(keys[i].name) == len && memcmp(keys[i].name, str, len) == 0)
+                return keys[i].type;
+        }
+        return keyOther;
+    }
+
+    bool KInfluxQueryParser::Announce()
+    {
+        m_announced = true;
+        m_row.resize(m_columns.size());
+        m_rowStrings.resize(m_columns.size());
+        if (!m_handler.OnSeries(m_name, m_tags, m_columns))
+        {
+            m_aborted = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool KInfluxQueryParser::Scalar(const InfluxValue& val)
+    {
+        // 语句错误在results[].error，请求错误在顶层error //
+        if ((m_depth == 1 && m_rootKey == keyError)
+            || (m_depth == 3 && m_rootKey == keyResults && m_resultKey == keyError))
+        {
+            if (val.type == InfluxString)
+                m_error.assign(val.str, val.len);
+            return true;
+        }
+
+        if (!InSeries())
+            return true;
+
+        if (InRow())
+        {
+            if (m_col < m_row.size())
+            {
+                InfluxValue& cell = m_row[m_col];
+                cell = val;
+                if (val.type == InfluxString)
+                {
+                    // SAX回调的字符串是临时的，复制到该列的缓存 //
+                    m_rowStrings[m_col].assign(val.str, val.len);
+                    cell.str = m_rowStrings[m_col].c_str();
+                }
+            }
+            ++m_col;
+        }
+        else if (val.type == InfluxString)
+        {
+            if (m_depth == 5 && m_seriesKey == keyName)
+                m_name.assign(val.str, val.len);
+            else if (m_depth == 6 && m_seriesKey == keyTags)
+                m_tags[m_tagKey].assign(val.str, val.len);
+            else if (m_depth == 6 && m_seriesKey == keyColumns)
+                m_columns.push_back(std::string(val.str, val.len));
+        }
+        return true;
+    }
+
+    bool KInfluxColumnCollector::OnSeries(const std::string& name, const std::map<std::string, std::string>& tags,
+        const std::vector<std::string>& columns)
+    {
+        if (!m_series.empty())
+        {
+            // 分块查询时同一series分多块返回 //
+            const InfluxSeries& last = m_series.back();
+            bool same = (last.name == name && last.tags == tags && last.columns.size() == columns.size());
+            for (size_t i = 0; same && i < columns.size(); ++i)
+                same = (last.columns[i].name == columns[i]);
+            if (same)
+                return true;
+        }
+
+        m_series.push_back(InfluxSeries());
+        InfluxSeries& series = m_series.back();
+        series.name = name;
+        series.tags = tags;
+        series.columns.resize(columns.size());
+        for (size_t i = 0; i < columns.size(); ++i)
+            series.columns[i].name = columns[i];
+        return true;
+    }
+
+    bool KInfluxColumnCollector::OnRow(const std::vector<InfluxValue>& row)
+    {
+        if (m_series.empty())
+            return true;
+
+        InfluxSeries& series = m_series.back();
+        for (size_t i = 0; i < series.columns.size(); ++i)
+        {
+            if (i < row.size())
+                Append(series.columns[i], row[i]);
+            else
+            {
+                InfluxValue val = { InfluxNull, 0, 0, NULL, 0 };
+                Append(series.columns[i], val);
+            }
+        }
+        ++series.rows;
+        return true;
+    }
+
+    void KInfluxColumnCollector::Append(InfluxColumn& col, const InfluxValue& val)
+    {
+        // influxdb把整数值的浮点数输出为整数，整数列遇到浮点数时整列转为浮点 //
+        if (val.type == InfluxDouble && col.type == InfluxInteger)
+        {
+            col.numbers.assign(col.integers.begin(), col.integers.end());
+            std::vector<int64_t>().swap(col.integers);
+            col.type = InfluxDouble;
+        }
+        if (col.type == InfluxNull && val.type != InfluxNull)
+            Settle(col, val.type);
+
+        bool null = (val.type != col.type && !(val.type == InfluxInteger && col.type == InfluxDouble));
+        switch (col.type)
+        {
+        case InfluxBool:
+        case InfluxInteger:
+            col.integers.push_back(null ? 0 : val.integer);
+            break;
+        case InfluxDouble:
+            col.numbers.push_back(null ? 0 : (val.type == InfluxInteger ? double(val.integer) : val.number));
+            break;
+        case InfluxString:
+            col.strings.push_back(null ? std::string() : std::string(val.str, val.len));
+            break;
+        default:
+            break;
+        }
+        col.nulls.push_back(null ? 1 : 0);
+    }
+
+    void KInfluxColumnCollector::Settle(InfluxColumn& col, InfluxValueType type)
+    {
+        col.type = type;
+        size_t rows = col.nulls.size();
+        if (type == InfluxBool || type == InfluxInteger)
+            col.integers.resize(rows);
+        else if (type == InfluxDouble)
+            col.numbers.resize(rows);
+        else if (type == InfluxString)
+            col.strings.resize(rows);
+    }
+};
@@ -0,0 +1,195 @@
+#pragma once
+#ifndef _INFLUX_QUERYPARSER_HPP_
+#define _INFLUX_QUERYPARSER_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "rapidjson/reader.h"
+/**
+influxdb查询结果流式解析类
+使用rapidjson的SAX接口边解析边按行回调，不构造DOM，不复制整个结果，
+每行的字符串缓存按列复用；KInfluxColumnCollector把行按列保存为类型化的数组
+**/
+namespace thirdparty {
+    enum InfluxValueType
+    {
+        InfluxNull,
+        InfluxBool,
+        InfluxInteger,
+        InfluxDouble,
+        InfluxString
+    };
+
+    /**
+    一个单元格的值，字符串只在回调期间有效
+    **/
+    struct InfluxValue
+    {
+        InfluxValueType type;
+        // 整数和布尔值 //
+        int64_t integer;
+        double number;
+        const char* str;
+        size_t len;
+    };
+
+    /**
+    行回调，返回false停止解析
+    **/
+    class KInfluxRowHandler
+    {
+    public:
+        virtual ~KInfluxRowHandler() {}
+
+        /************************************
+        * Method:    一个series开始，在该series的第一行之前回调
+        * Returns:
+        * Parameter: name measurement名称
+        * Parameter: tags group by的tag
+        * Parameter: columns 列名
+        *************************************/
+        virtual bool OnSeries(const std::string& name, const std::map<std::string, std::string>& tags,
+            const std::vector<std::string>& columns) = 0;
+
+        /************************************
+        * Method:    一行数据
+        * Returns:
+        * Parameter: row 与列一一对应，缺少的列为null
+        *************************************/
+        virtual bool OnRow(const std::vector<InfluxValue>& row) = 0;
+    };
+
+    class KInfluxQueryParser : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, KInfluxQueryParser>
+    {
+    public:
+        KInfluxQueryParser(KInfluxRowHandler& handler);
+
+        /************************************
+        * Method:    解析一个完整的应答或分块查询的一块
+        * Returns:   JSON格式错误、服务端返回错误或回调中止时返回false
+        * Parameter: dat
+        * Parameter: sz
+        *************************************/
+        bool Parse(const char* dat, size_t sz);
+
+        inline bool Parse(const std::string& resp) { return Parse(resp.c_str(), resp.size()); }
+
+        // 服务端返回的错误或JSON格式错误 //
+        inline const std::string& GetError() const { return m_error; }
+
+        // 是否被回调中止 //
+        inline bool IsAborted() const { return m_aborted; }
+
+    public:
+        // rapidjson SAX回调 //
+        bool Null();
+        bool Bool(bool b);
+        bool Int(int i);
+        bool Uint(unsigned u);
+        bool Int64(int64_t i);
+        bool Uint64(uint64_t u);
+        bool Double(double d);
+        bool String(const char* str, rapidjson::SizeType len, bool copy);
+        bool Key(const char* str, rapidjson::SizeType len, bool copy);
+        bool StartObject();
+        bool EndObject(rapidjson::SizeType);
+        bool StartArray();
+        bool EndArray(rapidjson::SizeType);
+
+    private:
+        enum KeyType { keyOther, keyResults, keySeries, keyError, keyName, keyTags, keyColumns, keyValues };
+
+        static KeyType MatchKey(const char* str, size_t len);
+
+        // 当前是否在results[].series[]的对象内 //
+        inline bool InSeries() const { return m_depth >= 5 && m_rootKey == keyResults && m_resultKey == keySeries; }
+
+        inline bool InRow() const { return m_depth == 7 && InSeries() && m_seriesKey == keyValues; }
+
+        bool Announce();
+
+        bool Scalar(const InfluxValue& val);
+
+    private:
+        KInfluxRowHandler& m_handler;
+        size_t m_depth;
+        KeyType m_rootKey;
+        KeyType m_resultKey;
+        KeyType m_seriesKey;
+        std::string m_tagKey;
+
+        std::string m_name;
+        std::map<std::string, std::string> m_tags;
+        std::vector<std::string> m_columns;
+        bool m_announced;
+
+        std::vector<InfluxValue> m_row;
+        // 每列字符串值的缓存，行间复用 //
+        std::vector<std::string> m_rowStrings;
+        size_t m_col;
+
+        std::string m_error;
+        bool m_aborted;
+    };
+
+    struct InfluxColumn
+    {
+        std::string name;
+        // 首个非null值决定类型，整数列遇到浮点数时整列转为浮点 //
+        InfluxValueType type;
+        // 整数和布尔列 //
+        std::vector<int64_t> integers;
+        std::vector<double> numbers;
+        std::vector<std::string> strings;
+        // 1表示该行为null或类型不一致 //
+        std::vector<uint8_t> nulls;
+
+        InfluxColumn()
+            :type(InfluxNull)
+        {
+
+        }
+    };
+
+    struct InfluxSeries
+    {
+        std::string name;
+        std::map<std::string, std::string> tags;
+        std::vector<InfluxColumn> columns;
+        size_t rows;
+
+        InfluxSeries()
+            :rows(0)
+        {
+
+        }
+    };
+
+    /**
+    按列收集结果，分块返回的同一series合并
+    **/
+    class KInfluxColumnCollector : public KInfluxRowHandler
+    {
+    public:
+        virtual bool OnSeries(const std::string& name, const std::map<std::string, std::string>& tags,
+            const std::vector<std::string>& columns);
+
+        virtual bool OnRow(const std::vector<InfluxValue>& row);
+
+        inline const std::vector<InfluxSeries>& GetSeries() const { return m_series; }
+
+        inline void Clear() { m_series.clear(); }
+
+    private:
+        static void Append(InfluxColumn& col, const InfluxValue& val);
+
+        // 补齐到当前行数 //
+        static void Settle(InfluxColumn& col, InfluxValueType type);
+
+    private:
+        std::vector<InfluxSeries> m_series;
+    };
+};
+#endif
@@ -0,0 +1,323 @@
+#include "KKafkaConsumer.h"
+#include "util/KTime.h"
+#include <cstdio>
+
+namespace thirdparty {
+    KKafkaLane::KKafkaLane(KKafkaConsumer& consumer, size_t maxSize)
+        :KEventObject<KafkaMessages*>("KKafkaLane Thread", maxSize), m_consumer(consumer)
+    {
+
+    }
+
+    void KKafkaLane::Stop()
+    {
+        KEventObject<KafkaMessages*>::Stop();
+        KEventObject<KafkaMessages*>::WaitForStop();
+
+        std::vector<KafkaMessages*> events;
+        Flush(events);
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            delete events[i];
+            --m_consumer.m_inflight;
+        }
+    }
+
+    void KKafkaLane::ProcessEvent(KafkaMessages* const& ev)
+    {
+        m_consumer.Dispatch(*ev);
+        delete ev;
+        --m_consumer.m_inflight;
+    }
+
+    KKafkaConsumer::KKafkaConsumer()
+        :m_consumer(NULL), m_consumeThread("KKafkaConsumer Thread"), m_running(false), m_dirty(false),
+        m_inflight(0), m_consumed(0), m_processed(0)
+    {
+
+    }
+
+    KKafkaConsumer::~KKafkaConsumer()
+    {
+        Stop();
+    }
+
+    bool KKafkaConsumer::Start(const KafkaConsumerConf& conf)
+    {
+        if (m_running || conf.topics.empty() || conf.workers == 0)
+            return false;
+
+        m_conf = conf;
+        std::string errStr;
+        RdKafka::Conf* kc = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
+        SetConf(kc, "bootstrap.servers", m_conf.brokers);
+        SetConf(kc, "group.id", m_conf.groupId);
+        // 处理完成后再提交 //
+        SetConf(kc, "enable.auto.commit", "false");
+        SetConf(kc, "enable.partition.eof", "false");
+        if (kc->set("rebalance_cb", static_cast<RdKafka::RebalanceCb*>(this), errStr)
+            != RdKafka::Conf::CONF_OK)
+        {
+            printf("Kafka CreateConsumer set rebalance_cb property error:[%s]\n",
+                errStr.c_str());
+        }
+
+        std::map<std::string, std::string>::const_iterator pit = m_conf.props.begin();
+        while (pit != m_conf.props.end())
+        {
+            SetConf(kc, pit->first, pit->second);
+            ++pit;
+        }
+
+        m_consumer = RdKafka::KafkaConsumer::create(kc, errStr);
+        delete kc;
+        if (!m_consumer)
+        {
+            printf("Kafka create Consumer failed:[%s]\n", errStr.c_str());
+            return false;
+        }
+
+        RdKafka::ErrorCode err = m_consumer->subscribe(m_conf.topics);
+        if (err != RdKafka::ERR_NO_ERROR)
+        {
+            printf("Kafka subscribe failed:[%s]\n", RdKafka::err2str(err).c_str());
+            m_consumer->close();
+            delete m_consumer;
+            m_consumer = NULL;
+            return false;
+        }
+
+        for (size_t i = 0; i < m_conf.workers; ++i)
+        {
+            KKafkaLane* lane = new KKafkaLane(*this, m_conf.laneQueueSize);
+            lane->Start();
+            m_lanes.push_back(lane);
+        }
+
+        m_running = true;
+        if (m_consumeThread.Run(this, &KKafkaConsumer::ConsumeLoop, 0) != KPthread::Success)
+        {
+            m_running = false;
+            Stop();
+            return false;
+        }
+
+        printf("KKafkaConsumer brokers:[%s], topic:[%d], groupid:[%s] start success\n",
+            m_conf.brokers.c_str(), int(m_conf.topics.size()), m_conf.groupId.c_str());
+        return true;
+    }
+
+    void KKafkaConsumer::Stop()
+    {
+        if (m_consumer == NULL)
+            return;
+
+        m_running = false;
+        m_consumeThread.Join();
+
+        Drain();
+        Commit(false);
+        m_consumer->close();
+
+        for (size_t i = 0; i < m_lanes.size(); ++i)
+        {
+            m_lanes[i]->Stop();
+            delete m_lanes[i];
+        }
+        m_lanes.clear();
+
+        delete m_consumer;
+        m_consumer = NULL;
+    }
+
+    void KKafkaConsumer::rebalance_cb(RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err,
+        std::vector<RdKafka::TopicPartition*>& partitions)
+    {
+        if (err == RdKafka::ERR__ASSIGN_PARTITIONS)
+        {
+            consumer->assign(partitions);
+            return;
+        }
+
+        // 分区被收回前处理完已投递的消息并提交，未投递的丢弃，由新的消费者重新消费 //
+        ReleaseBatches();
+        Drain();
+        Commit(false);
+        {
+            KLockGuard<KMutex> lock(m_offsetMtx);
+            m_offsets.clear();
+            m_dirty = false;
+        }
+        consumer->unassign();
+    }
+
+    int KKafkaConsumer::ConsumeLoop(int)
+    {
+        m_batches.assign(m_lanes.size(), (KafkaMessages*)NULL);
+        uint64_t lastCommit = 0;
+        KTime::NowMillisecond(lastCommit);
+        while (m_running)
+        {
+            if (ConsumeBatch(m_batches) > 0)
+            {
+                for (size_t i = 0; i < m_batches.size(); ++i)
+                {
+                    if (m_batches[i] == NULL)
+                        continue;
+
+                    // 处理线程队列满时暂停拉取，停止时未投递的不提交，重启后重新消费 //
+                    ++m_inflight;
+                    bool posted = false;
+                    while (!(posted = m_lanes[i]->Post(m_batches[i])) && m_running)
+                        KTime::MSleep(1);
+                    if (!posted)
+                    {
+                        delete m_batches[i];
+                        --m_inflight;
+                    }
+                    m_batches[i] = NULL;
+                }
+            }
+
+            uint64_t now = 0;
+            KTime::NowMillisecond(now);
+            if (now - lastCommit >= uint64_t(m_conf.commitIntervalMs))
+            {
+                Commit(true);
+                lastCommit = now;
+            }
+        }
+        ReleaseBatches();
+        return 0;
+    }
+
+    void KKafkaConsumer::ReleaseBatches()
+    {
+        for (size_t i = 0; i < m_batches.size(); ++i)
+        {
+            delete m_batches[i];
+            m_batches[i] = NULL;
+        }
+    }
+
+    size_t KKafkaConsumer::ConsumeBatch(std::vector<KafkaMessages*>& batches)
+    {
+        uint64_t begin = 0;
+        KTime::NowMillisecond(begin);
+        size_t count = 0;
+        int timeout = m_conf.batchTimeoutMs;
+        while (m_running && count < m_conf.batchSize)
+        {
+            RdKafka::Message* msg = m_consumer->consume(timeout);
+            RdKafka::ErrorCode err = msg->err();
+            if (err == RdKafka::ERR_NO_ERROR)
+            {
+                size_t lane = size_t(msg->partition()) % batches.size();
+                if (batches[lane] == NULL)
+                {
+                    batches[lane] = new KafkaMessages;
+                    batches[lane]->reserve(m_conf.batchSize / batches.size() + 1);
+                }
+
+                batches[lane]->push_back(KafkaMessage());
+                KafkaMessage& km = batches[lane]->back();
+                km.topic = msg->topic_name();
+                km.partition = msg->partition();
+                km.offset = msg->offset();
+                if (msg->key())
+                    km.key = *msg->key();
+                km.payload.assign(static_cast<const char*>(msg->payload()), msg->len());
+                ++count;
+            }
+            else if (err != RdKafka::ERR__TIMED_OUT && err != RdKafka::ERR__PARTITION_EOF)
+            {
+                printf("Kafka consume error:[%s]\n", msg->errstr().c_str());
+            }
+            delete msg;
+
+            if (err == RdKafka::ERR__TIMED_OUT)
+                break;
+
+            // 批次剩余的等待时间 //
+            uint64_t now = 0;
+            KTime::NowMillisecond(now);
+            uint64_t elapsed = now - begin;
+            if (elapsed >= uint64_t(m_conf.batchTimeoutMs))
+                timeout = 0;
+            else
+                timeout = m_conf.batchTimeoutMs - int(elapsed);
+        }
+        m_consumed += count;
+        return count;
+    }
+
+    void KKafkaConsumer::Dispatch(KafkaMessages& msgs)
+    {
+        if (msgs.empty())
+            return;
+
+        try
+        {
+            ProcessMessages(msgs);
+        }
+        catch (const std::exception& e)
+        {
+            printf("KKafkaConsumer ProcessMessages exception:[%s]\n", e.what());
+        }
+        m_processed += msgs.size();
+
+        // 批内同一分区有序，只记录每个分区最后一条 //
+        KLockGuard<KMutex> lock(m_offsetMtx);
+        for (size_t i = 0; i < msgs.size(); ++i)
+        {
+            const KafkaMessage& km = msgs[i];
+            if (i + 1 < msgs.size() && msgs[i + 1].partition == km.partition && msgs[i + 1].topic == km.topic)
+                continue;
+            m_offsets[PartitionKey(km.topic, km.partition)] = km.offset;
+        }
+        m_dirty = true;
+    }
+
+    void KKafkaConsumer::Drain()
+    {
+        while (m_inflight > 0)
+            KTime::MSleep(1);
+    }
+
+    void KKafkaConsumer::Commit(bool async)
+    {
+        std::vector<RdKafka::TopicPartition*> offsets;
+        {
+            KLockGuard<KMutex> lock(m_offsetMtx);
+            if (!m_dirty)
+                return;
+
+            offsets.reserve(m_offsets.size());
+            std::map<PartitionKey, int64_t>::const_iterator it = m_offsets.begin();
+            while (it != m_offsets.end())
+            {
+                // 提交下一条要消费的偏移量 //
+                offsets.push_back(RdKafka::TopicPartition::create(it->first.first, it->first.second, it->second + 1));
+                ++it;
+            }
+            m_dirty = false;
+        }
+
+        RdKafka::ErrorCode err = (async ? m_consumer->commitAsync(offsets) : m_consumer->commitSync(offsets));
+        if (err != RdKafka::ERR_NO_ERROR)
+            printf("Kafka commit offsets error:[%s]\n", RdKafka::err2str(err).c_str());
+        RdKafka::TopicPartition::destroy(offsets);
+    }
+
+    bool KKafkaConsumer::SetConf(RdKafka::Conf* kc, const std::string& name, const std::string& val)
+    {
+        std::string errStr;
+        if (kc->set(name, val, errStr) != RdKafka::Conf::CONF_OK)
+        {
+            printf("Kafka CreateConsumer set %s property error:[%s]\n",
+                name.c_str(), errStr.c_str());
+            return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "librdkafka/rdkafkacpp.h"
+#include "thread/KEventObject.h"
+#include "thread/KPthread.h"
+#include "thread/KMutex.h"
+#include "thread/KLockGuard.h"
+#include "thread/KAtomic.h"
+#include <map>
+#include <vector>
+#include <string>
+
+namespace thirdparty {
+    using namespace klib;
+    struct KafkaMessage
+    {
+        std::string topic;
+        int32_t partition;
+        int64_t offset;
+        std::string key;
+        std::string payload;
+    };
+
+    typedef std::vector<KafkaMessage> KafkaMessages;
+
+    struct KafkaConsumerConf
+    {
+        std::string brokers;
+        std::string groupId;
+        std::vector<std::string> topics;
+        // 处理线程数，同一分区的消息在同一个线程中按顺序处理 //
+        size_t workers;
+        // 每批最多消息数和最长等待毫秒数 //
+        size_t batchSize;
+        int batchTimeoutMs;
+        // 每个处理线程最多缓存的批数，满时暂停拉取 //
+        size_t laneQueueSize;
+        // 异步提交偏移量的间隔 //
+        int commitIntervalMs;
+        // 其它librdkafka全局配置 //
+        std::map<std::string, std::string> props;
+
+        KafkaConsumerConf()
+            :workers(4), batchSize(1000), batchTimeoutMs(100), laneQueueSize(64), commitIntervalMs(1000)
+        {
+
+        }
+    };
+
+    class KKafkaConsumer;
+
+    // 处理线程，消息按批投递 //
+    class KKafkaLane :public KEventObject<KafkaMessages*>
+    {
+    public:
+        KKafkaLane(KKafkaConsumer& consumer, size_t maxSize);
+
+        // 停止并释放未处理的消息 //
+        void Stop();
+
+    protected:
+        virtual void ProcessEvent(KafkaMessages* const& ev);
+
+    private:
+        KKafkaConsumer& m_consumer;
+    };
+
+    class KKafkaConsumer :public RdKafka::RebalanceCb
+    {
+        friend class KKafkaLane;
+    public:
+        KKafkaConsumer();
+
+        virtual ~KKafkaConsumer();
+
+        bool Start(const KafkaConsumerConf& conf);
+
+        // 等待已拉取的消息处理完成，提交偏移量后停止 //
+        void Stop();
+
+        inline uint64_t Consumed() const { return m_consumed; }
+
+        inline uint64_t Processed() const { return m_processed; }
+
+        void rebalance_cb(RdKafka::KafkaConsumer* consumer, RdKafka::ErrorCode err,
+            std::vector<RdKafka::TopicPartition*>& partitions);
+
+    protected:
+        /************************************
+        * Method:    处理一批消息，在分区对应的处理线程中调用
+        * Returns:
+        * Parameter: msgs 同一分区的消息按偏移量有序，返回后偏移量可以提交
+        *************************************/
+        virtual void ProcessMessages(const KafkaMessages& /*msgs*/)
+        {
+
+        }
+
+    private:
+        int ConsumeLoop(int);
+
+        // 拉取一批消息并按分区分配到处理线程 //
+        size_t ConsumeBatch(std::vector<KafkaMessages*>& batches);
+
+        // 释放拉取后还没有投递的消息 //
+        void ReleaseBatches();
+
+        void Dispatch(KafkaMessages& msgs);
+
+        // 等待处理线程完成所有已投递的消息 //
+        void Drain();
+
+        void Commit(bool async);
+
+        bool SetConf(RdKafka::Conf* kc, const std::string& name, const std::string& val);
+
+    private:
+        typedef std::pair<std::string, int32_t> PartitionKey;
+
+        KafkaConsumerConf m_conf;
+        RdKafka::KafkaConsumer* m_consumer;
+        std::vector<KKafkaLane*> m_lanes;
+        // 拉取线程中按处理线程分组的消息 //
+        std::vector<KafkaMessages*> m_batches;
+        KPthread m_consumeThread;
+        volatile bool m_running;
+
+        // 已处理的偏移量 //
+        KMutex m_offsetMtx;
+        std::map<PartitionKey, int64_t> m_offsets;
+        bool m_dirty;
+
+        AtomicInteger<uint32_t> m_inflight;
+        AtomicInteger<uint64_t> m_consumed;
+        AtomicInteger<uint64_t> m_processed;
+    };
+};
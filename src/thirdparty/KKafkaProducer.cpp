@@ -1,15 +1,21 @@
 #include "thirdparty/KKafkaProducer.h"
+#include "util/KTime.h"
+#include <cstdlib>
 
 namespace thirdparty {
-    KKafkaProducer::KKafkaProducer() :m_running(false)
+    KKafkaProducer::KKafkaProducer()
+        :m_running(false), m_producing(0), m_pollThread("KKafkaProducer poll thread"), m_polling(false)
     {
         m_eventcb = new KEventCb(m_running);
+        m_drcb = new KDeliveryCb(m_spill, m_mtx);
     }
 
     KKafkaProducer::~KKafkaProducer()
     {
-        Release(m_eventcb);
+        Stop();
         m_producer.Release();
+        Release(m_eventcb);
+        Release(m_drcb);
     }
 
     void KKafkaProducer::Initialize(const KafkaConf& conf)
@@ -17,18 +23,78 @@ namespace thirdparty {
         m_conf = conf;
     }
 
+    bool KKafkaProducer::Start()
+    {
+        if (m_polling)
+            return false;
+
+        if ((m_conf.spillMemoryBytes > 0 || !m_conf.spillFile.empty())
+            && !m_spill.Open(m_conf.spillMemoryBytes, m_conf.spillFile, m_conf.spillFileBytes))
+            return false;
+
+        m_eventcb->SetKeepOnDown(true);
+        m_polling = true;
+        if (m_pollThread.Run(this, &KKafkaProducer::PollLoop, 0) != KPthread::Success)
+        {
+            m_polling = false;
+            m_eventcb->SetKeepOnDown(false);
+            m_spill.Close();
+            return false;
+        }
+        return true;
+    }
+
+    void KKafkaProducer::Stop(int ms)
+    {
+        if (!m_polling)
+            return;
+
+        m_polling = false;
+        m_pollThread.Join();
+
+        uint64_t begin = 0, now = 0;
+        KTime::NowMillisecond(begin);
+        now = begin;
+        while (m_running && now - begin < uint64_t(ms))
+        {
+            {
+                KLockGuard<KMutex> lock(m_mtx);
+                if (m_spill.IsEmpty())
+                    break;
+                DrainSpill(KafkaSpillDrainBatch);
+            }
+            m_producer.producer->poll(10);
+            KTime::NowMillisecond(now);
+        }
+
+        if (now - begin < uint64_t(ms))
+            Flush(int(ms - (now - begin)));
+
+        KLockGuard<KMutex> lock(m_mtx);
+        if (!m_spill.IsEmpty())
+            printf("Kafka producer stop with spilled:[%llu] bytes\n", (unsigned long long)(m_spill.MemoryBytes() + m_spill.FileBytes()));
+        m_spill.Close();
+        m_eventcb->SetKeepOnDown(false);
+    }
+
     bool KKafkaProducer::CreateProducer()
     {
-        m_producer.Release();
+        // 等待不加锁的发送退出，阻塞发送需要Poll释放队列，暂存打开时Poll会回调加锁，只等待 //
+        while (m_producing > 0)
+        {
+            if (m_producer.producer && !m_spill.IsOpen())
+                m_producer.producer->poll(10);
+            else
+                KTime::MSleep(1);
+        }
+        {
+            KLockGuard<KMutex> lock(m_topicMtx);
+            m_producer.Release();
+        }
         std::string errStr;
         RdKafka::Conf* kc = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
         //Kafka server
-        if (kc->set("bootstrap.servers", m_conf.brokers, errStr)
-            != RdKafka::Conf::CONF_OK)
-        {
-            printf("Kafka CreateProducer set bootstrap.servers property error:[%s]\n",
-                errStr.c_str());
-        }
+        SetConf(kc, "bootstrap.servers", m_conf.brokers);
 
         //事件回调       
         if (kc->set("event_cb", m_eventcb, errStr)
@@ -38,20 +104,33 @@ namespace thirdparty {
                 errStr.c_str());
         }
 
-        //
-        if (kc->set("linger.ms", "100", errStr)
+        //发送结果回调
+        if (m_conf.idempotence)
+            SetConf(kc, "enable.idempotence", "true");
+
+        if (kc->set("dr_cb", m_drcb, errStr)
             != RdKafka::Conf::CONF_OK)
         {
-            printf("Kafka CreateProducer set linger.ms property error:[%s]\n",
+            printf("Kafka CreateProducer set dr_cb property error:[%s]\n",
                 errStr.c_str());
         }
 
-        //
-        if (kc->set("batch.num.messages", "16000", errStr)
-            != RdKafka::Conf::CONF_OK)
+        std::ostringstream os;
+        os << m_conf.lingerMs;
+        SetConf(kc, "linger.ms", os.str());
+        os.str("");
+        os << m_conf.batchNumMessages;
+        SetConf(kc, "batch.num.messages", os.str());
+        SetConf(kc, "compression.codec", m_conf.compression);
+        // 暂存时不让消息在本地队列中超时丢弃 //
+        if (m_conf.spillMemoryBytes > 0 || !m_conf.spillFile.empty())
+            SetConf(kc, "message.timeout.ms", "0");
+
+        std::map<std::string, std::string>::const_iterator pit = m_conf.props.begin();
+        while (pit != m_conf.props.end())
         {
-            printf("Kafka CreateProducer set batch.num.messages property error:[%s]\n",
-                errStr.c_str());
+            SetConf(kc, pit->first, pit->second);
+            ++pit;
         }
 
         // 
@@ -64,8 +143,17 @@ namespace thirdparty {
             return false;
         }
         printf("Kafka create Producer success:[%s]\n", m_conf.brokers.c_str());
+        // 没有默认主题时只用ProduceTo //
+        if (m_conf.topicName.empty())
+        {
+            m_producer.producer = producer;
+            m_running = true;
+            return true;
+        }
+
         // topic conf
         kc = RdKafka::Conf::create(RdKafka::Conf::CONF_TOPIC);
+        SetConf(kc, "partitioner", m_conf.partitioner);
         RdKafka::Topic* topic = RdKafka::Topic::create(producer, m_conf.topicName, kc, errStr);
         Release(kc);
         if (!topic)
@@ -99,15 +187,121 @@ namespace thirdparty {
 
     bool KKafkaProducer::Produce(const std::string& msg, std::string& errStr)
     {
-        if (!m_running && !CreateProducer())
+        return ProduceInternal(std::string(), m_conf.partition, RdKafka::Producer::RK_MSG_COPY, const_cast<char*>(msg.c_str()), msg.size(),
+            std::string(), errStr, NULL, NULL);
+    }
+
+    bool KKafkaProducer::Produce(const std::string& msg, const std::string& key, std::string& errStr,
+        KafkaDeliveryCb cb, void* param)
+    {
+        return ProduceInternal(std::string(), RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY, const_cast<char*>(msg.c_str()), msg.size(),
+            key, errStr, cb, param);
+    }
+
+    bool KKafkaProducer::Produce(char* payload, size_t len, const std::string& key, std::string& errStr,
+        KafkaDeliveryCb cb, void* param)
+    {
+        return ProduceInternal(std::string(), RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_FREE, payload, len, key, errStr, cb, param);
+    }
+
+    bool KKafkaProducer::Produce(KBuffer& buf, const std::string& key, std::string& errStr,
+        KafkaDeliveryCb cb, void* param)
+    {
+        if (!ProduceInternal(std::string(), RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_FREE, buf.GetData(), buf.GetSize(), key, errStr, cb, param))
+            return false;
+        buf.Detach();
+        return true;
+    }
+
+    bool KKafkaProducer::ProduceTo(const std::string& topic, const std::string& msg, const std::string& key, std::string& errStr,
+        KafkaDeliveryCb cb, void* param)
+    {
+        return ProduceInternal(topic, RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY, const_cast<char*>(msg.c_str()), msg.size(),
+            key, errStr, cb, param);
+    }
+
+    bool KKafkaProducer::ProduceInternal(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+        const std::string& key, std::string& errStr, KafkaDeliveryCb cb, void* param)
+    {
+        // 暂存未打开且生产者可用时不加锁发送，多个线程可同时发送 //
+        bool sent = false;
+        if (!m_spill.IsOpen())
+        {
+            bool rc = ProduceUnlocked(topic, partition, flags, payload, len, key, errStr, cb, param, sent);
+            if (sent)
+                return rc;
+        }
+
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            bool spill = m_spill.IsOpen();
+            if (!m_running)
+            {
+                if (spill)
+                    return Spill(topic, partition, flags, payload, len, key, errStr);
+                // 后台线程负责重建 //
+                if (m_polling || !CreateProducer())
+                {
+                    errStr = "producer not running";
+                    return false;
+                }
+            }
+            else if (spill && !m_spill.IsEmpty())
+            {
+                // 暂存的先发送，保持顺序 //
+                return Spill(topic, partition, flags, payload, len, key, errStr);
+            }
+
+            // 暂存打开时不阻塞，在锁内发送，队列满时转入暂存 //
+            if (spill)
+                return Send(topic, partition, flags, payload, len, key, errStr, cb, param, true);
+        }
+
+        // 本线程重建后释放锁再发送，阻塞发送时不能持有锁 //
+        bool rc = ProduceUnlocked(topic, partition, flags, payload, len, key, errStr, cb, param, sent);
+        if (!sent)
+            errStr = "producer not running";
+        return rc;
+    }
+
+    bool KKafkaProducer::ProduceUnlocked(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+        const std::string& key, std::string& errStr, KafkaDeliveryCb cb, void* param, bool& sent)
+    {
+        // 计数期间生产者不会被重建 //
+        ++m_producing;
+        sent = m_running;
+        if (sent && m_conf.blockOnFull)
+            flags |= RdKafka::Producer::RK_MSG_BLOCK;
+        bool rc = sent && Send(topic, partition, flags, payload, len, key, errStr, cb, param, false);
+        --m_producing;
+        return rc;
+    }
+
+    bool KKafkaProducer::Send(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+        const std::string& key, std::string& errStr, KafkaDeliveryCb cb, void* param, bool spill)
+    {
+        RdKafka::Topic* t = GetTopic(topic, errStr);
+        if (t == NULL)
             return false;
 
-        RdKafka::ErrorCode resp = m_producer.producer->produce(m_producer.topic,
-            m_conf.partition, RdKafka::Producer::RK_MSG_COPY,
-            const_cast<char*>(msg.c_str()), msg.size(), NULL, NULL);
+        KafkaDelivery* d = NULL;
+        if (cb)
+        {
+            d = new KafkaDelivery;
+            d->cb = cb;
+            d->param = param;
+        }
+
+        // 未指定分区时由partitioner按key计算 //
+        RdKafka::ErrorCode resp = m_producer.producer->produce(t,
+            partition, flags, payload, len,
+            key.empty() ? NULL : key.c_str(), key.size(), d);
         if (RdKafka::ERR_NO_ERROR != resp)
         {
-            if (RdKafka::ERR__UNKNOWN_PARTITION == resp)
+            delete d;
+            if (RdKafka::ERR__QUEUE_FULL == resp && spill)
+                return Spill(topic, partition, flags, payload, len, key, errStr);
+            if (RdKafka::ERR__UNKNOWN_PARTITION == resp && partition == m_conf.partition)
                 m_conf.partition = 0;
             std::ostringstream os;
             os << resp;
@@ -117,10 +311,149 @@ namespace thirdparty {
         return true;
     }
 
+    bool KKafkaProducer::Spill(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+        const std::string& key, std::string& errStr)
+    {
+        if (!m_spill.Push(topic, partition, key.c_str(), key.size(), payload, len))
+        {
+            errStr = "spill queue full";
+            return false;
+        }
+
+        if (flags & RdKafka::Producer::RK_MSG_FREE)
+            free(payload);
+        return true;
+    }
+
+    size_t KKafkaProducer::DrainSpill(size_t maxCount)
+    {
+        size_t count = 0;
+        KafkaSpillMessage msg;
+        std::string errStr;
+        while (count < maxCount && m_spill.Front(msg))
+        {
+            RdKafka::Topic* topic = GetTopic(msg.topic, errStr);
+            if (topic == NULL)
+            {
+                printf("Kafka drop spilled message of topic:[%s], error:[%s]\n", msg.topic.c_str(), errStr.c_str());
+                m_spill.Pop();
+                ++count;
+                continue;
+            }
+
+            RdKafka::ErrorCode resp = m_producer.producer->produce(topic,
+                msg.partition, RdKafka::Producer::RK_MSG_COPY,
+                const_cast<char*>(msg.payload.data()), msg.payload.size(),
+                msg.key.empty() ? NULL : msg.key.data(), msg.key.size(), NULL);
+            if (RdKafka::ERR__UNKNOWN_PARTITION == resp && msg.partition != RdKafka::Topic::PARTITION_UA)
+            {
+                resp = m_producer.producer->produce(topic,
+                    RdKafka::Topic::PARTITION_UA, RdKafka::Producer::RK_MSG_COPY,
+                    const_cast<char*>(msg.payload.data()), msg.payload.size(),
+                    msg.key.empty() ? NULL : msg.key.data(), msg.key.size(), NULL);
+            }
+
+            if (RdKafka::ERR__QUEUE_FULL == resp)
+                break;
+            if (RdKafka::ERR_NO_ERROR != resp)
+                printf("Kafka produce spilled message error:[%s]\n", RdKafka::err2str(resp).c_str());
+            m_spill.Pop();
+            ++count;
+        }
+        return count;
+    }
+
+    RdKafka::Topic* KKafkaProducer::GetTopic(const std::string& topic, std::string& errStr)
+    {
+        if (topic.empty() || topic == m_conf.topicName)
+        {
+            if (m_producer.topic == NULL)
+                errStr = "topic not set";
+            return m_producer.topic;
+        }
+
+        KLockGuard<KMutex> lock(m_topicMtx);
+        std::map<std::string, RdKafka::Topic*>::iterator it = m_producer.topics.find(topic);
+        if (it != m_producer.topics.end())
+            return it->second;
+
+        RdKafka::Conf* kc = RdKafka::Conf::create(RdKafka::Conf::CONF_TOPIC);
+        SetConf(kc, "partitioner", m_conf.partitioner);
+        RdKafka::Topic* t = RdKafka::Topic::create(m_producer.producer, topic, kc, errStr);
+        Release(kc);
+        if (t == NULL)
+        {
+            printf("Kafka create Topic error:[%s], topic:[%s]\n", errStr.c_str(), topic.c_str());
+            return NULL;
+        }
+        m_producer.topics[topic] = t;
+        return t;
+    }
+
+    int KKafkaProducer::PollLoop(int)
+    {
+        uint64_t lastCreate = 0;
+        while (m_polling)
+        {
+            // 发送不加锁时不需要锁，只在重建或发送暂存时加锁 //
+            size_t drained = 0;
+            if (!m_running || m_spill.IsOpen())
+            {
+                KLockGuard<KMutex> lock(m_mtx);
+                if (!m_running)
+                {
+                    uint64_t now = 0;
+                    KTime::NowMillisecond(now);
+                    if (now - lastCreate >= KafkaReconnectInterval)
+                    {
+                        lastCreate = now;
+                        CreateProducer();
+                    }
+                }
+
+                if (m_running && m_spill.IsOpen())
+                    drained = DrainSpill(KafkaSpillDrainBatch);
+            }
+
+            // 只有本线程会重建生产者 //
+            if (m_running)
+                m_producer.producer->poll(drained > 0 ? 0 : m_conf.pollIntervalMs);
+            else
+                KTime::MSleep(100);
+        }
+        return 0;
+    }
+
     void KKafkaProducer::Poll(int ms)
     {
         if (m_running && m_producer.producer)
             m_producer.producer->poll(ms);
     }
 
+    uint64_t KKafkaProducer::SpillBytes() const
+    {
+        KLockGuard<KMutex> lock(m_mtx);
+        return m_spill.MemoryBytes() + m_spill.FileBytes();
+    }
+
+    int KKafkaProducer::Flush(int ms)
+    {
+        if (!m_running || m_producer.producer == NULL)
+            return 0;
+        m_producer.producer->flush(ms);
+        return m_producer.producer->outq_len();
+    }
+
+    bool KKafkaProducer::SetConf(RdKafka::Conf* kc, const std::string& name, const std::string& val)
+    {
+        std::string errStr;
+        if (kc->set(name, val, errStr) != RdKafka::Conf::CONF_OK)
+        {
+            printf("Kafka CreateProducer set %s property error:[%s]\n",
+                name.c_str(), errStr.c_str());
+            return false;
+        }
+        return true;
+    }
+
 };
@@ -4,17 +4,28 @@
 #include "thread/KMutex.h"
 #include "thread/KLockGuard.h"
 #include "thread/KAtomic.h"
+#include "thread/KBuffer.h"
+#include "thread/KPthread.h"
+#include "thirdparty/KKafkaSpillQueue.h"
+#include <map>
+#include <sstream>
+
+#define KafkaReconnectInterval 1000
+#define KafkaSpillDrainBatch 10000
 
 namespace thirdparty {
     using namespace klib;
     class KEventCb : public RdKafka::EventCb {
     public:
         KEventCb(volatile bool& running)
-            :m_running(running)
+            :m_running(running), m_keepOnDown(false)
         {
 
         }
 
+        // 后台线程运行时由librdkafka自动重连，broker断开不重建生产者 //
+        inline void SetKeepOnDown(bool keep) { m_keepOnDown = keep; }
+
         void event_cb(RdKafka::Event& event)
         {
             switch (event.type())
@@ -22,7 +33,8 @@ namespace thirdparty {
             case RdKafka::Event::EVENT_ERROR:
             {
                 RdKafka::ErrorCode ec = event.err();
-                if (ec == RdKafka::ERR__ALL_BROKERS_DOWN || RdKafka::ERR__TRANSPORT == ec)
+                if (event.fatal()
+                    || (!m_keepOnDown && (ec == RdKafka::ERR__ALL_BROKERS_DOWN || RdKafka::ERR__TRANSPORT == ec)))
                     m_running = false;
                 std::ostringstream os;
                 os << ec;
@@ -36,6 +48,69 @@ namespace thirdparty {
 
     private:
         volatile bool & m_running;
+        volatile bool m_keepOnDown;
+    };
+
+    /************************************
+    * Method:    消息发送结果回调，在Poll的线程中执行
+    * Parameter: err RdKafka::ErrorCode，0为成功
+    * Parameter: partition
+    * Parameter: offset
+    * Parameter: param 发送时传入的参数
+    *************************************/
+    typedef void (*KafkaDeliveryCb)(int err, int32_t partition, int64_t offset, void* param);
+
+    struct KafkaDelivery
+    {
+        KafkaDeliveryCb cb;
+        void* param;
+    };
+
+    class KDeliveryCb : public RdKafka::DeliveryReportCb {
+    public:
+        KDeliveryCb(KKafkaSpillQueue& spill, KMutex& mtx)
+            :m_spill(spill), m_mtx(mtx)
+        {
+
+        }
+
+        void dr_cb(RdKafka::Message& message)
+        {
+            KafkaDelivery* d = static_cast<KafkaDelivery*>(message.msg_opaque());
+            // 转入暂存的消息不回调 //
+            if (Respill(message))
+            {
+                delete d;
+                return;
+            }
+
+            if (d == NULL)
+                return;
+            d->cb(message.err(), message.partition(), message.offset(), d->param);
+            delete d;
+        }
+
+    private:
+        // 暂存打开时，超时或连接失败的消息重新加入暂存，等待恢复后再发送 //
+        bool Respill(RdKafka::Message& message)
+        {
+            // 未暂存时不需要加锁，先检查再加锁 //
+            RdKafka::ErrorCode ec = message.err();
+            if (!m_spill.IsOpen()
+                || (ec != RdKafka::ERR__MSG_TIMED_OUT && ec != RdKafka::ERR__TRANSPORT && ec != RdKafka::ERR__ALL_BROKERS_DOWN))
+                return false;
+
+            const std::string* key = message.key();
+            const char* payload = static_cast<const char*>(message.payload());
+            KLockGuard<KMutex> lock(m_mtx);
+            return m_spill.IsOpen() && m_spill.Push(message.topic_name(), message.partition(),
+                key ? key->data() : "", key ? key->size() : 0,
+                payload ? payload : "", payload ? message.len() : 0);
+        }
+
+    private:
+        KKafkaSpillQueue& m_spill;
+        KMutex& m_mtx;
     };
 
     struct KafkaConf
@@ -44,9 +119,31 @@ namespace thirdparty {
         std::string topicName;
         std::string brokers;
         int partitionKey;
+        // 批量发送等待时间和每批最大消息数 //
+        int lingerMs;
+        int batchNumMessages;
+        // none gzip snappy lz4 zstd //
+        std::string compression;
+        // 按key分区的方式，murmur2_random与Java客户端一致，没有key时随机 //
+        std::string partitioner;
+        // 本地队列满时阻塞等待 //
+        bool blockOnFull;
+        // 其它librdkafka全局配置 //
+        std::map<std::string, std::string> props;
+        // 幂等发送，重试不会重复或乱序 //
+        bool idempotence;
+        // Start后发送失败的消息暂存的内存和文件大小，都为0时不暂存 //
+        // 暂存时message.timeout.ms默认为0，broker断开期间消息留在本地队列，队列满后进入暂存 //
+        size_t spillMemoryBytes;
+        std::string spillFile;
+        uint64_t spillFileBytes;
+        // 后台线程空闲时Poll的等待时间 //
+        int pollIntervalMs;
 
         KafkaConf()
-            :partitionKey(1), partition(0)
+            :partitionKey(1), partition(0), lingerMs(100), batchNumMessages(16000),
+            compression("none"), partitioner("murmur2_random"), blockOnFull(false),
+            idempotence(false), spillMemoryBytes(0), spillFileBytes(1024 * 1024 * 1024), pollIntervalMs(100)
         {
 
         }
@@ -57,7 +154,10 @@ namespace thirdparty {
         struct KafkaProducer
         {
             RdKafka::Producer* producer;
+            // conf.topicName的主题，为空时没有 //
             RdKafka::Topic* topic;
+            // ProduceTo发送过的其它主题 //
+            std::map<std::string, RdKafka::Topic*> topics;
 
             KafkaProducer()
                 :producer(NULL), topic(NULL)
@@ -73,6 +173,14 @@ namespace thirdparty {
                     topic = NULL;
                 }
 
+                std::map<std::string, RdKafka::Topic*>::iterator it = topics.begin();
+                while (it != topics.end())
+                {
+                    delete it->second;
+                    ++it;
+                }
+                topics.clear();
+
                 if (producer)
                 {
                     delete producer;
@@ -85,11 +193,100 @@ namespace thirdparty {
         ~KKafkaProducer();
 
         void Initialize(const KafkaConf& conf);
+
+        /************************************
+        * Method:    启动后台线程，负责Poll、断线重建和发送暂存的消息，不需要再调用Poll
+        * Returns:
+        *************************************/
+        bool Start();
+
+        /************************************
+        * Method:    停止后台线程，等待暂存和队列中的消息发送完成
+        * Returns:
+        * Parameter: ms 最长等待时间，超时后内存中暂存的消息丢弃，文件中的下次启动时发送
+        *************************************/
+        void Stop(int ms = 5000);
+
         bool Produce(const std::string& msg, std::string& errStr);
+
+        /************************************
+        * Method:    按key分区发送，复制消息
+        * Returns:
+        * Parameter: msg
+        * Parameter: key 为空时随机分区
+        * Parameter: errStr
+        * Parameter: cb 发送结果回调，需要调用Poll，暂存后再发送的消息不回调，发送失败转入暂存的也不回调
+        * Parameter: param 回调参数
+        *************************************/
+        bool Produce(const std::string& msg, const std::string& key, std::string& errStr,
+            KafkaDeliveryCb cb = NULL, void* param = NULL);
+
+        /************************************
+        * Method:    零拷贝发送，成功后payload交给librdkafka，发送完成后free释放
+        * Returns:   失败时payload仍由调用者释放
+        * Parameter: payload malloc分配的内存
+        * Parameter: len
+        * Parameter: key
+        * Parameter: errStr
+        * Parameter: cb
+        * Parameter: param
+        *************************************/
+        bool Produce(char* payload, size_t len, const std::string& key, std::string& errStr,
+            KafkaDeliveryCb cb = NULL, void* param = NULL);
+
+        // 零拷贝发送，成功后buf的数据交给librdkafka，buf变为空 //
+        bool Produce(KBuffer& buf, const std::string& key, std::string& errStr,
+            KafkaDeliveryCb cb = NULL, void* param = NULL);
+
+        /************************************
+        * Method:    发送到指定主题，按key分区，复制消息，多个主题共用一个生产者
+        * Returns:
+        * Parameter: topic 首次发送时创建并缓存，为空时为conf.topicName
+        * Parameter: msg
+        * Parameter: key 为空时随机分区
+        * Parameter: errStr
+        * Parameter: cb 同Produce
+        * Parameter: param
+        *************************************/
+        bool ProduceTo(const std::string& topic, const std::string& msg, const std::string& key, std::string& errStr,
+            KafkaDeliveryCb cb = NULL, void* param = NULL);
+
         void Poll(int ms = 0);
 
+        // 等待队列中的消息发送完成，返回剩余的消息数 //
+        int Flush(int ms);
+
+        // 暂存中的字节数 //
+        uint64_t SpillBytes() const;
+
     private:
         bool CreateProducer();
+
+        bool SetConf(RdKafka::Conf* kc, const std::string& name, const std::string& val);
+
+        bool ProduceInternal(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+            const std::string& key, std::string& errStr, KafkaDeliveryCb cb, void* param);
+
+        // 不加锁发送，生产者不可用时sent为false //
+        bool ProduceUnlocked(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+            const std::string& key, std::string& errStr, KafkaDeliveryCb cb, void* param, bool& sent);
+
+        // 调用produce，spill为true时在锁内调用，队列满时转入暂存 //
+        bool Send(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+            const std::string& key, std::string& errStr, KafkaDeliveryCb cb, void* param, bool spill);
+
+        // 加入暂存，RK_MSG_FREE的payload在成功后释放 //
+        bool Spill(const std::string& topic, int32_t partition, int flags, char* payload, size_t len,
+            const std::string& key, std::string& errStr);
+
+        // 取主题句柄，不存在时创建，生产者重建时释放 //
+        RdKafka::Topic* GetTopic(const std::string& topic, std::string& errStr);
+
+        // 发送暂存的消息，返回发送的条数 //
+        size_t DrainSpill(size_t maxCount);
+
+        int PollLoop(int);
+
         template<typename PointerType>
         void Release(PointerType*& p)
         {
@@ -102,8 +299,18 @@ namespace thirdparty {
 
     private:
         KEventCb* m_eventcb;
+        KDeliveryCb* m_drcb;
         KafkaProducer m_producer;
         KafkaConf m_conf;
         volatile bool m_running;
+        // 不加锁发送中的线程数，重建生产者前等待归零 //
+        AtomicInteger<int> m_producing;
+        // 保护m_producer.topics，不加锁发送时也会创建主题 //
+        KMutex m_topicMtx;
+
+        KMutex m_mtx;
+        KKafkaSpillQueue m_spill;
+        KPthread m_pollThread;
+        volatile bool m_polling;
     };
 };
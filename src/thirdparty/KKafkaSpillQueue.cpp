@@ -0,0 +1,182 @@
+#include "KKafkaSpillQueue.h"
+
+namespace thirdparty {
+    KKafkaSpillQueue::KKafkaSpillQueue()
+        :m_open(false), m_memoryBytes(0), m_maxMemoryBytes(0), m_file(NULL),
+        m_fileBytes(0), m_maxFileBytes(0), m_readPos(0), m_hasHead(false), m_headSize(0)
+    {
+
+    }
+
+    KKafkaSpillQueue::~KKafkaSpillQueue()
+    {
+        Close();
+    }
+
+    bool KKafkaSpillQueue::Open(size_t maxMemoryBytes, const std::string& file, uint64_t maxFileBytes)
+    {
+        Close();
+        m_maxMemoryBytes = maxMemoryBytes;
+        m_maxFileBytes = maxFileBytes;
+        m_fileName = file;
+        if (!m_fileName.empty())
+        {
+            m_file = fopen(m_fileName.c_str(), "a+b");
+            if (m_file == NULL)
+            {
+                printf("KKafkaSpillQueue open file failed:[%s]\n", m_fileName.c_str());
+                return false;
+            }
+
+            // 上次未发送完的消息 //
+            fseek(m_file, 0, SEEK_END);
+            long sz = ftell(m_file);
+            m_fileBytes = (sz > 0 ? uint64_t(sz) : 0);
+            m_readPos = 0;
+        }
+        m_open = true;
+        return true;
+    }
+
+    void KKafkaSpillQueue::Close()
+    {
+        if (m_file)
+        {
+            fclose(m_file);
+            m_file = NULL;
+        }
+        m_memory.clear();
+        m_memoryBytes = 0;
+        m_fileBytes = 0;
+        m_readPos = 0;
+        m_hasHead = false;
+        m_open = false;
+    }
+
+    bool KKafkaSpillQueue::Push(const std::string& topic, int32_t partition, const char* key, size_t keyLen, const char* payload, size_t len)
+    {
+        if (!m_open)
+            return false;
+
+        // 文件中有数据时继续写文件，保持顺序 //
+        size_t sz = topic.size() + keyLen + len;
+        if (m_fileBytes == m_readPos && m_memoryBytes + sz <= m_maxMemoryBytes)
+        {
+            m_memory.push_back(KafkaSpillMessage());
+            KafkaSpillMessage& msg = m_memory.back();
+            msg.topic = topic;
+            msg.partition = partition;
+            msg.key.assign(key, keyLen);
+            msg.payload.assign(payload, len);
+            m_memoryBytes += sz;
+            return true;
+        }
+
+        uint64_t recordSize = sizeof(RecordHeader) + sz;
+        if (m_file == NULL || m_fileBytes + recordSize > m_maxFileBytes)
+            return false;
+
+        RecordHeader header;
+        header.partition = partition;
+        header.topicLen = uint32_t(topic.size());
+        header.keyLen = uint32_t(keyLen);
+        header.len = uint32_t(len);
+        if (fwrite(&header, sizeof(header), 1, m_file) != 1
+            || (!topic.empty() && fwrite(topic.data(), topic.size(), 1, m_file) != 1)
+            || (keyLen > 0 && fwrite(key, keyLen, 1, m_file) != 1)
+            || (len > 0 && fwrite(payload, len, 1, m_file) != 1))
+        {
+            printf("KKafkaSpillQueue write file failed:[%s]\n", m_fileName.c_str());
+            return false;
+        }
+        m_fileBytes += recordSize;
+        return true;
+    }
+
+    bool KKafkaSpillQueue::Front(KafkaSpillMessage& msg)
+    {
+        if (!m_memory.empty())
+        {
+            msg = m_memory.front();
+            return true;
+        }
+
+        if (!m_hasHead && !ReadHead())
+            return false;
+        msg = m_head;
+        return true;
+    }
+
+    void KKafkaSpillQueue::Pop()
+    {
+        if (!m_memory.empty())
+        {
+            const KafkaSpillMessage& msg = m_memory.front();
+            m_memoryBytes -= msg.topic.size() + msg.key.size() + msg.payload.size();
+            m_memory.pop_front();
+            return;
+        }
+
+        if (!m_hasHead)
+            return;
+        m_readPos += m_headSize;
+        m_hasHead = false;
+        if (m_readPos >= m_fileBytes)
+            Truncate();
+    }
+
+    bool KKafkaSpillQueue::IsEmpty() const
+    {
+        return m_memory.empty() && m_readPos >= m_fileBytes;
+    }
+
+    bool KKafkaSpillQueue::ReadHead()
+    {
+        if (m_file == NULL || m_readPos >= m_fileBytes)
+            return false;
+
+        fflush(m_file);
+        RecordHeader header;
+        if (fseek(m_file, long(m_readPos), SEEK_SET) != 0
+            || fread(&header, sizeof(header), 1, m_file) != 1
+            || m_readPos + sizeof(header) + header.topicLen + header.keyLen + header.len > m_fileBytes)
+        {
+            // 不完整的记录，丢弃剩余数据 //
+            printf("KKafkaSpillQueue broken record at:[%llu]\n", (unsigned long long)m_readPos);
+            Truncate();
+            return false;
+        }
+
+        m_head.partition = header.partition;
+        m_head.topic.resize(header.topicLen);
+        m_head.key.resize(header.keyLen);
+        m_head.payload.resize(header.len);
+        if ((header.topicLen > 0 && fread(&m_head.topic[0], header.topicLen, 1, m_file) != 1)
+            || (header.keyLen > 0 && fread(&m_head.key[0], header.keyLen, 1, m_file) != 1)
+            || (header.len > 0 && fread(&m_head.payload[0], header.len, 1, m_file) != 1))
+        {
+            Truncate();
+            return false;
+        }
+        m_headSize = sizeof(header) + header.topicLen + header.keyLen + header.len;
+        m_hasHead = true;
+        return true;
+    }
+
+    void KKafkaSpillQueue::Truncate()
+    {
+        m_hasHead = false;
+        m_readPos = 0;
+        m_fileBytes = 0;
+        if (m_file == NULL)
+            return;
+
+        fclose(m_file);
+        m_file = fopen(m_fileName.c_str(), "w+b");
+        if (m_file)
+        {
+            fclose(m_file);
+            m_file = fopen(m_fileName.c_str(), "a+b");
+        }
+    }
+};
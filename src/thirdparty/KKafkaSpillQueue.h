@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+namespace thirdparty {
+    struct KafkaSpillMessage
+    {
+        // 为空时是生产者的默认主题 //
+        std::string topic;
+        int32_t partition;
+        std::string key;
+        std::string payload;
+    };
+
+    // 暂存发送不出去的消息，先存内存，内存满后追加到文件，按写入顺序取出，非线程安全 //
+    class KKafkaSpillQueue
+    {
+    public:
+        KKafkaSpillQueue();
+
+        ~KKafkaSpillQueue();
+
+        /************************************
+        * Method:    打开，文件中已有的消息会先取出
+        * Returns:
+        * Parameter: maxMemoryBytes 内存中最多缓存的字节数
+        * Parameter: file 为空时只用内存
+        * Parameter: maxFileBytes 文件最大字节数
+        *************************************/
+        bool Open(size_t maxMemoryBytes, const std::string& file, uint64_t maxFileBytes);
+
+        // 关闭，内存中的消息丢弃，文件中的保留，读取位置不保存，下次打开时可能重复 //
+        void Close();
+
+        inline bool IsOpen() const { return m_open; }
+
+        // 满时返回false //
+        bool Push(const std::string& topic, int32_t partition, const char* key, size_t keyLen, const char* payload, size_t len);
+
+        // 取出最早的消息，不删除 //
+        bool Front(KafkaSpillMessage& msg);
+
+        void Pop();
+
+        bool IsEmpty() const;
+
+        inline size_t MemoryBytes() const { return m_memoryBytes; }
+
+        inline uint64_t FileBytes() const { return m_fileBytes - m_readPos; }
+
+    private:
+        struct RecordHeader
+        {
+            int32_t partition;
+            uint32_t topicLen;
+            uint32_t keyLen;
+            uint32_t len;
+        };
+
+        bool ReadHead();
+
+        // 文件已读完，清空 //
+        void Truncate();
+
+    private:
+        bool m_open;
+        std::deque<KafkaSpillMessage> m_memory;
+        size_t m_memoryBytes;
+        size_t m_maxMemoryBytes;
+
+        std::string m_fileName;
+        FILE* m_file;
+        uint64_t m_fileBytes;
+        uint64_t m_maxFileBytes;
+        uint64_t m_readPos;
+
+        // 从文件中读出的第一条 //
+        KafkaSpillMessage m_head;
+        bool m_hasHead;
+        uint64_t m_headSize;
+    };
+};
@@ -0,0 +1,151 @@
+#include "KMqActivemq.h"
+#include "util/KTime.h"
+
+namespace thirdparty {
+    // 等待处理完成后确认的消息 //
+    struct ActivemqAckContext
+    {
+        KMqActivemqSource* source;
+        Message* msg;
+        uint32_t generation;
+    };
+
+    KMqActivemqProducer::KMqActivemqProducer(const std::vector<std::string>& brokers,
+        const ActivemqProducerOptions& opts)
+        :m_producer(brokers, "", opts)
+    {
+
+    }
+
+    KMqActivemqProducer::~KMqActivemqProducer()
+    {
+        m_producer.Stop();
+    }
+
+    bool KMqActivemqProducer::Start()
+    {
+        return m_producer.Start();
+    }
+
+    bool KMqActivemqProducer::Send(const MqMessage& msg, MqDeliveryCb cb, void* param)
+    {
+        // 发送或事务提交后在发送线程中回调 //
+        return m_producer.Send(msg.topic, msg.payload, cb, param);
+    }
+
+    size_t KMqActivemqProducer::Flush(int ms)
+    {
+        uint64_t begin = 0, now = 0;
+        klib::KTime::NowMillisecond(begin);
+        now = begin;
+        while (!m_producer.IsEmpty() && now - begin < uint64_t(ms))
+        {
+            klib::KTime::MSleep(1);
+            klib::KTime::NowMillisecond(now);
+        }
+        return m_producer.Size();
+    }
+
+    KMqActivemqSource::KMqActivemqSource(const std::vector<std::string>& brokers, const std::string& destURI,
+        const ActivemqConsumerOptions& opts, KMqLane& lane)
+        :KActivemqConsumer(brokers, destURI, opts), m_topic(destURI), m_lane(lane)
+    {
+
+    }
+
+    void KMqActivemqSource::Pause()
+    {
+        try {
+            if (m_connection != NULL)
+                m_connection->stop();
+        }
+        catch (CMSException& e) {}
+    }
+
+    bool KMqActivemqSource::OnText(const TextMessage* msg)
+    {
+        // 消息只在回调中有效，保留副本在处理完成后确认 //
+        ActivemqAckContext* ctx = new ActivemqAckContext;
+        ctx->source = this;
+        ctx->msg = msg->clone();
+        ctx->generation = GetGeneration();
+
+        // 处理线程队列满时阻塞会话，由预取窗口限制broker发送 //
+        MqMessage m;
+        m.topic = m_topic;
+        m.payload = msg->getText();
+        if (m_lane.Deliver(m, OnProcessed, ctx))
+            return true;
+
+        Release(ctx->msg);
+        delete ctx;
+        return false;
+    }
+
+    void KMqActivemqSource::OnProcessed(bool success, void* param)
+    {
+        // 处理失败的不确认，重连后重新投递 //
+        ActivemqAckContext* ctx = static_cast<ActivemqAckContext*>(param);
+        if (success)
+            ctx->source->Acknowledge(ctx->msg, ctx->generation);
+        Release(ctx->msg);
+        delete ctx;
+    }
+
+    KMqActivemqConsumer::KMqActivemqConsumer(const std::vector<std::string>& brokers,
+        const ActivemqConsumerOptions& opts, size_t batchSize, size_t queueSize)
+        :m_brokers(brokers), m_opts(opts), m_batchSize(batchSize), m_queueSize(queueSize)
+    {
+        m_opts.workers = 0;
+        m_opts.ackMode = AckDeferred;
+    }
+
+    KMqActivemqConsumer::~KMqActivemqConsumer()
+    {
+        Stop();
+    }
+
+    bool KMqActivemqConsumer::Start(const std::vector<std::string>& topics, KMqHandler* handler)
+    {
+        if (!m_sources.empty() || handler == NULL || topics.empty())
+            return false;
+
+        for (size_t i = 0; i < topics.size(); ++i)
+        {
+            KMqLane* lane = new KMqLane(handler, m_batchSize, m_queueSize);
+            lane->Start();
+            m_lanes.push_back(lane);
+            m_sources.push_back(new KMqActivemqSource(m_brokers, topics[i], m_opts, *lane));
+        }
+
+        // 连接失败的由KeepAlive重试 //
+        bool rc = true;
+        for (size_t i = 0; i < m_sources.size(); ++i)
+            rc = m_sources[i]->Start() && rc;
+        return rc;
+    }
+
+    void KMqActivemqConsumer::Stop()
+    {
+        // 先停止分发，等处理线程处理完已收到的消息并确认后再关闭会话 //
+        for (size_t i = 0; i < m_sources.size(); ++i)
+            m_sources[i]->Pause();
+        klib::DrainAndRelease(m_lanes);
+
+        for (size_t i = 0; i < m_sources.size(); ++i)
+        {
+            m_sources[i]->Stop();
+            delete m_sources[i];
+        }
+        m_sources.clear();
+    }
+
+    void KMqActivemqConsumer::KeepAlive()
+    {
+        for (size_t i = 0; i < m_sources.size(); ++i)
+        {
+            if (!m_sources[i]->IsConnected())
+                m_sources[i]->Start();
+        }
+    }
+};
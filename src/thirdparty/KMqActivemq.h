@@ -0,0 +1,72 @@
+#pragma once
+#include "thirdparty/KMqInterface.h"
+#include "thirdparty/KActivemqConsumer.h"
+#include "thirdparty/KActivemqProducer.h"
+
+namespace thirdparty {
+    // 主题为ActiveMQ的目的地，发送完成或事务提交后回调 //
+    class KMqActivemqProducer :public KMqProducer
+    {
+    public:
+        KMqActivemqProducer(const std::vector<std::string>& brokers,
+            const ActivemqProducerOptions& opts = ActivemqProducerOptions());
+
+        virtual ~KMqActivemqProducer();
+
+        bool Start();
+
+        virtual bool Send(const MqMessage& msg, MqDeliveryCb cb = NULL, void* param = NULL);
+
+        virtual size_t Flush(int ms);
+
+    private:
+        KActivemqProducer m_producer;
+    };
+
+    // 每个目的地一个KActivemqConsumer，消息交给该目的地的处理线程，处理完成后确认 //
+    class KMqActivemqSource :public KActivemqConsumer
+    {
+    public:
+        KMqActivemqSource(const std::vector<std::string>& brokers, const std::string& destURI,
+            const ActivemqConsumerOptions& opts, KMqLane& lane);
+
+        // 停止分发，已交给处理线程的消息仍可确认 //
+        void Pause();
+
+    protected:
+        virtual bool OnText(const TextMessage* msg);
+
+    private:
+        // 处理线程中回调，成功时确认消息 //
+        static void OnProcessed(bool success, void* param);
+
+    private:
+        std::string m_topic;
+        KMqLane& m_lane;
+    };
+
+    class KMqActivemqConsumer :public KMqConsumer
+    {
+    public:
+        // workers不使用，消息由KMqLane处理；确认方式固定为AckDeferred //
+        KMqActivemqConsumer(const std::vector<std::string>& brokers,
+            const ActivemqConsumerOptions& opts = ActivemqConsumerOptions(), size_t batchSize = 100, size_t queueSize = 10000);
+
+        virtual ~KMqActivemqConsumer();
+
+        virtual bool Start(const std::vector<std::string>& topics, KMqHandler* handler);
+
+        virtual void Stop();
+
+        // 断开的连接重新连接，需要定时调用 //
+        void KeepAlive();
+
+    private:
+        std::vector<std::string> m_brokers;
+        ActivemqConsumerOptions m_opts;
+        size_t m_batchSize;
+        size_t m_queueSize;
+        std::vector<KMqLane*> m_lanes;
+        std::vector<KMqActivemqSource*> m_sources;
+    };
+};
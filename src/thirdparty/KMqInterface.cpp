@@ -0,0 +1,28 @@
+#include "KMqInterface.h"
+
+namespace thirdparty {
+    KMqLane::KMqLane(KMqHandler* handler, size_t batchSize, size_t maxSize)
+        :KBatchEventObject<MqMessage>("KMqLane Thread", batchSize, maxSize), m_handler(handler)
+    {
+
+    }
+
+    void KMqLane::ProcessBatch(const std::vector<MqMessage>& msgs)
+    {
+        m_handler->OnMessages(msgs);
+    }
+
+    size_t MqLaneIndex(const std::string& key, size_t lanes)
+    {
+        if (lanes <= 1)
+            return 0;
+
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            h ^= (unsigned char)key[i];
+            h *= 16777619u;
+        }
+        return h % lanes;
+    }
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "thread/KBatchEventObject.h"
+
+namespace thirdparty {
+    using namespace klib;
+    // 与消息中间件无关的消息 //
+    struct MqMessage
+    {
+        std::string topic;
+        // 相同key的消息按顺序投递，可以为空 //
+        std::string key;
+        std::string payload;
+    };
+
+    /************************************
+    * Method:    发送结果回调，在中间件的线程中执行
+    * Parameter: success
+    * Parameter: error 失败时的错误信息
+    * Parameter: param 发送时传入的参数
+    *************************************/
+    typedef void (*MqDeliveryCb)(bool success, const std::string& error, void* param);
+
+    // 发送接口，Send可以多线程调用 //
+    class KMqProducer
+    {
+    public:
+        virtual ~KMqProducer() {}
+
+        /************************************
+        * Method:    异步发送
+        * Returns:   本地队列满或未连接时返回false，由调用者决定重试或丢弃
+        * Parameter: msg
+        * Parameter: cb 为NULL时不回调
+        * Parameter: param
+        *************************************/
+        virtual bool Send(const MqMessage& msg, MqDeliveryCb cb = NULL, void* param = NULL) = 0;
+
+        // 批量发送，返回成功入队的条数 //
+        virtual size_t SendBatch(const std::vector<MqMessage>& msgs)
+        {
+            size_t count = 0;
+            while (count < msgs.size() && Send(msgs[count]))
+                ++count;
+            return count;
+        }
+
+        // 等待已发送的消息完成，返回未完成的条数 //
+        virtual size_t Flush(int ms) = 0;
+    };
+
+    // 消息处理接口 //
+    class KMqHandler
+    {
+    public:
+        virtual ~KMqHandler() {}
+
+        /************************************
+        * Method:    处理一批消息，在消费者的处理线程中调用，返回后消息视为已消费；
+        *            返回后才确认：kafka提交偏移，rocketmq返回消费成功，activemq逐条确认；
+        *            抛出异常时kafka仍提交偏移跳过这批消息，rocketmq和activemq不确认，之后重新投递，
+        *            loopback只在进程内，进程退出时队列中未处理的消息丢失
+        * Returns:
+        * Parameter: msgs 同一个key(分区、队列)的消息有序
+        *************************************/
+        virtual void OnMessages(const std::vector<MqMessage>& msgs) = 0;
+    };
+
+    // 消费接口，处理跟不上时暂停拉取 //
+    class KMqConsumer
+    {
+    public:
+        virtual ~KMqConsumer() {}
+
+        virtual bool Start(const std::vector<std::string>& topics, KMqHandler* handler) = 0;
+
+        virtual void Stop() = 0;
+    };
+
+    // 处理线程，把队列中已到达的消息按批交给KMqHandler //
+    class KMqLane :public KBatchEventObject<MqMessage>
+    {
+    public:
+        KMqLane(KMqHandler* handler, size_t batchSize, size_t maxSize);
+
+    protected:
+        virtual void ProcessBatch(const std::vector<MqMessage>& msgs);
+
+    private:
+        KMqHandler* m_handler;
+    };
+
+    // 按key选择处理线程 //
+    size_t MqLaneIndex(const std::string& key, size_t lanes);
+};
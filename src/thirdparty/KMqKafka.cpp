@@ -0,0 +1,113 @@
+#include "KMqKafka.h"
+#include <cstdio>
+
+namespace thirdparty {
+    KMqKafkaProducer::KMqKafkaProducer(const KafkaConf& conf)
+        :m_conf(conf), m_started(false)
+    {
+        // 没有默认主题，每条消息按MqMessage.topic发送 //
+        m_conf.topicName.clear();
+        m_producer.Initialize(m_conf);
+    }
+
+    KMqKafkaProducer::~KMqKafkaProducer()
+    {
+        m_producer.Stop();
+    }
+
+    bool KMqKafkaProducer::Send(const MqMessage& msg, MqDeliveryCb cb, void* param)
+    {
+        KKafkaProducer* producer = GetProducer();
+        if (producer == NULL)
+            return false;
+
+        // 暂存的消息没有发送回调，开启暂存时入队即回调 //
+        bool spill = (m_conf.spillMemoryBytes > 0 || !m_conf.spillFile.empty());
+        DeliveryContext* ctx = NULL;
+        if (cb && !spill)
+        {
+            ctx = new DeliveryContext;
+            ctx->cb = cb;
+            ctx->param = param;
+        }
+
+        std::string errStr;
+        bool rc = producer->ProduceTo(msg.topic, msg.payload, msg.key, errStr, ctx ? OnDelivery : NULL, ctx);
+        if (!rc)
+            delete ctx;
+        if (cb && (!rc || spill))
+            cb(rc, errStr, param);
+        return rc;
+    }
+
+    size_t KMqKafkaProducer::Flush(int ms)
+    {
+        if (!m_started)
+            return 0;
+        return size_t(m_producer.Flush(ms));
+    }
+
+    KKafkaProducer* KMqKafkaProducer::GetProducer()
+    {
+        if (m_started)
+            return &m_producer;
+
+        KLockGuard<KMutex> lock(m_mtx);
+        if (!m_started)
+        {
+            if (!m_producer.Start())
+            {
+                printf("KMqKafkaProducer start producer failed:[%s]\n", m_conf.brokers.c_str());
+                return NULL;
+            }
+            m_started = true;
+        }
+        return &m_producer;
+    }
+
+    void KMqKafkaProducer::OnDelivery(int err, int32_t /*partition*/, int64_t /*offset*/, void* param)
+    {
+        DeliveryContext* ctx = static_cast<DeliveryContext*>(param);
+        ctx->cb(err == RdKafka::ERR_NO_ERROR,
+            err == RdKafka::ERR_NO_ERROR ? std::string() : RdKafka::err2str(RdKafka::ErrorCode(err)), ctx->param);
+        delete ctx;
+    }
+
+    KMqKafkaConsumer::KMqKafkaConsumer(const KafkaConsumerConf& conf)
+        :m_mqConf(conf), m_handler(NULL)
+    {
+
+    }
+
+    KMqKafkaConsumer::~KMqKafkaConsumer()
+    {
+        Stop();
+    }
+
+    bool KMqKafkaConsumer::Start(const std::vector<std::string>& topics, KMqHandler* handler)
+    {
+        if (handler == NULL)
+            return false;
+
+        m_handler = handler;
+        m_mqConf.topics = topics;
+        return KKafkaConsumer::Start(m_mqConf);
+    }
+
+    void KMqKafkaConsumer::Stop()
+    {
+        KKafkaConsumer::Stop();
+    }
+
+    void KMqKafkaConsumer::ProcessMessages(const KafkaMessages& msgs)
+    {
+        std::vector<MqMessage> batch(msgs.size());
+        for (size_t i = 0; i < msgs.size(); ++i)
+        {
+            batch[i].topic = msgs[i].topic;
+            batch[i].key = msgs[i].key;
+            batch[i].payload = msgs[i].payload;
+        }
+        m_handler->OnMessages(batch);
+    }
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include "thirdparty/KMqInterface.h"
+#include "thirdparty/KKafkaProducer.h"
+#include "thirdparty/KKafkaConsumer.h"
+
+namespace thirdparty {
+    // 所有主题共用一个KKafkaProducer，首次发送时启动后台线程，主题句柄按需创建 //
+    class KMqKafkaProducer :public KMqProducer
+    {
+    public:
+        // conf.topicName不使用 //
+        KMqKafkaProducer(const KafkaConf& conf);
+
+        virtual ~KMqKafkaProducer();
+
+        virtual bool Send(const MqMessage& msg, MqDeliveryCb cb = NULL, void* param = NULL);
+
+        virtual size_t Flush(int ms);
+
+    private:
+        struct DeliveryContext
+        {
+            MqDeliveryCb cb;
+            void* param;
+        };
+
+        // 首次调用时启动，失败时返回NULL，下次发送再重试 //
+        KKafkaProducer* GetProducer();
+
+        static void OnDelivery(int err, int32_t /*partition*/, int64_t /*offset*/, void* param);
+
+    private:
+        KafkaConf m_conf;
+        KMutex m_mtx;
+        KKafkaProducer m_producer;
+        volatile bool m_started;
+    };
+
+    class KMqKafkaConsumer :public KMqConsumer, private KKafkaConsumer
+    {
+    public:
+        // conf.topics由Start传入 //
+        KMqKafkaConsumer(const KafkaConsumerConf& conf);
+
+        virtual ~KMqKafkaConsumer();
+
+        virtual bool Start(const std::vector<std::string>& topics, KMqHandler* handler);
+
+        virtual void Stop();
+
+    protected:
+        virtual void ProcessMessages(const KafkaMessages& msgs);
+
+    private:
+        KafkaConsumerConf m_mqConf;
+        KMqHandler* m_handler;
+    };
+};
@@ -0,0 +1,121 @@
+#include "KMqLoopback.h"
+#include "util/KTime.h"
+
+namespace thirdparty {
+    bool KMqLoopbackBroker::Publish(const MqMessage& msg)
+    {
+        KLockGuard<KMutex> lock(m_mtx);
+        std::map<std::string, std::vector<KMqLoopbackConsumer*> >::iterator it = m_topics.find(msg.topic);
+        if (it == m_topics.end())
+        {
+            ++m_published;
+            return true;
+        }
+
+        // 处理线程只会取出消息，在锁内检查后投递不会失败 //
+        std::vector<KMqLoopbackConsumer*>& consumers = it->second;
+        std::vector<KMqLane*> lanes(consumers.size(), (KMqLane*)NULL);
+        for (size_t i = 0; i < consumers.size(); ++i)
+        {
+            lanes[i] = consumers[i]->SelectLane(msg);
+            if (lanes[i]->IsFull())
+                return false;
+        }
+
+        for (size_t i = 0; i < lanes.size(); ++i)
+            lanes[i]->TryDeliver(msg);
+        ++m_published;
+        return true;
+    }
+
+    void KMqLoopbackBroker::Subscribe(const std::string& topic, KMqLoopbackConsumer* consumer)
+    {
+        KLockGuard<KMutex> lock(m_mtx);
+        m_topics[topic].push_back(consumer);
+    }
+
+    void KMqLoopbackBroker::Unsubscribe(KMqLoopbackConsumer* consumer)
+    {
+        KLockGuard<KMutex> lock(m_mtx);
+        std::map<std::string, std::vector<KMqLoopbackConsumer*> >::iterator it = m_topics.begin();
+        while (it != m_topics.end())
+        {
+            std::vector<KMqLoopbackConsumer*>& consumers = it->second;
+            for (size_t i = 0; i < consumers.size();)
+            {
+                if (consumers[i] == consumer)
+                    consumers.erase(consumers.begin() + i);
+                else
+                    ++i;
+            }
+
+            if (consumers.empty())
+                m_topics.erase(it++);
+            else
+                ++it;
+        }
+    }
+
+    KMqLoopbackProducer::KMqLoopbackProducer(KMqLoopbackBroker& broker)
+        :m_broker(broker)
+    {
+
+    }
+
+    bool KMqLoopbackProducer::Send(const MqMessage& msg, MqDeliveryCb cb, void* param)
+    {
+        bool rc = m_broker.Publish(msg);
+        if (cb)
+            cb(rc, rc ? std::string() : std::string("queue full"), param);
+        return rc;
+    }
+
+    KMqLoopbackConsumer::KMqLoopbackConsumer(KMqLoopbackBroker& broker, size_t lanes, size_t batchSize, size_t queueSize)
+        :m_broker(broker), m_laneCount(lanes > 0 ? lanes : 1), m_batchSize(batchSize), m_queueSize(queueSize), m_next(0)
+    {
+
+    }
+
+    KMqLoopbackConsumer::~KMqLoopbackConsumer()
+    {
+        Stop();
+    }
+
+    bool KMqLoopbackConsumer::Start(const std::vector<std::string>& topics, KMqHandler* handler)
+    {
+        if (!m_lanes.empty() || handler == NULL || topics.empty())
+            return false;
+
+        for (size_t i = 0; i < m_laneCount; ++i)
+        {
+            KMqLane* lane = new KMqLane(handler, m_batchSize, m_queueSize);
+            lane->Start();
+            m_lanes.push_back(lane);
+        }
+
+        std::vector<std::string>::const_iterator it = topics.begin();
+        while (it != topics.end())
+        {
+            m_broker.Subscribe(*it, this);
+            ++it;
+        }
+        return true;
+    }
+
+    void KMqLoopbackConsumer::Stop()
+    {
+        if (m_lanes.empty())
+            return;
+
+        m_broker.Unsubscribe(this);
+        DrainAndRelease(m_lanes);
+    }
+
+    KMqLane* KMqLoopbackConsumer::SelectLane(const MqMessage& msg)
+    {
+        // 没有key时轮询 //
+        if (msg.key.empty())
+            return m_lanes[m_next++ % m_lanes.size()];
+        return m_lanes[MqLaneIndex(msg.key, m_lanes.size())];
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include "thirdparty/KMqInterface.h"
+#include "thread/KMutex.h"
+#include "thread/KLockGuard.h"
+#include "thread/KAtomic.h"
+#include <map>
+
+namespace thirdparty {
+    class KMqLoopbackConsumer;
+
+    // 进程内的消息转发，用于测试和压测处理逻辑，不需要中间件 //
+    class KMqLoopbackBroker
+    {
+    public:
+        /************************************
+        * Method:    投递给订阅该主题的所有消费者
+        * Returns:   有消费者的队列满时返回false，所有消费者都不投递
+        * Parameter: msg
+        *************************************/
+        bool Publish(const MqMessage& msg);
+
+        void Subscribe(const std::string& topic, KMqLoopbackConsumer* consumer);
+
+        void Unsubscribe(KMqLoopbackConsumer* consumer);
+
+        inline uint64_t Published() const { return m_published; }
+
+    private:
+        KMutex m_mtx;
+        std::map<std::string, std::vector<KMqLoopbackConsumer*> > m_topics;
+        AtomicInteger<uint64_t> m_published;
+    };
+
+    class KMqLoopbackProducer :public KMqProducer
+    {
+    public:
+        KMqLoopbackProducer(KMqLoopbackBroker& broker);
+
+        // 入队后立即回调 //
+        virtual bool Send(const MqMessage& msg, MqDeliveryCb cb = NULL, void* param = NULL);
+
+        virtual size_t Flush(int /*ms*/) { return 0; }
+
+    private:
+        KMqLoopbackBroker& m_broker;
+    };
+
+    class KMqLoopbackConsumer :public KMqConsumer
+    {
+        friend class KMqLoopbackBroker;
+    public:
+        KMqLoopbackConsumer(KMqLoopbackBroker& broker, size_t lanes = 1, size_t batchSize = 100, size_t queueSize = 10000);
+
+        virtual ~KMqLoopbackConsumer();
+
+        virtual bool Start(const std::vector<std::string>& topics, KMqHandler* handler);
+
+        // 等待已投递的消息处理完成后停止 //
+        virtual void Stop();
+
+    private:
+        // 在broker的锁内调用 //
+        KMqLane* SelectLane(const MqMessage& msg);
+
+    private:
+        KMqLoopbackBroker& m_broker;
+        size_t m_laneCount;
+        size_t m_batchSize;
+        size_t m_queueSize;
+        std::vector<KMqLane*> m_lanes;
+        uint32_t m_next;
+    };
+};
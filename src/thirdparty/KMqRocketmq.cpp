@@ -0,0 +1,117 @@
+#include "KMqRocketmq.h"
+#include "util/KTime.h"
+
+namespace thirdparty {
+    KMqRocketmqProducer::KMqRocketmqProducer(bool orderly)
+        :m_orderly(orderly)
+    {
+
+    }
+
+    KMqRocketmqProducer::~KMqRocketmqProducer()
+    {
+        m_producer.Stop();
+    }
+
+    bool KMqRocketmqProducer::Start(const std::string& brokers, const std::string& groupid, int sendTimeoutMs)
+    {
+        return m_producer.Start(brokers, groupid, sendTimeoutMs);
+    }
+
+    bool KMqRocketmqProducer::Send(const MqMessage& msg, MqDeliveryCb cb, void* param)
+    {
+        RocketMqOutMessage rmsg;
+        rmsg.topic = msg.topic;
+        rmsg.keys = msg.key;
+        rmsg.body = msg.payload;
+        if (m_orderly && !msg.key.empty())
+        {
+            std::string msgId;
+            bool rc = m_producer.SendOrderly(rmsg, msg.key, msgId);
+            if (cb)
+                cb(rc, rc ? std::string() : std::string("send orderly failed"), param);
+            return rc;
+        }
+
+        DeliveryContext* ctx = NULL;
+        if (cb)
+        {
+            ctx = new DeliveryContext;
+            ctx->cb = cb;
+            ctx->param = param;
+        }
+
+        if (!m_producer.SendAsync(rmsg, ctx ? OnDelivery : NULL, ctx))
+        {
+            delete ctx;
+            return false;
+        }
+        return true;
+    }
+
+    size_t KMqRocketmqProducer::Flush(int ms)
+    {
+        uint64_t begin = 0, now = 0;
+        KTime::NowMillisecond(begin);
+        now = begin;
+        while (m_producer.Pending() > 0 && now - begin < uint64_t(ms))
+        {
+            KTime::MSleep(1);
+            KTime::NowMillisecond(now);
+        }
+        return m_producer.Pending();
+    }
+
+    void KMqRocketmqProducer::OnDelivery(bool success, const std::string& result, void* param)
+    {
+        DeliveryContext* ctx = static_cast<DeliveryContext*>(param);
+        ctx->cb(success, success ? std::string() : result, ctx->param);
+        delete ctx;
+    }
+
+    KMqRocketmqConsumer::KMqRocketmqConsumer(const std::string& brokers, const std::string& groupid,
+        const RocketMqConsumerOptions& opts)
+        :KRocketMqConsumer(WithLanes(opts)), m_brokers(brokers), m_groupid(groupid), m_handler(NULL)
+    {
+
+    }
+
+    KMqRocketmqConsumer::~KMqRocketmqConsumer()
+    {
+        Stop();
+    }
+
+    bool KMqRocketmqConsumer::Start(const std::vector<std::string>& topics, KMqHandler* handler)
+    {
+        if (handler == NULL)
+            return false;
+
+        m_handler = handler;
+        return KRocketMqConsumer::Start(m_brokers, topics, m_groupid);
+    }
+
+    void KMqRocketmqConsumer::Stop()
+    {
+        KRocketMqConsumer::Stop();
+    }
+
+    void KMqRocketmqConsumer::ProcessMessages(const std::vector<RocketMqMessage>& msgs)
+    {
+        std::vector<MqMessage> batch(msgs.size());
+        for (size_t i = 0; i < msgs.size(); ++i)
+        {
+            batch[i].topic = msgs[i].topic;
+            batch[i].key = msgs[i].keys;
+            batch[i].payload = msgs[i].body;
+        }
+        m_handler->OnMessages(batch);
+    }
+
+    RocketMqConsumerOptions KMqRocketmqConsumer::WithLanes(const RocketMqConsumerOptions& opts)
+    {
+        RocketMqConsumerOptions o = opts;
+        if (o.lanes == 0)
+            o.lanes = 1;
+        return o;
+    }
+};
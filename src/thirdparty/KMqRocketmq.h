@@ -0,0 +1,59 @@
+#pragma once
+#include "thirdparty/KMqInterface.h"
+#include "thirdparty/KRocketMqConsumer.h"
+#include "thirdparty/KRocketMqProducer.h"
+
+namespace thirdparty {
+    class KMqRocketmqProducer :public KMqProducer
+    {
+    public:
+        // orderly为true时有key的消息按key选择队列同步发送 //
+        KMqRocketmqProducer(bool orderly = false);
+
+        virtual ~KMqRocketmqProducer();
+
+        bool Start(const std::string& brokers, const std::string& groupid, int sendTimeoutMs = 3000);
+
+        virtual bool Send(const MqMessage& msg, MqDeliveryCb cb = NULL, void* param = NULL);
+
+        virtual size_t Flush(int ms);
+
+    private:
+        struct DeliveryContext
+        {
+            MqDeliveryCb cb;
+            void* param;
+        };
+
+        static void OnDelivery(bool success, const std::string& result, void* param);
+
+    private:
+        KRocketMqProducer m_producer;
+        bool m_orderly;
+    };
+
+    class KMqRocketmqConsumer :public KMqConsumer, private KRocketMqConsumer
+    {
+    public:
+        // opts.lanes为0时使用1 //
+        KMqRocketmqConsumer(const std::string& brokers, const std::string& groupid,
+            const RocketMqConsumerOptions& opts = RocketMqConsumerOptions());
+
+        virtual ~KMqRocketmqConsumer();
+
+        virtual bool Start(const std::vector<std::string>& topics, KMqHandler* handler);
+
+        virtual void Stop();
+
+    protected:
+        virtual void ProcessMessages(const std::vector<RocketMqMessage>& msgs);
+
+    private:
+        static RocketMqConsumerOptions WithLanes(const RocketMqConsumerOptions& opts);
+
+    private:
+        std::string m_brokers;
+        std::string m_groupid;
+        KMqHandler* m_handler;
+    };
+};
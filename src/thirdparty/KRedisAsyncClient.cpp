@@ -0,0 +1,571 @@
+#include "thirdparty/KRedisAsyncClient.h"
+#if defined(WIN32)
+#include <winsock2.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+
+namespace thirdparty {
+    static int ReplyToString(const redisReply* reply, std::string& val)
+    {
+        int state = KRedisPipeline::ReplyState(reply);
+        switch (state)
+        {
+        case KRedisClient::valstring:
+        case KRedisClient::valstatus:
+        case KRedisClient::valerror:
+            val.assign(reply->str, reply->len);
+            break;
+        case KRedisClient::valint64:
+            val.assign(KStringUtility::Int64ToString(reply->integer));
+            break;
+        default:
+            break;
+        }
+        return state;
+    }
+
+    KRedisFuture::~KRedisFuture()
+    {
+        Reset();
+    }
+
+    int KRedisFuture::GetState() const
+    {
+        RedisAsyncResult r;
+        Get(r);
+        return r.state;
+    }
+
+    const redisReply* KRedisFuture::GetReply() const
+    {
+        RedisAsyncResult r;
+        Get(r);
+        return r.reply;
+    }
+
+    int KRedisFuture::GetValue(std::string& val) const
+    {
+        RedisAsyncResult r;
+        if (!Get(r) || !r.reply)
+            return r.state;
+        return ReplyToString(r.reply, val);
+    }
+
+    int KRedisFuture::GetValue(std::vector<std::string>& vals) const
+    {
+        RedisAsyncResult r;
+        if (!Get(r) || !r.reply)
+            return r.state;
+
+        if (r.reply->type == REDIS_REPLY_ARRAY)
+        {
+            for (size_t i = 0; i < r.reply->elements; ++i)
+            {
+                std::string val;
+                ReplyToString(r.reply->element[i], val);
+                vals.push_back(val);
+            }
+            return KRedisClient::valarray;
+        }
+
+        std::string val;
+        int rc = ReplyToString(r.reply, val);
+        vals.push_back(val);
+        return rc;
+    }
+
+    void KRedisFuture::Reset()
+    {
+        RedisAsyncResult old;
+        KFuture<RedisAsyncResult>::Reset(old);
+        if (old.reply)
+            freeReplyObject(old.reply);
+    }
+
+    void KRedisFuture::Complete(redisReply* reply, int state)
+    {
+        RedisAsyncResult r;
+        r.reply = reply;
+        r.state = state;
+        KFuture<RedisAsyncResult>::Complete(r);
+    }
+
+    KRedisPipeline::KRedisPipeline(const std::vector<RedisConfig>& confs, size_t maxPending)
+        :m_confs(confs), m_requests(maxPending), m_ctx(NULL), m_reader(NULL),
+        m_connected(false), m_running(false),
+        m_writeThread("Redis pipeline write thread"), m_readThread("Redis pipeline read thread")
+    {
+
+    }
+
+    KRedisPipeline::~KRedisPipeline()
+    {
+        Stop();
+    }
+
+    bool KRedisPipeline::Start()
+    {
+        if (m_running)
+            return true;
+
+        m_running = true;
+        if (m_readThread.Run(this, &KRedisPipeline::ReadLoop, 0) != KPthread::Success)
+        {
+            m_running = false;
+            return false;
+        }
+
+        if (m_writeThread.Run(this, &KRedisPipeline::WriteLoop, 0) != KPthread::Success)
+        {
+            m_running = false;
+            m_readThread.Join();
+            return false;
+        }
+        return true;
+    }
+
+    void KRedisPipeline::Stop()
+    {
+        {
+            // 与Submit互斥，之后入队的请求都被拒绝，不会遗留在队列中 //
+            KLockGuard<KMutex> lock(m_submitMtx);
+            if (!m_running)
+                return;
+            m_running = false;
+        }
+        m_writeThread.Join();
+        m_readThread.Join();
+        Disconnect();
+
+        std::deque<RedisAsyncRequest*> left;
+        m_requests.GetAll(left);
+        FailAll(left, KRedisClient::valunconnected);
+    }
+
+    bool KRedisPipeline::Submit(RedisAsyncRequest* req)
+    {
+        KLockGuard<KMutex> lock(m_submitMtx);
+        if (!m_running)
+            return false;
+        return m_requests.PushBack(req);
+    }
+
+    size_t KRedisPipeline::Pending() const
+    {
+        KLockGuard<KMutex> lock(m_inflightMtx);
+        return m_inflight.size() + m_requests.Size();
+    }
+
+    int KRedisPipeline::ReplyState(const redisReply* reply)
+    {
+        if (!reply)
+            return KRedisClient::valnullreply;
+
+        switch (reply->type)
+        {
+        case REDIS_REPLY_STRING:
+            return KRedisClient::valstring;
+        case REDIS_REPLY_INTEGER:
+            return KRedisClient::valint64;
+        case REDIS_REPLY_STATUS:
+            return KRedisClient::valstatus;
+        case REDIS_REPLY_NIL:
+            return KRedisClient::valnil;
+        case REDIS_REPLY_ERROR:
+            return KRedisClient::valerror;
+        case REDIS_REPLY_ARRAY:
+            return KRedisClient::valarray;
+        default:
+            return KRedisClient::valunsupport;
+        }
+    }
+
+    void KRedisPipeline::Complete(RedisAsyncRequest* req, redisReply* reply, int state)
+    {
+        if (req->future)
+        {
+            // future 负责释放应答 //
+            req->future->Complete(reply, state);
+        }
+        else
+        {
+            if (req->cb)
+            {
+                try
+                {
+                    req->cb(reply, state, req->param);
+                }
+                catch (const std::exception& e)
+                {
+                    printf("KRedisPipeline callback exception:[%s]\n", e.what());
+                }
+            }
+
+            if (reply)
+                freeReplyObject(reply);
+        }
+        delete req;
+    }
+
+    int KRedisPipeline::WriteLoop(int)
+    {
+        std::string out;
+        std::deque<RedisAsyncRequest*> batch;
+        while (m_running)
+        {
+            RedisAsyncRequest* req = NULL;
+            if (!m_requests.PopFront(req, 100))
+                continue;
+
+            // 把当前排队的请求一起取出，一次写入 //
+            batch.clear();
+            m_requests.GetPart(RedisPipelineDepth - 1, batch);
+            batch.push_front(req);
+
+            out.clear();
+            std::deque<RedisAsyncRequest*>::const_iterator it = batch.begin();
+            while (it != batch.end())
+            {
+                out.append((*it)->cmd);
+                ++it;
+            }
+
+            KLockGuard<KMutex> lock(m_ioMtx);
+            if (!m_connected)
+            {
+                FailAll(batch, KRedisClient::valunconnected);
+                continue;
+            }
+
+            // 先登记再发送，保证应答到达时能找到请求 //
+            {
+                KLockGuard<KMutex> ilock(m_inflightMtx);
+                m_inflight.insert(m_inflight.end(), batch.begin(), batch.end());
+            }
+
+            if (!SendAll(out))
+            {
+                // 交给读线程清理连接和未应答请求 //
+#if defined(WIN32)
+                shutdown(m_ctx->fd, SD_BOTH);
+#else
+                shutdown(m_ctx->fd, SHUT_RDWR);
+#endif
+            }
+        }
+        return 0;
+    }
+
+    int KRedisPipeline::ReadLoop(int)
+    {
+        char* buf = new char[RedisReadBufferSize];
+        while (m_running)
+        {
+            if (!m_connected)
+            {
+                if (!Connect())
+                    KTime::MSleep(1000);
+                continue;
+            }
+
+            int rc = WaitReadable(500);
+            if (rc == 0)
+                continue;
+
+            int n = (rc > 0 ? ::recv(m_ctx->fd, buf, RedisReadBufferSize, 0) : -1);
+            if (n <= 0)
+            {
+#if !defined(WIN32)
+                if (n < 0 && errno == EINTR)
+                    continue;
+#endif
+                printf("KRedisPipeline connection lost:[%s:%d]\n",
+                    m_confs.empty() ? "" : m_confs.front().ip.c_str(), m_confs.empty() ? 0 : m_confs.front().port);
+                Disconnect();
+                continue;
+            }
+
+            if (redisReaderFeed(m_reader, buf, n) != REDIS_OK)
+            {
+                Disconnect();
+                continue;
+            }
+
+            void* reply = NULL;
+            while ((rc = redisReaderGetReply(m_reader, &reply)) == REDIS_OK && reply != NULL)
+            {
+                RedisAsyncRequest* req = NULL;
+                {
+                    KLockGuard<KMutex> lock(m_inflightMtx);
+                    if (!m_inflight.empty())
+                    {
+                        req = m_inflight.front();
+                        m_inflight.pop_front();
+                    }
+                }
+
+                redisReply* r = reinterpret_cast<redisReply*>(reply);
+                if (req)
+                    Complete(req, r, ReplyState(r));
+                else
+                    freeReplyObject(r);
+                reply = NULL;
+            }
+
+            if (rc != REDIS_OK)
+            {
+                printf("KRedisPipeline protocol error:[%s]\n", m_reader->errstr);
+                Disconnect();
+            }
+        }
+        delete[] buf;
+        return 0;
+    }
+
+    bool KRedisPipeline::Connect()
+    {
+        std::vector<RedisConfig>::const_iterator it = m_confs.begin();
+        while (it != m_confs.end())
+        {
+            timeval tv = { 3, 0 };
+            redisContext* ctx = redisConnectWithTimeout(it->ip.c_str(), it->port, tv);
+            if (ctx && !ctx->err)
+            {
+                std::string val;
+                bool authed = it->pwd.empty() || SyncExec(ctx, ("auth " + it->pwd).c_str(), val);
+                // 连上之后判断是否是master，不是的话再连接其它的 //
+                if (authed && SyncExec(ctx, "info replication", val)
+                    && val.find("role:master") != std::string::npos)
+                {
+                    KLockGuard<KMutex> lock(m_ioMtx);
+                    m_ctx = ctx;
+                    m_reader = redisReaderCreate();
+                    m_connected = true;
+                    printf("KRedisPipeline connected:[%s:%d]\n", it->ip.c_str(), it->port);
+                    return true;
+                }
+            }
+            if (ctx)
+                redisFree(ctx);
+            ++it;
+        }
+        return false;
+    }
+
+    void KRedisPipeline::Disconnect()
+    {
+        std::deque<RedisAsyncRequest*> inflight;
+        {
+            KLockGuard<KMutex> lock(m_ioMtx);
+            m_connected = false;
+            if (m_reader)
+            {
+                redisReaderFree(m_reader);
+                m_reader = NULL;
+            }
+
+            if (m_ctx)
+            {
+                redisFree(m_ctx);
+                m_ctx = NULL;
+            }
+
+            KLockGuard<KMutex> ilock(m_inflightMtx);
+            inflight.swap(m_inflight);
+        }
+        FailAll(inflight, KRedisClient::valunconnected);
+    }
+
+    bool KRedisPipeline::SendAll(const std::string& dat)
+    {
+        size_t sent = 0;
+        while (sent < dat.size())
+        {
+            int rc = ::send(m_ctx->fd, dat.c_str() + sent, int(dat.size() - sent), 0);
+            if (rc > 0)
+                sent += rc;
+#if !defined(WIN32)
+            else if (rc < 0 && errno == EINTR)
+                continue;
+#endif
+            else
+                return false;
+        }
+        return true;
+    }
+
+    int KRedisPipeline::WaitReadable(int ms)
+    {
+        pollfd p;
+        p.fd = m_ctx->fd;
+        p.events = POLLIN;
+        p.revents = 0;
+#if defined(WIN32)
+        int rc = WSAPoll(&p, 1, ms);
+#else
+        int rc = ::poll(&p, 1, ms);
+        if (rc < 0 && errno == EINTR)
+            return 0;
+#endif
+        return rc;
+    }
+
+    void KRedisPipeline::FailAll(std::deque<RedisAsyncRequest*>& reqs, int state)
+    {
+        std::deque<RedisAsyncRequest*>::iterator it = reqs.begin();
+        while (it != reqs.end())
+        {
+            Complete(*it, NULL, state);
+            ++it;
+        }
+        reqs.clear();
+    }
+
+    bool KRedisPipeline::SyncExec(redisContext* ctx, const char* cmd, std::string& val)
+    {
+        redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(ctx, cmd));
+        int rc = ReplyToString(reply, val);
+        if (reply)
+            freeReplyObject(reply);
+        return rc == KRedisClient::valstatus || rc == KRedisClient::valstring;
+    }
+
+    KRedisAsyncClient::KRedisAsyncClient()
+        :m_next(0)
+    {
+
+    }
+
+    KRedisAsyncClient::~KRedisAsyncClient()
+    {
+        Stop();
+    }
+
+    bool KRedisAsyncClient::Start(const std::vector<RedisConfig>& confs, uint16_t connections, size_t maxPending)
+    {
+        if (!m_pipelines.empty() || confs.empty())
+            return false;
+
+        for (uint16_t i = 0; i < (connections > 0 ? connections : 1); ++i)
+        {
+            KRedisPipeline* p = new KRedisPipeline(confs, maxPending);
+            if (!p->Start())
+            {
+                delete p;
+                Stop();
+                return false;
+            }
+            m_pipelines.push_back(p);
+        }
+        return true;
+    }
+
+    void KRedisAsyncClient::Stop()
+    {
+        std::vector<KRedisPipeline*>::iterator it = m_pipelines.begin();
+        while (it != m_pipelines.end())
+        {
+            (*it)->Stop();
+            delete *it;
+            ++it;
+        }
+        m_pipelines.clear();
+    }
+
+    bool KRedisAsyncClient::Command(const std::vector<std::string>& argv, KRedisFuture& future)
+    {
+        future.Reset();
+        RedisAsyncRequest* req = new RedisAsyncRequest;
+        req->future = &future;
+        future.SetSubmitted(true);
+        if (!Submit(argv, req))
+        {
+            future.SetSubmitted(false);
+            return false;
+        }
+        return true;
+    }
+
+    bool KRedisAsyncClient::Command(const std::vector<std::string>& argv, RedisReplyCb cb, void* param)
+    {
+        RedisAsyncRequest* req = new RedisAsyncRequest;
+        req->cb = cb;
+        req->param = param;
+        return Submit(argv, req);
+    }
+
+    int KRedisAsyncClient::Exec(const std::vector<std::string>& argv, std::string& val)
+    {
+        KRedisFuture future;
+        if (!Command(argv, future))
+            return KRedisClient::valunconnected;
+        future.Wait(-1);
+        return future.GetValue(val);
+    }
+
+    bool KRedisAsyncClient::IsConnected() const
+    {
+        std::vector<KRedisPipeline*>::const_iterator it = m_pipelines.begin();
+        while (it != m_pipelines.end())
+        {
+            if ((*it)->IsConnected())
+                return true;
+            ++it;
+        }
+        return false;
+    }
+
+    size_t KRedisAsyncClient::Pending() const
+    {
+        size_t count = 0;
+        std::vector<KRedisPipeline*>::const_iterator it = m_pipelines.begin();
+        while (it != m_pipelines.end())
+        {
+            count += (*it)->Pending();
+            ++it;
+        }
+        return count;
+    }
+
+    bool KRedisAsyncClient::Submit(const std::vector<std::string>& argv, RedisAsyncRequest* req)
+    {
+        KRedisPipeline* p = Route(argv);
+        if (p == NULL || argv.empty())
+        {
+            delete req;
+            return false;
+        }
+
+        // 在调用线程中编码，分摊CPU //
+        KRespEncoder::Encode(req->cmd, argv);
+
+        if (!p->Submit(req))
+        {
+            delete req;
+            return false;
+        }
+        return true;
+    }
+
+    KRedisPipeline* KRedisAsyncClient::Route(const std::vector<std::string>& argv)
+    {
+        if (m_pipelines.empty())
+            return NULL;
+
+        if (argv.size() < 2)
+            return m_pipelines[m_next++ % m_pipelines.size()];
+
+        // 按key哈希，保证同一个key的命令顺序 //
+        uint32_t h = 2166136261u;
+        const std::string& key = argv[1];
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            h ^= uint8_t(key[i]);
+            h *= 16777619u;
+        }
+        return m_pipelines[h % m_pipelines.size()];
+    }
+};
@@ -0,0 +1,241 @@
+#pragma once
+#ifndef _HIREDIS_ASYNC_HPP_
+#define _HIREDIS_ASYNC_HPP_
+
+#include "thirdparty/KRedisClient.h"
+#include "thread/KQueue.h"
+#include "thread/KFuture.h"
+#include "thread/KAtomic.h"
+#include <deque>
+/**
+redis异步管道客户端类
+多个线程的命令合并到少量连接上批量发送，应答按顺序回调或通过future返回
+**/
+namespace thirdparty {
+    using namespace klib;
+// 单次合并发送的最大命令数 //
+#define RedisPipelineDepth 1024
+
+    /************************************
+    * Method:    应答回调，在连接的读线程中执行，返回后reply被释放
+    * Parameter: reply 应答，未连接或断开时为NULL
+    * Parameter: state KRedisClient::ValState
+    * Parameter: param 用户参数
+    *************************************/
+    typedef void (*RedisReplyCb)(redisReply* reply, int state, void* param);
+
+    struct RedisAsyncResult
+    {
+        redisReply* reply;
+        // KRedisClient::ValState //
+        int state;
+
+        RedisAsyncResult()
+            :reply(NULL), state(KRedisClient::valnullreply)
+        {
+
+        }
+    };
+
+    class KRedisFuture :public KFuture<RedisAsyncResult>
+    {
+    public:
+        // 析构时等待应答完成，连接断开或停止时所有请求都会完成 //
+        ~KRedisFuture();
+
+        /************************************
+        * Method:    获取应答状态
+        * Returns:   KRedisClient::ValState
+        *************************************/
+        int GetState() const;
+
+        /************************************
+        * Method:    获取原始应答，由future负责释放
+        * Returns:
+        *************************************/
+        const redisReply* GetReply() const;
+
+        /************************************
+        * Method:    应答转换为字符串
+        * Returns:   KRedisClient::ValState
+        * Parameter: val
+        *************************************/
+        int GetValue(std::string& val) const;
+
+        /************************************
+        * Method:    应答转换为字符串数组
+        * Returns:   KRedisClient::ValState
+        * Parameter: vals
+        *************************************/
+        int GetValue(std::vector<std::string>& vals) const;
+
+        /************************************
+        * Method:    重置以便复用，未完成时等待完成
+        * Returns:
+        *************************************/
+        void Reset();
+
+    private:
+        void Complete(redisReply* reply, int state);
+
+        friend class KRedisPipeline;
+    };
+
+    struct RedisAsyncRequest
+    {
+        // 已编码的RESP命令 //
+        std::string cmd;
+        KRedisFuture* future;
+        RedisReplyCb cb;
+        void* param;
+
+        RedisAsyncRequest()
+            :future(NULL), cb(NULL), param(NULL)
+        {
+
+        }
+    };
+
+    /**
+    单个连接的管道，写线程批量发送，读线程解析应答并按先进先出完成请求
+    **/
+    class KRedisPipeline
+    {
+    public:
+        KRedisPipeline(const std::vector<RedisConfig>& confs, size_t maxPending);
+
+        ~KRedisPipeline();
+
+        bool Start();
+
+        void Stop();
+
+        /************************************
+        * Method:    请求入队
+        * Returns:   队列满或未运行返回false
+        * Parameter: req
+        *************************************/
+        bool Submit(RedisAsyncRequest* req);
+
+        inline bool IsConnected() const { return m_connected; }
+
+        // 排队和已发送未应答的请求数 //
+        size_t Pending() const;
+
+        /************************************
+        * Method:    应答类型转换为状态
+        * Returns:   KRedisClient::ValState
+        * Parameter: reply
+        *************************************/
+        static int ReplyState(const redisReply* reply);
+
+        /************************************
+        * Method:    完成请求并释放
+        * Returns:
+        * Parameter: req
+        * Parameter: reply
+        * Parameter: state
+        *************************************/
+        static void Complete(RedisAsyncRequest* req, redisReply* reply, int state);
+
+    private:
+        int WriteLoop(int);
+
+        int ReadLoop(int);
+
+        bool Connect();
+
+        void Disconnect();
+
+        bool SendAll(const std::string& dat);
+
+        int WaitReadable(int ms);
+
+        void FailAll(std::deque<RedisAsyncRequest*>& reqs, int state);
+
+        static bool SyncExec(redisContext* ctx, const char* cmd, std::string& val);
+
+    private:
+        std::vector<RedisConfig> m_confs;
+        KQueue<RedisAsyncRequest*> m_requests;
+        // 已发送未应答的请求 //
+        std::deque<RedisAsyncRequest*> m_inflight;
+        mutable KMutex m_inflightMtx;
+        // 入队与停止互斥 //
+        KMutex m_submitMtx;
+        // 连接建立/释放与写互斥 //
+        KMutex m_ioMtx;
+        redisContext* m_ctx;
+        redisReader* m_reader;
+        volatile bool m_connected;
+        volatile bool m_running;
+        KPthread m_writeThread;
+        KPthread m_readThread;
+    };
+
+    class KRedisAsyncClient
+    {
+    public:
+        KRedisAsyncClient();
+
+        virtual ~KRedisAsyncClient();
+
+        /************************************
+        * Method:    启动
+        * Returns:
+        * Parameter: confs redis地址，连接时选择master
+        * Parameter: connections 连接个数
+        * Parameter: maxPending 每个连接最大排队请求数
+        *************************************/
+        bool Start(const std::vector<RedisConfig>& confs, uint16_t connections = 1, size_t maxPending = 100000);
+
+        /************************************
+        * Method:    停止，未完成的请求以valunconnected完成
+        * Returns:
+        *************************************/
+        void Stop();
+
+        /************************************
+        * Method:    异步执行命令，同一个key的命令在同一个连接上按顺序执行
+        * Returns:   入队成功返回true
+        * Parameter: argv 命令和参数
+        * Parameter: future 由调用者持有直到完成
+        *************************************/
+        bool Command(const std::vector<std::string>& argv, KRedisFuture& future);
+
+        /************************************
+        * Method:    异步执行命令，应答通过回调返回
+        * Returns:   入队成功返回true
+        * Parameter: argv 命令和参数
+        * Parameter: cb 回调
+        * Parameter: param 回调参数
+        *************************************/
+        bool Command(const std::vector<std::string>& argv, RedisReplyCb cb, void* param);
+
+        /************************************
+        * Method:    同步执行命令
+        * Returns:   KRedisClient::ValState
+        * Parameter: argv
+        * Parameter: val
+        *************************************/
+        int Exec(const std::vector<std::string>& argv, std::string& val);
+
+        /************************************
+        * Method:    是否有连接可用
+        * Returns:
+        *************************************/
+        bool IsConnected() const;
+
+        size_t Pending() const;
+
+    private:
+        bool Submit(const std::vector<std::string>& argv, RedisAsyncRequest* req);
+
+        KRedisPipeline* Route(const std::vector<std::string>& argv);
+
+    private:
+        std::vector<KRedisPipeline*> m_pipelines;
+        AtomicInteger<uint32_t> m_next;
+    };
+};
+#endif
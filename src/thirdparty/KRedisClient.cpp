@@ -2,7 +2,8 @@
 #include "util/KStringUtility.h"
 namespace thirdparty {
     KRedisClient::KRedisClient()
-        :m_redisContext(NULL)
+        :m_redisContext(NULL), m_scanCount(RedisScanCount), m_maxKeysPerSecond(0), m_unlinkSupported(true),
+        m_trackingRedirect(-1), m_connectionSerial(0)
     {
 
     }
@@ -21,20 +22,46 @@ namespace thirdparty {
     {
         uint16_t count = times;
         KLockGuard<KMutex> lock(m_redisMutex);
+        bool reconnect = (m_redisContext == NULL);
         while (!m_redisContext && !(m_redisContext = Connect(m_currentConf))
             && (times == 0 || (times > 0 && count-- > 0)))
         {
             KTime::MSleep(1000);
         }
+
+        if (reconnect && m_redisContext)
+        {
+            ++m_connectionSerial;
+            Tracking();
+        }
         return m_redisContext != NULL;
     }
 
+    bool KRedisClient::EnableTracking(int64_t redirectId)
+    {
+        KLockGuard<KMutex> lock(m_redisMutex);
+        m_trackingRedirect = redirectId;
+        return m_redisContext == NULL || Tracking();
+    }
+
+    bool KRedisClient::Tracking()
+    {
+        if (m_trackingRedirect < 0 || !m_redisContext)
+            return false;
+        return Exec(m_redisContext, "client tracking on redirect " + KStringUtility::Int64ToString(m_trackingRedirect));
+    }
+
     bool KRedisClient::Auth()
     {
         std::string cmd("auth ");
         cmd.append(m_currentConf.pwd);
         KLockGuard<KMutex> lock(m_redisMutex);
-        return Exec(m_redisContext, cmd);
+        if (!Exec(m_redisContext, cmd))
+            return false;
+        // 未登录时开启会失败，登录后重新开启 //
+        if (m_trackingRedirect >= 0)
+            Tracking();
+        return true;
     }
 
     bool KRedisClient::Select(uint16_t index)
@@ -53,28 +80,163 @@ namespace thirdparty {
 
     bool KRedisClient::Remove(const std::string& pattern)
     {
+        RedisScanCursor cursor(m_scanCount);
         std::vector<std::string> kys;
-        int rc = Keys(pattern, kys);
-        if (rc == valnil || rc == valarray)
+        uint64_t start = 0;
+        KTime::NowMillisecond(start);
+        uint64_t removed = 0;
+        do
         {
-            std::vector<std::string>::iterator it = kys.begin();
-            while (it != kys.end())
+            if (!Scan(cursor, pattern, kys))
+                return false;
+
+            if (kys.size() >= RedisBatchSize || (cursor.finished && !kys.empty()))
             {
-                std::vector<std::string>::iterator last = it;
-                size_t step = std::distance(last, kys.end());
-                step = (step > RedisBatchSize ? RedisBatchSize : step);
-                std::advance(last, step);
-                if (Remove(std::vector<std::string>(it, last)) != valint64)
-                {
+                if (!Unlink(kys))
                     return false;
-                }
-                it = last;
+                removed += kys.size();
+                kys.clear();
+                Throttle(start, removed);
             }
+        } while (!cursor.finished);
+        return true;
+    }
+
+    void KRedisClient::SetScanOptions(uint32_t count, uint32_t maxKeysPerSecond)
+    {
+        m_scanCount = (count > 0 ? count : RedisScanCount);
+        m_maxKeysPerSecond = maxKeysPerSecond;
+    }
+
+    bool KRedisClient::Scan(RedisScanCursor& cursor, const std::string& pattern, std::vector<std::string>& kys)
+    {
+        if (cursor.finished)
             return true;
+
+        std::string count = KStringUtility::Uint32ToString(cursor.count);
+        RedisArgvCmd rmd;
+        rmd.Allocate(pattern.empty() ? 4 : 6);
+        rmd.AddArgv("scan", 4);
+        rmd.AddArgv(cursor.cursor);
+        if (!pattern.empty())
+        {
+            rmd.AddArgv("match", 5);
+            rmd.AddArgv(pattern);
+        }
+        rmd.AddArgv("count", 5);
+        rmd.AddArgv(count);
+
+        KLockGuard<KMutex> lock(m_redisMutex);
+        if (m_redisContext)
+        {
+            redisReply* reply = reinterpret_cast<redisReply*>(redisCommandArgv(m_redisContext, rmd.argc, (const char**)rmd.argv, rmd.argvlen));
+            rmd.Release();
+            if (!reply)
+            {
+                Close();
+                return false;
+            }
+
+            // [下一个游标, [key...]] //
+            bool rc = false;
+            if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 2
+                && reply->element[0]->type == REDIS_REPLY_STRING
+                && reply->element[1]->type == REDIS_REPLY_ARRAY)
+            {
+                cursor.cursor.assign(reply->element[0]->str, reply->element[0]->len);
+                cursor.finished = (cursor.cursor.compare("0") == 0);
+                const redisReply* elements = reply->element[1];
+                for (size_t i = 0; i < elements->elements; ++i)
+                    kys.push_back(std::string(elements->element[i]->str, elements->element[i]->len));
+                rc = true;
+            }
+            freeReplyObject(reply);
+            return rc;
         }
+        rmd.Release();
         return false;
     }
 
+    bool KRedisClient::ScanKeys(const std::string& pattern, std::vector<std::string>& kys)
+    {
+        RedisScanCursor cursor(m_scanCount);
+        while (!cursor.finished)
+        {
+            if (!Scan(cursor, pattern, kys))
+                return false;
+        }
+        return true;
+    }
+
+    bool KRedisClient::Unlink(const std::vector<std::string>& kys)
+    {
+        if (kys.empty())
+            return true;
+
+        // 每RedisUnlinkChunk个key一个命令，所有命令一次管道发送 //
+        std::vector<RedisArgvCmd> cmds;
+        std::vector<std::string>::const_iterator it = kys.begin();
+        while (it != kys.end())
+        {
+            size_t step = std::distance(it, kys.end());
+            step = (step > RedisUnlinkChunk ? RedisUnlinkChunk : step);
+            RedisArgvCmd rmd;
+            rmd.Allocate(int(step) + 1);
+            if (m_unlinkSupported)
+                rmd.AddArgv("unlink", 6);
+            else
+                rmd.AddArgv("del", 3);
+            for (size_t i = 0; i < step; ++i, ++it)
+                rmd.AddArgv(*it);
+            cmds.push_back(rmd);
+        }
+
+        std::vector<redisReply*> replies;
+        bool rc = PipelineCmd(cmds, replies);
+        bool unsupported = false;
+        std::vector<redisReply*>::iterator rit = replies.begin();
+        while (rit != replies.end())
+        {
+            redisReply* reply = *rit;
+            if (reply->type != REDIS_REPLY_INTEGER)
+            {
+                // redis 4.0 之前没有UNLINK //
+                if (reply->type == REDIS_REPLY_ERROR && m_unlinkSupported
+                    && std::string(reply->str, reply->len).find("unknown command") != std::string::npos)
+                    unsupported = true;
+                rc = false;
+            }
+            freeReplyObject(reply);
+            ++rit;
+        }
+
+        std::vector<RedisArgvCmd>::iterator cit = cmds.begin();
+        while (cit != cmds.end())
+        {
+            cit->Release();
+            ++cit;
+        }
+
+        if (unsupported)
+        {
+            m_unlinkSupported = false;
+            return Unlink(kys);
+        }
+        return rc;
+    }
+
+    void KRedisClient::Throttle(uint64_t start, uint64_t removed) const
+    {
+        if (m_maxKeysPerSecond == 0)
+            return;
+
+        uint64_t now = 0;
+        KTime::NowMillisecond(now);
+        uint64_t expected = removed * 1000 / m_maxKeysPerSecond;
+        if (now - start < expected)
+            KTime::MSleep(int(expected - (now - start)));
+    }
+
     bool KRedisClient::Sadd(const std::string& key, const std::set<std::string>& elements)
     {
         std::string cmd("sadd ");
@@ -141,7 +303,7 @@ namespace thirdparty {
                     while (rit != replies.end())
                     {
                         freeReplyObject(*rit);
-                        ++it;
+                        ++rit;
                     }
                     replies.clear();
                     Close();
@@ -183,7 +345,7 @@ namespace thirdparty {
                     while (rit != replies.end())
                     {
                         freeReplyObject(*rit);
-                        ++it;
+                        ++rit;
                     }
                     replies.clear();
                     Close();
@@ -293,21 +455,6 @@ namespace thirdparty {
         return false;
     }
 
-    int KRedisClient::Keys(const std::string& pattern, std::vector<std::string>& kys)
-    {
-        std::string cmd("keys ");
-        cmd.append(pattern);
-        KLockGuard<KMutex> lock(m_redisMutex);
-        if (m_redisContext)
-        {
-            redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(m_redisContext, cmd.c_str()));
-            int rc = GetResponse(reply, kys);
-            freeReplyObject(reply);
-            return rc;
-        }
-        return valunconnected;
-    }
-
     int KRedisClient::HgetAll(const std::string& key, std::vector<std::string>& fields, std::vector<std::string>& values)
     {
         std::string cmd("hgetall ");
@@ -393,45 +540,33 @@ namespace thirdparty {
 
     int KRedisClient::MgetInternal(const std::vector<std::string>& kys, std::vector<std::string>& vals)
     {
-        std::ostringstream os;
-        os << "mget";
+        std::string cmd;
+        KRespEncoder::BeginCommand(cmd, kys.size() + 1);
+        KRespEncoder::AppendArg(cmd, "mget", 4);
         std::vector<std::string>::const_iterator it = kys.begin();
         while (it != kys.end())
         {
-            os << " " << (it->empty() ? "###" : *it);
+            KRespEncoder::AppendArg(cmd, *it);
             ++it;
         }
         KLockGuard<KMutex> lock(m_redisMutex);
-        if (m_redisContext)
-        {
-            redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(m_redisContext, os.str().c_str()));
-            int rc = GetResponse(reply, vals);
-            freeReplyObject(reply);
-            return rc;
-        }
-        return valunconnected;
+        return RawCommand(cmd, vals);
     }
 
     int KRedisClient::HmgetInternal(const std::string& key, const std::vector<std::string>& kys, std::vector<std::string>& vals)
     {
-        std::ostringstream os;
-        os << "hmget " << key;
+        std::string cmd;
+        KRespEncoder::BeginCommand(cmd, kys.size() + 2);
+        KRespEncoder::AppendArg(cmd, "hmget", 5);
+        KRespEncoder::AppendArg(cmd, key);
         std::vector<std::string>::const_iterator it = kys.begin();
         while (it != kys.end())
         {
-            os << " " << (it->empty() ? "###" : *it);
+            KRespEncoder::AppendArg(cmd, *it);
             ++it;
         }
-        std::string cmd = os.str();
         KLockGuard<KMutex> lock(m_redisMutex);
-        if (m_redisContext)
-        {
-            redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(m_redisContext, cmd.c_str()));
-            int rc = GetResponse(reply, vals);
-            freeReplyObject(reply);
-            return rc;
-        }
-        return valunconnected;
+        return RawCommand(cmd, vals);
     }
 
     int KRedisClient::MsetInternal(std::map<std::string, std::string>::const_iterator first, std::map<std::string, std::string>::const_iterator last)
@@ -440,17 +575,11 @@ namespace thirdparty {
         RedisArgvCmd rmd;
         rmd.Allocate(argc);
         rmd.AddArgv("mset", 4);
-        std::string cmd("mset");
         std::map<std::string, std::string>::const_iterator it = first;
         while (it != last)
         {
             rmd.AddArgv(it->first);
             rmd.AddArgv(it->second);
-
-            cmd.push_back(' ');
-            cmd.append(it->first);
-            cmd.push_back(' ');
-            cmd.append(it->second);
             ++it;
         }
         KLockGuard<KMutex> lock(m_redisMutex);
@@ -474,21 +603,11 @@ namespace thirdparty {
         rmd.Allocate(argc);
         rmd.AddArgv("hmset", 5);
         rmd.AddArgv(key);
-
-        std::string cmd("hmset");
-        cmd.push_back(' ');
-        cmd.append(key);
-
         std::map<std::string, std::string>::const_iterator it = first;
         while (it != last)
         {
             rmd.AddArgv(it->first);
             rmd.AddArgv(it->second);
-
-            cmd.push_back(' ');
-            cmd.append(it->first);
-            cmd.push_back(' ');
-            cmd.append(it->second);
             ++it;
         }
         KLockGuard<KMutex> lock(m_redisMutex);
@@ -505,6 +624,76 @@ namespace thirdparty {
         return valunconnected;
     }
 
+    int KRedisClient::RawCommand(const std::string& cmd, std::vector<std::string>& vals)
+    {
+        if (!m_redisContext)
+            return valunconnected;
+        // 上一个命令的应答已读完，hiredis的读缓存为空，可以直接读写socket //
+        size_t sent = 0;
+        while (sent < cmd.size())
+        {
+            int rc = ::send(m_redisContext->fd, cmd.c_str() + sent, int(cmd.size() - sent), 0);
+            if (rc <= 0)
+            {
+                Close();
+                return valnullreply;
+            }
+            sent += rc;
+        }
+
+        KRespStringCollector collector(vals);
+        KRespDecoder decoder;
+        std::vector<char> buf(RedisReadBufferSize);
+        size_t len = 0;
+        bool done = false;
+        while (!done)
+        {
+            // 单个元素超过缓存时扩容 //
+            if (len == buf.size())
+                buf.resize(buf.size() * 2);
+            int n = ::recv(m_redisContext->fd, &buf[0] + len, int(buf.size() - len), 0);
+            if (n <= 0)
+            {
+                Close();
+                return valnullreply;
+            }
+            len += n;
+            int64_t used = decoder.Feed(&buf[0], len, collector);
+            if (used == KRespDecoder::RespError)
+            {
+                Close();
+                return valnullreply;
+            }
+            // 有数据被消费且不在聚合中，说明顶层应答已完整 //
+            done = (used > 0 && !decoder.InReply());
+            if (used > 0)
+            {
+                len -= size_t(used);
+                if (len > 0)
+                    memmove(&buf[0], &buf[0] + used, len);
+            }
+        }
+
+        switch (collector.GetType())
+        {
+        case '*':
+        case '~':
+            return valarray;
+        case '$':
+            return valstring;
+        case '+':
+            return valstatus;
+        case ':':
+            return valint64;
+        case '_':
+            return valnil;
+        case '-':
+            return valerror;
+        default:
+            return valunsupport;
+        }
+    }
+
     int KRedisClient::GetResponse(redisReply* reply, std::string& val)
     {
         if (!reply)
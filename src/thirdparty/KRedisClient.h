@@ -3,16 +3,19 @@
 #define _HIREDIS_HPP_
 
 #include "hiredis.h"
+#include "thirdparty/KRespCodec.h"
 #include "thread/KMutex.h"
 #include "thread/KLockGuard.h"
 #include "util/KStringUtility.h"
 #include "util/KTime.h"
 #include "thread/KPthread.h"
+#include "thread/KAtomic.h"
 #include <string>
 #if defined(WIN32)
 #include <WS2tcpip.h>
 #else
 #include <sys/time.h>
+#include <sys/socket.h>
 #endif
 #include <cstdio>
 #include <vector>
@@ -26,6 +29,12 @@ redis客户端类
 namespace thirdparty {
     using namespace klib;
 #define  RedisBatchSize 1000
+// SCAN每次建议返回的key个数 //
+#define  RedisScanCount 500
+// 单个UNLINK命令携带的key个数 //
+#define  RedisUnlinkChunk 200
+// 读缓存大小 //
+#define  RedisReadBufferSize 65536
     struct RedisConfig
     {
         std::string ip;
@@ -83,6 +92,25 @@ namespace thirdparty {
         int m_index;
     };
 
+    /**
+    SCAN游标
+    **/
+    struct RedisScanCursor
+    {
+        // 服务端返回的游标，"0"表示开始 //
+        std::string cursor;
+        // 每次建议返回的个数 //
+        uint32_t count;
+        // 是否遍历结束 //
+        bool finished;
+
+        RedisScanCursor(uint32_t c = RedisScanCount)
+            :cursor("0"), count(c), finished(false)
+        {
+
+        }
+    };
+
     class KRedisClient
     {
     public:
@@ -115,6 +143,19 @@ namespace thirdparty {
         *************************************/
         bool CheckConnection(uint16_t times = 0);
 
+        /************************************
+        * Method:    开启客户端缓存失效通知(CLIENT TRACKING)，重连和登录后自动重新开启
+        * Returns:   未连接时返回true，连接后开启
+        * Parameter: redirectId 订阅__redis__:invalidate的连接的CLIENT ID
+        *************************************/
+        bool EnableTracking(int64_t redirectId);
+
+        /************************************
+        * Method:    连接序号，每次建立新连接加1，变化说明期间可能丢失失效通知
+        * Returns:   
+        *************************************/
+        inline uint32_t GetConnectionSerial() const { return m_connectionSerial; }
+
         /************************************
         * Method:    登录
         * Returns:   
@@ -135,12 +176,44 @@ namespace thirdparty {
         bool Flushdb();
 
         /************************************
-        * Method:    批量删除
+        * Method:    按模式批量删除，SCAN增量遍历并用UNLINK管道删除，不阻塞服务端
         * Returns:   
         * Parameter: pattern
         *************************************/
         bool Remove(const std::string& pattern);
 
+        /************************************
+        * Method:    设置SCAN参数
+        * Returns:   
+        * Parameter: count 每次SCAN的COUNT
+        * Parameter: maxKeysPerSecond 模式删除每秒最多删除的key个数，0不限制
+        *************************************/
+        void SetScanOptions(uint32_t count, uint32_t maxKeysPerSecond = 0);
+
+        /************************************
+        * Method:    增量遍历一次，追加匹配的key
+        * Returns:   成功返回true，cursor.finished为true时遍历结束
+        * Parameter: cursor 游标
+        * Parameter: pattern
+        * Parameter: kys
+        *************************************/
+        bool Scan(RedisScanCursor& cursor, const std::string& pattern, std::vector<std::string>& kys);
+
+        /************************************
+        * Method:    用SCAN获取所有匹配的key
+        * Returns:   
+        * Parameter: pattern
+        * Parameter: kys
+        *************************************/
+        bool ScanKeys(const std::string& pattern, std::vector<std::string>& kys);
+
+        /************************************
+        * Method:    管道批量UNLINK，服务端不支持时使用DEL
+        * Returns:   
+        * Parameter: kys
+        *************************************/
+        bool Unlink(const std::vector<std::string>& kys);
+
         /************************************
         * Method:    批量删除
         * Returns:   
@@ -219,13 +292,16 @@ namespace thirdparty {
 
 
     private:
-        int Keys(const std::string& pattern, std::vector<std::string>& kys);
+        void Throttle(uint64_t start, uint64_t removed) const;
+
         redisContext* Connect(RedisConfig& conf);
 
         void Close();
 
         bool Exec(redisContext* ctx, const std::string& cmd);
 
+        bool Tracking();
+
         int MgetInternal(const std::vector<std::string>& kys, std::vector<std::string>& vals);
 
         int HmgetInternal(const std::string& key, const std::vector<std::string>& kys, std::vector<std::string>& vals);
@@ -236,6 +312,14 @@ namespace thirdparty {
 
         int HmsetInternal(const std::string& key, std::map<std::string, std::string>::const_iterator first, std::map<std::string, std::string>::const_iterator last);
 
+        /************************************
+        * Method:    直接在socket上发送已编码的命令并解析应答，不经过hiredis分配reply
+        * Returns:   ValState
+        * Parameter: cmd RESP编码的命令
+        * Parameter: vals 应答中的字符串，数组展开
+        *************************************/
+        int RawCommand(const std::string& cmd, std::vector<std::string>& vals);
+
         int GetResponse(redisReply* reply, std::string& val);
 
         int GetResponse(redisReply* reply, std::vector<std::string>& vals);
@@ -245,6 +329,12 @@ namespace thirdparty {
         std::vector<RedisConfig> m_confs;
         RedisConfig m_currentConf;
         KMutex m_redisMutex;
+        uint32_t m_scanCount;
+        uint32_t m_maxKeysPerSecond;
+        volatile bool m_unlinkSupported;
+        // 失效通知重定向的连接，小于0不开启 //
+        int64_t m_trackingRedirect;
+        AtomicInteger<uint32_t> m_connectionSerial;
     };
 };
 #endif
@@ -0,0 +1,713 @@
+#include "thirdparty/KRedisCluster.h"
+
+namespace thirdparty {
+    KRedisNode::KRedisNode(const RedisConfig& conf, uint16_t poolSize)
+        :KEventObject<RedisNodeTask*>("Redis node thread", 1000),
+        m_conf(conf), m_poolSize(poolSize > 0 ? poolSize : 1), m_created(0)
+    {
+
+    }
+
+    KRedisNode::~KRedisNode()
+    {
+        Stop();
+        WaitForStop();
+        Close();
+    }
+
+    redisContext* KRedisNode::Acquire(int ms)
+    {
+        {
+            KLockGuard<KMutex> lock(m_poolMtx);
+            while (m_idle.empty() && m_created >= m_poolSize)
+            {
+                if (!m_poolCond.TimedWait(lock, ms))
+                    return NULL;
+            }
+
+            if (!m_idle.empty())
+            {
+                redisContext* ctx = m_idle.back();
+                m_idle.pop_back();
+                return ctx;
+            }
+            ++m_created;
+        }
+
+        // 在锁外建立新连接 //
+        redisContext* ctx = Connect();
+        if (ctx == NULL)
+        {
+            {
+                KLockGuard<KMutex> lock(m_poolMtx);
+                --m_created;
+            }
+            m_poolCond.Notify();
+        }
+        return ctx;
+    }
+
+    void KRedisNode::Release(redisContext* ctx, bool broken)
+    {
+        if (ctx == NULL)
+            return;
+
+        {
+            KLockGuard<KMutex> lock(m_poolMtx);
+            if (broken)
+            {
+                redisFree(ctx);
+                --m_created;
+            }
+            else
+                m_idle.push_back(ctx);
+        }
+        m_poolCond.Notify();
+    }
+
+    redisReply* KRedisNode::Command(const RedisArgv& argv, bool asking)
+    {
+        redisContext* ctx = Acquire();
+        if (ctx == NULL)
+            return NULL;
+
+        redisReply* reply = NULL;
+        if (asking)
+        {
+            // 重定向到迁移中的slot需要先发送ASKING //
+            redisReply* ask = NULL;
+            if (redisAppendCommand(ctx, "ASKING") == REDIS_OK
+                && AppendArgv(ctx, argv) == REDIS_OK
+                && redisGetReply(ctx, (void**)&ask) == REDIS_OK)
+            {
+                freeReplyObject(ask);
+                if (redisGetReply(ctx, (void**)&reply) != REDIS_OK)
+                    reply = NULL;
+            }
+        }
+        else
+        {
+            std::vector<const char*> args(argv.size());
+            std::vector<size_t> lens(argv.size());
+            for (size_t i = 0; i < argv.size(); ++i)
+            {
+                args[i] = argv[i].c_str();
+                lens[i] = argv[i].size();
+            }
+            reply = reinterpret_cast<redisReply*>(redisCommandArgv(ctx, int(argv.size()), &args[0], &lens[0]));
+        }
+        Release(ctx, reply == NULL);
+        return reply;
+    }
+
+    bool KRedisNode::Pipeline(const std::vector<RedisArgv>& cmds, std::vector<redisReply*>& replies)
+    {
+        redisContext* ctx = Acquire();
+        if (ctx == NULL)
+            return false;
+
+        std::vector<RedisArgv>::const_iterator it = cmds.begin();
+        while (it != cmds.end())
+        {
+            if (AppendArgv(ctx, *it) != REDIS_OK)
+            {
+                Release(ctx, true);
+                return false;
+            }
+            ++it;
+        }
+
+        for (size_t i = 0; i < cmds.size(); ++i)
+        {
+            redisReply* reply = NULL;
+            if (redisGetReply(ctx, (void**)&reply) != REDIS_OK)
+            {
+                std::vector<redisReply*>::iterator rit = replies.begin();
+                while (rit != replies.end())
+                {
+                    freeReplyObject(*rit);
+                    ++rit;
+                }
+                replies.clear();
+                Release(ctx, true);
+                return false;
+            }
+            replies.push_back(reply);
+        }
+        Release(ctx, false);
+        return true;
+    }
+
+    void KRedisNode::Close()
+    {
+        KLockGuard<KMutex> lock(m_poolMtx);
+        std::vector<redisContext*>::iterator it = m_idle.begin();
+        while (it != m_idle.end())
+        {
+            redisFree(*it);
+            --m_created;
+            ++it;
+        }
+        m_idle.clear();
+    }
+
+    bool KRedisNode::Post(RedisNodeTask* const& task)
+    {
+        KLockGuard<KMutex> lock(m_taskMtx);
+        return KEventObject<RedisNodeTask*>::Post(task);
+    }
+
+    void KRedisNode::Stop()
+    {
+        KLockGuard<KMutex> lock(m_taskMtx);
+        KEventObject<RedisNodeTask*>::Stop();
+
+        // 等待中的调用者需要全部任务完成 //
+        std::vector<RedisNodeTask*> tasks;
+        Flush(tasks);
+        std::vector<RedisNodeTask*>::iterator it = tasks.begin();
+        while (it != tasks.end())
+        {
+            (*it)->success = false;
+            (*it)->latch->CountDown();
+            ++it;
+        }
+    }
+
+    void KRedisNode::ProcessEvent(RedisNodeTask* const& task)
+    {
+        task->success = Pipeline(task->cmds, task->replies);
+        task->latch->CountDown();
+    }
+
+    redisContext* KRedisNode::Connect()
+    {
+        timeval tv = { 3, 0 };
+        redisContext* ctx = redisConnectWithTimeout(m_conf.ip.c_str(), m_conf.port, tv);
+        if (ctx == NULL || ctx->err)
+        {
+            printf("KRedisNode connect [%s:%d] failed\n", m_conf.ip.c_str(), m_conf.port);
+            if (ctx)
+                redisFree(ctx);
+            return NULL;
+        }
+
+        if (!m_conf.pwd.empty())
+        {
+            redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(ctx, "auth %s", m_conf.pwd.c_str()));
+            bool ok = (reply && reply->type == REDIS_REPLY_STATUS);
+            if (reply)
+                freeReplyObject(reply);
+            if (!ok)
+            {
+                redisFree(ctx);
+                return NULL;
+            }
+        }
+        return ctx;
+    }
+
+    int KRedisNode::AppendArgv(redisContext* ctx, const RedisArgv& argv)
+    {
+        std::vector<const char*> args(argv.size());
+        std::vector<size_t> lens(argv.size());
+        for (size_t i = 0; i < argv.size(); ++i)
+        {
+            args[i] = argv[i].c_str();
+            lens[i] = argv[i].size();
+        }
+        return redisAppendCommandArgv(ctx, int(argv.size()), &args[0], &lens[0]);
+    }
+
+    KRedisCluster::KRedisCluster()
+        :m_poolSize(4), m_cluster(false), m_slots(RedisClusterSlots, (KRedisNode*)NULL)
+    {
+
+    }
+
+    KRedisCluster::~KRedisCluster()
+    {
+        Close();
+    }
+
+    bool KRedisCluster::Initialize(const std::vector<RedisConfig>& seeds, uint16_t poolSize)
+    {
+        m_seeds = seeds;
+        m_poolSize = poolSize;
+        return RefreshSlots();
+    }
+
+    void KRedisCluster::Close()
+    {
+        {
+            KLockGuard<KMutex> lock(m_slotMtx);
+            std::fill(m_slots.begin(), m_slots.end(), (KRedisNode*)NULL);
+        }
+
+        KLockGuard<KMutex> lock(m_nodeMtx);
+        std::map<std::string, KRedisNode*>::iterator it = m_nodes.begin();
+        while (it != m_nodes.end())
+        {
+            delete it->second;
+            ++it;
+        }
+        m_nodes.clear();
+    }
+
+    bool KRedisCluster::RefreshSlots()
+    {
+        std::vector<RedisConfig>::const_iterator it = m_seeds.begin();
+        while (it != m_seeds.end())
+        {
+            KRedisNode* node = GetNode(it->ip, it->port);
+            if (node && LoadSlots(node))
+                return true;
+            ++it;
+        }
+        printf("KRedisCluster load slots failed\n");
+        return false;
+    }
+
+    redisReply* KRedisCluster::Command(const RedisArgv& argv)
+    {
+        if (argv.empty())
+            return NULL;
+
+        KRedisNode* node = Route(argv.size() > 1 ? argv[1] : argv[0]);
+        bool ask = false;
+        bool refreshed = false;
+        for (int i = 0; i < RedisMaxRedirects && node != NULL; ++i)
+        {
+            redisReply* reply = node->Command(argv, ask);
+            if (reply == NULL)
+            {
+                // 节点不可用，可能发生了故障转移，重新加载一次 //
+                if (!m_cluster || refreshed || !RefreshSlots())
+                    return NULL;
+                refreshed = true;
+                node = Route(argv.size() > 1 ? argv[1] : argv[0]);
+                ask = false;
+                continue;
+            }
+
+            uint16_t slot = 0;
+            std::string ip;
+            int port = 0;
+            if (!ParseRedirect(reply, ask, slot, ip, port))
+                return reply;
+
+            freeReplyObject(reply);
+            node = GetNode(ip, port);
+            if (!ask)
+                UpdateSlot(slot, node);
+        }
+        return NULL;
+    }
+
+    int KRedisCluster::Exec(const RedisArgv& argv, std::string& val)
+    {
+        redisReply* reply = Command(argv);
+        if (reply == NULL)
+            return KRedisClient::valnullreply;
+
+        int rc = KRedisClient::valunsupport;
+        switch (reply->type)
+        {
+        case REDIS_REPLY_STRING:
+            val.assign(reply->str, reply->len);
+            rc = KRedisClient::valstring;
+            break;
+        case REDIS_REPLY_STATUS:
+            val.assign(reply->str, reply->len);
+            rc = KRedisClient::valstatus;
+            break;
+        case REDIS_REPLY_ERROR:
+            val.assign(reply->str, reply->len);
+            rc = KRedisClient::valerror;
+            break;
+        case REDIS_REPLY_INTEGER:
+            val.assign(KStringUtility::Int64ToString(reply->integer));
+            rc = KRedisClient::valint64;
+            break;
+        case REDIS_REPLY_NIL:
+            rc = KRedisClient::valnil;
+            break;
+        case REDIS_REPLY_ARRAY:
+            rc = KRedisClient::valarray;
+            break;
+        default:
+            break;
+        }
+        freeReplyObject(reply);
+        return rc;
+    }
+
+    bool KRedisCluster::Mget(const std::vector<std::string>& kys, std::vector<std::string>& vals)
+    {
+        std::map<KRedisNode*, RedisNodeTask*> tasks;
+        for (size_t i = 0; i < kys.size(); ++i)
+        {
+            KRedisNode* node = Route(kys[i]);
+            if (node == NULL)
+            {
+                ReleaseTasks(tasks);
+                return false;
+            }
+
+            RedisNodeTask*& task = tasks[node];
+            if (task == NULL)
+                task = new RedisNodeTask;
+            RedisArgv argv(2);
+            argv[0] = "get";
+            argv[1] = kys[i];
+            task->cmds.push_back(argv);
+            task->indexes.push_back(i);
+        }
+
+        std::vector<std::string> result(kys.size());
+        bool rc = RunTasks(tasks);
+        std::map<KRedisNode*, RedisNodeTask*>::iterator it = tasks.begin();
+        while (rc && it != tasks.end())
+        {
+            RedisNodeTask* task = it->second;
+            for (size_t i = 0; rc && i < task->replies.size(); ++i)
+            {
+                redisReply* reply = task->replies[i];
+                bool ask = false;
+                uint16_t slot = 0;
+                std::string ip;
+                int port = 0;
+                if (ParseRedirect(reply, ask, slot, ip, port))
+                {
+                    // 迁移中的key逐个重试 //
+                    if (!ask)
+                        UpdateSlot(slot, GetNode(ip, port));
+                    int vs = Exec(task->cmds[i], result[task->indexes[i]]);
+                    rc = (vs == KRedisClient::valstring || vs == KRedisClient::valnil);
+                }
+                else if (reply->type == REDIS_REPLY_STRING)
+                    result[task->indexes[i]].assign(reply->str, reply->len);
+                else
+                    rc = (reply->type == REDIS_REPLY_NIL);
+            }
+            ++it;
+        }
+        ReleaseTasks(tasks);
+
+        if (rc)
+            vals.insert(vals.end(), result.begin(), result.end());
+        return rc;
+    }
+
+    bool KRedisCluster::Mset(const std::map<std::string, std::string>& keyvals)
+    {
+        std::map<KRedisNode*, RedisNodeTask*> tasks;
+        std::map<std::string, std::string>::const_iterator kit = keyvals.begin();
+        for (size_t i = 0; kit != keyvals.end(); ++kit, ++i)
+        {
+            KRedisNode* node = Route(kit->first);
+            if (node == NULL)
+            {
+                ReleaseTasks(tasks);
+                return false;
+            }
+
+            RedisNodeTask*& task = tasks[node];
+            if (task == NULL)
+                task = new RedisNodeTask;
+            RedisArgv argv(3);
+            argv[0] = "set";
+            argv[1] = kit->first;
+            argv[2] = kit->second;
+            task->cmds.push_back(argv);
+            task->indexes.push_back(i);
+        }
+
+        bool rc = RunTasks(tasks);
+        std::map<KRedisNode*, RedisNodeTask*>::iterator it = tasks.begin();
+        while (rc && it != tasks.end())
+        {
+            RedisNodeTask* task = it->second;
+            for (size_t i = 0; rc && i < task->replies.size(); ++i)
+            {
+                redisReply* reply = task->replies[i];
+                bool ask = false;
+                uint16_t slot = 0;
+                std::string ip;
+                int port = 0;
+                if (ParseRedirect(reply, ask, slot, ip, port))
+                {
+                    if (!ask)
+                        UpdateSlot(slot, GetNode(ip, port));
+                    std::string val;
+                    rc = (Exec(task->cmds[i], val) == KRedisClient::valstatus);
+                }
+                else
+                    rc = (reply->type == REDIS_REPLY_STATUS);
+            }
+            ++it;
+        }
+        ReleaseTasks(tasks);
+        return rc;
+    }
+
+    uint16_t KRedisCluster::KeySlot(const std::string& key)
+    {
+        // 只对第一个非空{}中的内容计算 //
+        size_t s = key.find('{');
+        if (s != std::string::npos)
+        {
+            size_t e = key.find('}', s + 1);
+            if (e != std::string::npos && e != s + 1)
+                return Crc16(key.c_str() + s + 1, e - s - 1) & (RedisClusterSlots - 1);
+        }
+        return Crc16(key.c_str(), key.size()) & (RedisClusterSlots - 1);
+    }
+
+    uint16_t KRedisCluster::Crc16(const char* buf, size_t len)
+    {
+        // CRC16-CCITT(XMODEM)，多项式0x1021 //
+        uint16_t crc = 0;
+        for (size_t i = 0; i < len; ++i)
+        {
+            crc ^= uint16_t(uint8_t(buf[i])) << 8;
+            for (int j = 0; j < 8; ++j)
+                crc = (crc & 0x8000) ? uint16_t((crc << 1) ^ 0x1021) : uint16_t(crc << 1);
+        }
+        return crc;
+    }
+
+    KRedisNode* KRedisCluster::GetNode(const std::string& ip, int port)
+    {
+        std::ostringstream os;
+        os << ip << ":" << port;
+        KLockGuard<KMutex> lock(m_nodeMtx);
+        std::map<std::string, KRedisNode*>::iterator it = m_nodes.find(os.str());
+        if (it != m_nodes.end())
+            return it->second;
+
+        RedisConfig conf;
+        conf.ip = ip;
+        conf.port = port;
+        if (!m_seeds.empty())
+            conf.pwd = m_seeds.front().pwd;
+        KRedisNode* node = new KRedisNode(conf, m_poolSize);
+        if (!node->Start())
+        {
+            delete node;
+            return NULL;
+        }
+        m_nodes[os.str()] = node;
+        return node;
+    }
+
+    KRedisNode* KRedisCluster::Route(const std::string& key)
+    {
+        KLockGuard<KMutex> lock(m_slotMtx);
+        return m_slots[KeySlot(key)];
+    }
+
+    void KRedisCluster::UpdateSlot(uint16_t slot, KRedisNode* node)
+    {
+        if (node == NULL || slot >= RedisClusterSlots)
+            return;
+        KLockGuard<KMutex> lock(m_slotMtx);
+        m_slots[slot] = node;
+    }
+
+    bool KRedisCluster::LoadSlots(KRedisNode* node)
+    {
+        RedisArgv argv(2);
+        argv[0] = "cluster";
+        argv[1] = "slots";
+        redisReply* reply = node->Command(argv);
+        if (reply == NULL)
+            return false;
+
+        if (reply->type == REDIS_REPLY_ERROR)
+        {
+            // 未开启集群，作为单机连接池，但只接受master //
+            freeReplyObject(reply);
+            argv[0] = "info";
+            argv[1] = "replication";
+            reply = node->Command(argv);
+            bool master = (reply && reply->type == REDIS_REPLY_STRING
+                && std::string(reply->str, reply->len).find("role:master") != std::string::npos);
+            if (reply)
+                freeReplyObject(reply);
+            if (!master)
+                return false;
+
+            KLockGuard<KMutex> lock(m_slotMtx);
+            std::fill(m_slots.begin(), m_slots.end(), node);
+            m_cluster = false;
+            return true;
+        }
+
+        bool rc = false;
+        if (reply->type == REDIS_REPLY_ARRAY)
+        {
+            std::vector<KRedisNode*> slots(RedisClusterSlots, (KRedisNode*)NULL);
+            for (size_t i = 0; i < reply->elements; ++i)
+            {
+                // [start, end, [ip, port, id], 从节点...] //
+                const redisReply* range = reply->element[i];
+                if (range->type != REDIS_REPLY_ARRAY || range->elements < 3
+                    || range->element[2]->type != REDIS_REPLY_ARRAY || range->element[2]->elements < 2)
+                    continue;
+
+                const redisReply* master = range->element[2];
+                std::string ip(master->element[0]->str, master->element[0]->len);
+                if (ip.empty())
+                    ip = node->GetConfig().ip;
+                KRedisNode* n = GetNode(ip, int(master->element[1]->integer));
+                long long last = range->element[1]->integer;
+                for (long long s = range->element[0]->integer; n && s <= last && s < RedisClusterSlots; ++s)
+                    slots[size_t(s)] = n;
+                rc = true;
+            }
+
+            if (rc)
+            {
+                KLockGuard<KMutex> lock(m_slotMtx);
+                m_slots.swap(slots);
+                m_cluster = true;
+            }
+        }
+        freeReplyObject(reply);
+        return rc;
+    }
+
+    bool KRedisCluster::ParseRedirect(const redisReply* reply, bool& ask, uint16_t& slot, std::string& ip, int& port) const
+    {
+        // MOVED 3999 127.0.0.1:6381 或 ASK 3999 127.0.0.1:6381 //
+        if (reply == NULL || reply->type != REDIS_REPLY_ERROR)
+            return false;
+
+        std::string err(reply->str, reply->len);
+        if (err.compare(0, 6, "MOVED ") == 0)
+            ask = false;
+        else if (err.compare(0, 4, "ASK ") == 0)
+            ask = true;
+        else
+            return false;
+
+        std::vector<std::string> parts;
+        KStringUtility::SplitString(err, " ", parts);
+        if (parts.size() != 3)
+            return false;
+
+        size_t pos = parts[2].rfind(':');
+        if (pos == std::string::npos)
+            return false;
+
+        slot = uint16_t(atoi(parts[1].c_str()));
+        ip = parts[2].substr(0, pos);
+        port = atoi(parts[2].c_str() + pos + 1);
+        return true;
+    }
+
+    bool KRedisCluster::RunTasks(std::map<KRedisNode*, RedisNodeTask*>& tasks)
+    {
+        if (DispatchTasks(tasks))
+            return true;
+
+        // 节点不可用，可能发生了故障转移，重新加载一次后把失败节点的key重新路由 //
+        if (!m_cluster || !RefreshSlots())
+            return false;
+
+        std::map<KRedisNode*, RedisNodeTask*> retry;
+        std::map<KRedisNode*, RedisNodeTask*>::iterator it = tasks.begin();
+        while (it != tasks.end())
+        {
+            RedisNodeTask* task = it->second;
+            if (task->success)
+            {
+                ++it;
+                continue;
+            }
+
+            for (size_t i = 0; i < task->cmds.size(); ++i)
+            {
+                KRedisNode* node = Route(task->cmds[i][1]);
+                if (node == NULL)
+                {
+                    ReleaseTasks(retry);
+                    return false;
+                }
+
+                RedisNodeTask*& rt = retry[node];
+                if (rt == NULL)
+                    rt = new RedisNodeTask;
+                rt->cmds.push_back(task->cmds[i]);
+                rt->indexes.push_back(task->indexes[i]);
+            }
+            task->Release();
+            delete task;
+            tasks.erase(it++);
+        }
+
+        bool rc = DispatchTasks(retry);
+        // 合并回原任务，同一节点已有成功的任务时追加到其后 //
+        it = retry.begin();
+        while (it != retry.end())
+        {
+            RedisNodeTask*& task = tasks[it->first];
+            if (task == NULL)
+                task = it->second;
+            else
+            {
+                task->cmds.insert(task->cmds.end(), it->second->cmds.begin(), it->second->cmds.end());
+                task->indexes.insert(task->indexes.end(), it->second->indexes.begin(), it->second->indexes.end());
+                task->replies.insert(task->replies.end(), it->second->replies.begin(), it->second->replies.end());
+                delete it->second;
+            }
+            ++it;
+        }
+        return rc;
+    }
+
+    bool KRedisCluster::DispatchTasks(std::map<KRedisNode*, RedisNodeTask*>& tasks)
+    {
+        if (tasks.empty())
+            return true;
+
+        KRedisLatch latch(int(tasks.size()));
+        std::map<KRedisNode*, RedisNodeTask*>::iterator it = tasks.begin();
+        while (it != tasks.end())
+        {
+            RedisNodeTask* task = it->second;
+            task->latch = &latch;
+            // 最后一个节点在当前线程执行，节点队列满时也在当前线程执行 //
+            std::map<KRedisNode*, RedisNodeTask*>::iterator next = it;
+            if (++next == tasks.end() || !it->first->Post(task))
+            {
+                task->success = it->first->Pipeline(task->cmds, task->replies);
+                latch.CountDown();
+            }
+            ++it;
+        }
+        latch.Wait();
+
+        it = tasks.begin();
+        while (it != tasks.end())
+        {
+            if (!it->second->success)
+                return false;
+            ++it;
+        }
+        return true;
+    }
+
+    void KRedisCluster::ReleaseTasks(std::map<KRedisNode*, RedisNodeTask*>& tasks)
+    {
+        std::map<KRedisNode*, RedisNodeTask*>::iterator it = tasks.begin();
+        while (it != tasks.end())
+        {
+            it->second->Release();
+            delete it->second;
+            ++it;
+        }
+        tasks.clear();
+    }
+};
@@ -0,0 +1,266 @@
+#pragma once
+#ifndef _HIREDIS_CLUSTER_HPP_
+#define _HIREDIS_CLUSTER_HPP_
+
+#include "thirdparty/KRedisClient.h"
+#include "thread/KEventObject.h"
+#include "thread/KCondVariable.h"
+/**
+redis连接池和集群客户端类
+按CRC16计算key的slot路由到节点，处理MOVED/ASK重定向，批量操作按节点拆分并行执行
+单机模式下所有slot都指向master，仅作为连接池使用
+**/
+namespace thirdparty {
+    using namespace klib;
+#define RedisClusterSlots 16384
+// 最大重定向次数 //
+#define RedisMaxRedirects 5
+
+    typedef std::vector<std::string> RedisArgv;
+
+    /**
+    计数等待
+    **/
+    class KRedisLatch
+    {
+    public:
+        KRedisLatch(int count)
+            :m_count(count)
+        {
+
+        }
+
+        void CountDown()
+        {
+            // 在锁内通知，Wait返回后latch可能立即销毁 //
+            KLockGuard<KMutex> lock(m_mtx);
+            if (--m_count <= 0)
+                m_cond.NotifyAll();
+        }
+
+        void Wait()
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            while (m_count > 0)
+                m_cond.Wait(lock);
+        }
+
+    private:
+        KMutex m_mtx;
+        KCondVariable m_cond;
+        int m_count;
+    };
+
+    /**
+    节点批量任务
+    **/
+    struct RedisNodeTask
+    {
+        // 命令 //
+        std::vector<RedisArgv> cmds;
+        // 命令对应的原始位置 //
+        std::vector<size_t> indexes;
+        // 应答，调用者释放 //
+        std::vector<redisReply*> replies;
+        bool success;
+        KRedisLatch* latch;
+
+        RedisNodeTask()
+            :success(false), latch(NULL)
+        {
+
+        }
+
+        void Release()
+        {
+            std::vector<redisReply*>::iterator it = replies.begin();
+            while (it != replies.end())
+            {
+                if (*it)
+                    freeReplyObject(*it);
+                ++it;
+            }
+            replies.clear();
+        }
+    };
+
+    /**
+    单个节点，包含连接池和执行批量任务的线程
+    **/
+    class KRedisNode :public KEventObject<RedisNodeTask*>
+    {
+    public:
+        KRedisNode(const RedisConfig& conf, uint16_t poolSize);
+
+        ~KRedisNode();
+
+        /************************************
+        * Method:    从连接池获取连接，池满时等待
+        * Returns:   失败返回NULL
+        * Parameter: ms 等待毫秒数
+        *************************************/
+        redisContext* Acquire(int ms = 3000);
+
+        /************************************
+        * Method:    归还连接
+        * Returns:
+        * Parameter: ctx
+        * Parameter: broken 连接出错时直接释放
+        *************************************/
+        void Release(redisContext* ctx, bool broken);
+
+        /************************************
+        * Method:    执行单个命令
+        * Returns:   应答，调用者释放
+        * Parameter: argv
+        * Parameter: asking 是否先发送ASKING
+        *************************************/
+        redisReply* Command(const RedisArgv& argv, bool asking = false);
+
+        /************************************
+        * Method:    管道执行
+        * Returns:   成功返回true
+        * Parameter: cmds
+        * Parameter: replies 调用者释放
+        *************************************/
+        bool Pipeline(const std::vector<RedisArgv>& cmds, std::vector<redisReply*>& replies);
+
+        /************************************
+        * Method:    关闭所有空闲连接
+        * Returns:
+        *************************************/
+        void Close();
+
+        /************************************
+        * Method:    任务入队，停止后返回false
+        * Returns:
+        * Parameter: task
+        *************************************/
+        virtual bool Post(RedisNodeTask* const& task);
+
+        /************************************
+        * Method:    停止，队列中未执行的任务以失败完成
+        * Returns:
+        *************************************/
+        virtual void Stop();
+
+        inline const RedisConfig& GetConfig() const { return m_conf; }
+
+    protected:
+        virtual void ProcessEvent(RedisNodeTask* const& task);
+
+    private:
+        redisContext* Connect();
+
+        static int AppendArgv(redisContext* ctx, const RedisArgv& argv);
+
+    private:
+        RedisConfig m_conf;
+        uint16_t m_poolSize;
+        uint16_t m_created;
+        std::vector<redisContext*> m_idle;
+        KMutex m_poolMtx;
+        KCondVariable m_poolCond;
+        // 保证停止后不再有任务入队 //
+        KMutex m_taskMtx;
+    };
+
+    class KRedisCluster
+    {
+    public:
+        KRedisCluster();
+
+        virtual ~KRedisCluster();
+
+        /************************************
+        * Method:    初始化并加载slot分布
+        * Returns:
+        * Parameter: seeds 种子节点
+        * Parameter: poolSize 每个节点的连接数
+        *************************************/
+        bool Initialize(const std::vector<RedisConfig>& seeds, uint16_t poolSize = 4);
+
+        /************************************
+        * Method:    关闭所有节点
+        * Returns:
+        *************************************/
+        void Close();
+
+        /************************************
+        * Method:    重新加载slot分布
+        * Returns:
+        *************************************/
+        bool RefreshSlots();
+
+        /************************************
+        * Method:    执行命令，按argv[1]路由并处理重定向
+        * Returns:   应答，调用者释放
+        * Parameter: argv
+        *************************************/
+        redisReply* Command(const RedisArgv& argv);
+
+        /************************************
+        * Method:    执行命令
+        * Returns:   KRedisClient::ValState
+        * Parameter: argv
+        * Parameter: val
+        *************************************/
+        int Exec(const RedisArgv& argv, std::string& val);
+
+        /************************************
+        * Method:    批量获取，按节点拆分并行执行
+        * Returns:
+        * Parameter: kys
+        * Parameter: vals 与kys一一对应，不存在为空
+        *************************************/
+        bool Mget(const std::vector<std::string>& kys, std::vector<std::string>& vals);
+
+        /************************************
+        * Method:    批量写入，按节点拆分并行执行
+        * Returns:
+        * Parameter: keyvals
+        *************************************/
+        bool Mset(const std::map<std::string, std::string>& keyvals);
+
+        /************************************
+        * Method:    计算key的slot，支持{tag}
+        * Returns:
+        * Parameter: key
+        *************************************/
+        static uint16_t KeySlot(const std::string& key);
+
+        static uint16_t Crc16(const char* buf, size_t len);
+
+        inline bool IsCluster() const { return m_cluster; }
+
+    private:
+        KRedisNode* GetNode(const std::string& ip, int port);
+
+        KRedisNode* Route(const std::string& key);
+
+        void UpdateSlot(uint16_t slot, KRedisNode* node);
+
+        bool LoadSlots(KRedisNode* node);
+
+        bool ParseRedirect(const redisReply* reply, bool& ask, uint16_t& slot, std::string& ip, int& port) const;
+
+        // 执行各节点的任务，节点失败时重新加载slot并把它的key重新路由执行一次 //
+        bool RunTasks(std::map<KRedisNode*, RedisNodeTask*>& tasks);
+
+        bool DispatchTasks(std::map<KRedisNode*, RedisNodeTask*>& tasks);
+
+        static void ReleaseTasks(std::map<KRedisNode*, RedisNodeTask*>& tasks);
+
+    private:
+        std::vector<RedisConfig> m_seeds;
+        uint16_t m_poolSize;
+        volatile bool m_cluster;
+        // ip:port -> 节点 //
+        std::map<std::string, KRedisNode*> m_nodes;
+        KMutex m_nodeMtx;
+        // slot -> 节点 //
+        std::vector<KRedisNode*> m_slots;
+        KMutex m_slotMtx;
+    };
+};
+#endif
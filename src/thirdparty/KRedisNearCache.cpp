@@ -0,0 +1,365 @@
+#include "thirdparty/KRedisNearCache.h"
+
+namespace thirdparty {
+    KRedisInvalidator::KRedisInvalidator(KRedisNearCache& cache)
+        :KRedisSubscriber(true), m_cache(cache)
+    {
+
+    }
+
+    void KRedisInvalidator::ProcessEvent(const RedisMessage& ev)
+    {
+        if (ev.channel != RedisInvalidateChannel)
+            return;
+
+        // 消息体为null表示FLUSHDB/FLUSHALL或服务端跟踪表已满 //
+        if (ev.items.empty())
+        {
+            m_cache.Clear();
+            return;
+        }
+
+        std::vector<std::string>::const_iterator it = ev.items.begin();
+        while (it != ev.items.end())
+        {
+            m_cache.Invalidate(*it);
+            ++it;
+        }
+        m_cache.m_invalidations += ev.items.size();
+    }
+
+    bool KRedisInvalidator::OnConnected(redisContext* ctx)
+    {
+        redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(ctx, "client id"));
+        int64_t id = (reply && reply->type == REDIS_REPLY_INTEGER) ? reply->integer : -1;
+        if (reply)
+            freeReplyObject(reply);
+        if (id < 0)
+            return false;
+
+        // 先订阅再开启跟踪，避免丢失开启后的失效通知 //
+        reply = reinterpret_cast<redisReply*>(redisCommand(ctx, "subscribe " RedisInvalidateChannel));
+        bool ok = (reply && reply->type == REDIS_REPLY_ARRAY);
+        if (reply)
+            freeReplyObject(reply);
+        if (!ok)
+            return false;
+
+        if (!m_cache.m_client.EnableTracking(id))
+        {
+            printf("KRedisNearCache client tracking failed, redis 6 or later required\n");
+            return false;
+        }
+        m_cache.SetReady(true);
+        return true;
+    }
+
+    void KRedisInvalidator::OnDisconnected()
+    {
+        m_cache.SetReady(false);
+    }
+
+    KRedisNearCache::KRedisNearCache(KRedisClient& client, size_t capacity, uint32_t ttlms, uint16_t shards)
+        :m_client(client), m_shardCapacity(0), m_ttlms(ttlms), m_invalidator(NULL), m_ready(false),
+        m_connectionSerial(client.GetConnectionSerial()), m_invalidateSerial(0),
+        m_hits(0), m_misses(0), m_evictions(0), m_invalidations(0)
+    {
+        if (shards == 0)
+            shards = 1;
+        m_shardCapacity = (capacity + shards - 1) / shards;
+        if (m_shardCapacity == 0)
+            m_shardCapacity = 1;
+        for (uint16_t i = 0; i < shards; ++i)
+            m_shards.push_back(new Shard);
+    }
+
+    KRedisNearCache::~KRedisNearCache()
+    {
+        Stop();
+        std::vector<Shard*>::iterator it = m_shards.begin();
+        while (it != m_shards.end())
+        {
+            delete *it;
+            ++it;
+        }
+        m_shards.clear();
+    }
+
+    bool KRedisNearCache::EnableTracking(const std::vector<RedisConfig>& confs)
+    {
+        if (m_invalidator)
+            return true;
+
+        m_invalidator = new KRedisInvalidator(*this);
+        std::vector<std::string> channels(1, RedisInvalidateChannel);
+        if (!m_invalidator->Start(confs, channels))
+        {
+            delete m_invalidator;
+            m_invalidator = NULL;
+            return false;
+        }
+        return true;
+    }
+
+    void KRedisNearCache::Stop()
+    {
+        if (m_invalidator)
+        {
+            m_invalidator->Stop();
+            delete m_invalidator;
+            m_invalidator = NULL;
+        }
+        m_ready = false;
+        Clear();
+    }
+
+    bool KRedisNearCache::Mget(const std::vector<std::string>& kys, std::vector<std::string>& vals)
+    {
+        uint32_t serial = 0;
+        uint32_t connection = 0;
+        if (!Usable(serial, connection))
+            return m_client.Mget(kys, vals);
+
+        uint64_t now = 0;
+        KTime::NowMillisecond(now);
+        size_t base = vals.size();
+        vals.resize(base + kys.size());
+        std::vector<std::string> missKeys;
+        std::vector<size_t> missIndexes;
+        for (size_t i = 0; i < kys.size(); ++i)
+        {
+            bool hit = false;
+            Shard& shard = GetShard(kys[i]);
+            {
+                KLockGuard<KMutex> lock(shard.mtx);
+                Entry* e = Find(shard, kys[i], now);
+                if (e && e->hasValue)
+                {
+                    vals[base + i] = e->value;
+                    hit = true;
+                }
+            }
+
+            if (!hit)
+            {
+                missKeys.push_back(kys[i]);
+                missIndexes.push_back(i);
+            }
+        }
+
+        // 计数合并后一次更新，减少多线程竞争 //
+        m_hits += kys.size() - missKeys.size();
+        if (missKeys.empty())
+            return true;
+        m_misses += missKeys.size();
+
+        std::vector<std::string> fetched;
+        if (!m_client.Mget(missKeys, fetched))
+        {
+            vals.resize(base);
+            return false;
+        }
+
+        // 失效通知先增加序号再加锁删除，在锁内检查序号保证不会写入过期的值 //
+        for (size_t i = 0; i < missKeys.size(); ++i)
+        {
+            vals[base + missIndexes[i]] = fetched[i];
+            Shard& shard = GetShard(missKeys[i]);
+            KLockGuard<KMutex> lock(shard.mtx);
+            if (Storable(serial, connection))
+            {
+                Entry& e = Insert(shard, missKeys[i], now);
+                e.value = fetched[i];
+                e.hasValue = true;
+            }
+        }
+        return true;
+    }
+
+    bool KRedisNearCache::Hmget(const std::string& key, std::vector<std::string>& fields, std::vector<std::string>& values)
+    {
+        uint32_t serial = 0;
+        uint32_t connection = 0;
+        if (fields.empty() || !Usable(serial, connection))
+            return m_client.Hmget(key, fields, values);
+
+        uint64_t now = 0;
+        KTime::NowMillisecond(now);
+        size_t base = values.size();
+        values.resize(base + fields.size());
+        std::vector<std::string> missFields;
+        std::vector<size_t> missIndexes;
+        Shard& shard = GetShard(key);
+        {
+            KLockGuard<KMutex> lock(shard.mtx);
+            Entry* e = Find(shard, key, now);
+            for (size_t i = 0; i < fields.size(); ++i)
+            {
+                std::map<std::string, std::string>::const_iterator fit;
+                if (e && (fit = e->fields.find(fields[i])) != e->fields.end())
+                    values[base + i] = fit->second;
+                else
+                {
+                    missFields.push_back(fields[i]);
+                    missIndexes.push_back(i);
+                }
+            }
+        }
+
+        m_hits += fields.size() - missFields.size();
+        if (missFields.empty())
+            return true;
+        m_misses += missFields.size();
+
+        std::vector<std::string> fetched;
+        if (!m_client.Hmget(key, missFields, fetched))
+        {
+            values.resize(base);
+            return false;
+        }
+
+        KLockGuard<KMutex> lock(shard.mtx);
+        Entry* e = (Storable(serial, connection) ? &Insert(shard, key, now) : NULL);
+        for (size_t i = 0; i < missFields.size(); ++i)
+        {
+            values[base + missIndexes[i]] = fetched[i];
+            if (e)
+                e->fields[missFields[i]] = fetched[i];
+        }
+        return true;
+    }
+
+    void KRedisNearCache::Invalidate(const std::string& key)
+    {
+        ++m_invalidateSerial;
+        Shard& shard = GetShard(key);
+        KLockGuard<KMutex> lock(shard.mtx);
+        std::map<std::string, Entry>::iterator it = shard.entries.find(key);
+        if (it != shard.entries.end())
+            Erase(shard, it);
+    }
+
+    void KRedisNearCache::Clear()
+    {
+        ++m_invalidateSerial;
+        std::vector<Shard*>::iterator it = m_shards.begin();
+        while (it != m_shards.end())
+        {
+            KLockGuard<KMutex> lock((*it)->mtx);
+            (*it)->entries.clear();
+            (*it)->lru.clear();
+            ++it;
+        }
+    }
+
+    NearCacheStats KRedisNearCache::GetStats() const
+    {
+        NearCacheStats stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.evictions = m_evictions;
+        stats.invalidations = m_invalidations;
+        stats.size = 0;
+        std::vector<Shard*>::const_iterator it = m_shards.begin();
+        while (it != m_shards.end())
+        {
+            KLockGuard<KMutex> lock((*it)->mtx);
+            stats.size += (*it)->entries.size();
+            ++it;
+        }
+        return stats;
+    }
+
+    bool KRedisNearCache::Usable(uint32_t& serial, uint32_t& connection)
+    {
+        // 开启失效通知但通知连接不可用时不使用缓存 //
+        if (m_invalidator && !m_ready)
+            return false;
+
+        connection = m_client.GetConnectionSerial();
+        {
+            KLockGuard<KMutex> lock(m_serialMtx);
+            if (connection != m_connectionSerial)
+            {
+                // 数据连接重连过，期间的失效通知可能丢失 //
+                m_connectionSerial = connection;
+                Clear();
+            }
+        }
+        serial = m_invalidateSerial;
+        return true;
+    }
+
+    bool KRedisNearCache::Storable(uint32_t serial, uint32_t connection) const
+    {
+        return serial == uint32_t(m_invalidateSerial) && connection == m_client.GetConnectionSerial()
+            && (!m_invalidator || m_ready);
+    }
+
+    KRedisNearCache::Shard& KRedisNearCache::GetShard(const std::string& key)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < key.size(); ++i)
+        {
+            hash ^= uint8_t(key[i]);
+            hash *= 16777619u;
+        }
+        return *m_shards[hash % m_shards.size()];
+    }
+
+    KRedisNearCache::Entry* KRedisNearCache::Find(Shard& shard, const std::string& key, uint64_t now)
+    {
+        std::map<std::string, Entry>::iterator it = shard.entries.find(key);
+        if (it == shard.entries.end())
+            return NULL;
+
+        if (it->second.expire > 0 && it->second.expire <= now)
+        {
+            Erase(shard, it);
+            ++m_evictions;
+            return NULL;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.pos);
+        return &it->second;
+    }
+
+    KRedisNearCache::Entry& KRedisNearCache::Insert(Shard& shard, const std::string& key, uint64_t now)
+    {
+        std::map<std::string, Entry>::iterator it = shard.entries.find(key);
+        if (it != shard.entries.end())
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.pos);
+            return it->second;
+        }
+
+        // 淘汰最久未使用的 //
+        while (shard.entries.size() >= m_shardCapacity && !shard.lru.empty())
+        {
+            Erase(shard, shard.entries.find(shard.lru.back()));
+            ++m_evictions;
+        }
+
+        shard.lru.push_front(key);
+        Entry& e = shard.entries[key];
+        e.pos = shard.lru.begin();
+        // 有效期从首次写入开始计算，后续补充字段不延长 //
+        e.expire = (m_ttlms > 0 ? now + m_ttlms : 0);
+        return e;
+    }
+
+    void KRedisNearCache::Erase(Shard& shard, std::map<std::string, Entry>::iterator it)
+    {
+        shard.lru.erase(it->second.pos);
+        shard.entries.erase(it);
+    }
+
+    void KRedisNearCache::SetReady(bool ready)
+    {
+        // 状态切换时都清空，只保留通知连接可用期间读取的数据 //
+        if (!ready)
+            m_ready = false;
+        Clear();
+        if (ready)
+            m_ready = true;
+    }
+};
@@ -0,0 +1,167 @@
+#pragma once
+#ifndef _HIREDIS_NEARCACHE_HPP_
+#define _HIREDIS_NEARCACHE_HPP_
+
+#include "thirdparty/KRedisClient.h"
+#include "thirdparty/KRedisSubscriber.h"
+#include <list>
+/**
+redis进程内近端缓存类
+缓存Mget/Hmget读取的结果，按key分片加锁，每个分片LRU淘汰，
+开启失效通知时通过CLIENT TRACKING保持一致，否则只按TTL过期
+**/
+namespace thirdparty {
+    using namespace klib;
+#define RedisInvalidateChannel "__redis__:invalidate"
+
+    struct NearCacheStats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        // LRU淘汰和过期的个数 //
+        uint64_t evictions;
+        // 收到失效通知的key个数 //
+        uint64_t invalidations;
+        size_t size;
+    };
+
+    class KRedisNearCache;
+
+    /**
+    接收失效通知的连接，建立连接后在数据连接上开启CLIENT TRACKING重定向到这里
+    **/
+    class KRedisInvalidator :public KRedisSubscriber
+    {
+    public:
+        KRedisInvalidator(KRedisNearCache& cache);
+
+    protected:
+        virtual void ProcessEvent(const RedisMessage& ev);
+
+        virtual bool OnConnected(redisContext* ctx);
+
+        virtual void OnDisconnected();
+
+    private:
+        KRedisNearCache& m_cache;
+    };
+
+    class KRedisNearCache
+    {
+    public:
+        /************************************
+        * Method:    构造
+        * Parameter: client 数据连接，由调用者管理连接
+        * Parameter: capacity 最多缓存的key个数
+        * Parameter: ttlms 缓存有效期，0不过期(只在开启失效通知时使用)
+        * Parameter: shards 分片个数
+        *************************************/
+        KRedisNearCache(KRedisClient& client, size_t capacity = 100000, uint32_t ttlms = 60000, uint16_t shards = 16);
+
+        ~KRedisNearCache();
+
+        /************************************
+        * Method:    开启失效通知，通知连接断开期间不使用缓存
+        * Returns:
+        * Parameter: confs 与client相同的redis地址
+        *************************************/
+        bool EnableTracking(const std::vector<RedisConfig>& confs);
+
+        void Stop();
+
+        /************************************
+        * Method:    批量获取，未命中的key通过client读取后缓存
+        * Returns:
+        * Parameter: kys
+        * Parameter: vals 与kys一一对应，不存在为空
+        *************************************/
+        bool Mget(const std::vector<std::string>& kys, std::vector<std::string>& vals);
+
+        /************************************
+        * Method:    批量获取hash字段，fields为空时直接读取全部字段不缓存
+        * Returns:
+        * Parameter: key
+        * Parameter: fields
+        * Parameter: values
+        *************************************/
+        bool Hmget(const std::string& key, std::vector<std::string>& fields, std::vector<std::string>& values);
+
+        /************************************
+        * Method:    使key失效，包括hash的所有字段
+        * Returns:
+        * Parameter: key
+        *************************************/
+        void Invalidate(const std::string& key);
+
+        void Clear();
+
+        NearCacheStats GetStats() const;
+
+    private:
+        struct Entry
+        {
+            // 字符串值 //
+            std::string value;
+            bool hasValue;
+            // hash字段 //
+            std::map<std::string, std::string> fields;
+            uint64_t expire;
+            std::list<std::string>::iterator pos;
+
+            Entry()
+                :hasValue(false), expire(0)
+            {
+
+            }
+        };
+
+        struct Shard
+        {
+            KMutex mtx;
+            // 最近使用的在前面 //
+            std::list<std::string> lru;
+            std::map<std::string, Entry> entries;
+        };
+
+        /************************************
+        * Method:    是否可以使用缓存，数据连接重连过时清空
+        * Returns:
+        * Parameter: serial 返回当前的失效序号，写入时校验
+        * Parameter: connection 返回当前的连接序号，写入时校验
+        *************************************/
+        bool Usable(uint32_t& serial, uint32_t& connection);
+
+        // 读取期间没有失效和重连时才写入缓存 //
+        bool Storable(uint32_t serial, uint32_t connection) const;
+
+        Shard& GetShard(const std::string& key);
+
+        // 调用者持有分片锁，过期时删除并返回NULL //
+        Entry* Find(Shard& shard, const std::string& key, uint64_t now);
+
+        Entry& Insert(Shard& shard, const std::string& key, uint64_t now);
+
+        void Erase(Shard& shard, std::map<std::string, Entry>::iterator it);
+
+        void SetReady(bool ready);
+
+        friend class KRedisInvalidator;
+
+    private:
+        KRedisClient& m_client;
+        std::vector<Shard*> m_shards;
+        size_t m_shardCapacity;
+        uint32_t m_ttlms;
+        KRedisInvalidator* m_invalidator;
+        volatile bool m_ready;
+        uint32_t m_connectionSerial;
+        KMutex m_serialMtx;
+        // 每次失效或清空加1，读取期间变化则不写入缓存，避免写入过期数据 //
+        AtomicInteger<uint32_t> m_invalidateSerial;
+        AtomicInteger<uint64_t> m_hits;
+        AtomicInteger<uint64_t> m_misses;
+        AtomicInteger<uint64_t> m_evictions;
+        AtomicInteger<uint64_t> m_invalidations;
+    };
+};
+#endif
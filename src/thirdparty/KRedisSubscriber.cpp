@@ -0,0 +1,578 @@
+#include "thirdparty/KRedisSubscriber.h"
+#if defined(WIN32)
+#include <winsock2.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+
+namespace thirdparty {
+    /**
+    把推送消息的字符串收集后交给订阅者
+    **/
+    class RedisPushHandler :public KRespHandler
+    {
+    public:
+        RedisPushHandler(KRedisSubscriber* owner)
+            :m_owner(owner)
+        {
+
+        }
+
+        virtual bool OnAggregate(char /*type*/, int64_t /*count*/, size_t depth)
+        {
+            // 数组类型的消息体占一个字段，元素放到items //
+            if (depth == 1)
+                m_fields.push_back(std::string());
+            return true;
+        }
+
+        virtual bool OnString(char /*type*/, const RespView& view, size_t depth)
+        {
+            std::vector<std::string>& dst = (depth > 1 ? m_items : m_fields);
+            dst.push_back(std::string());
+            view.CopyTo(dst.back());
+            return true;
+        }
+
+        virtual bool OnInteger(int64_t val, size_t depth)
+        {
+            char buf[24];
+            std::vector<std::string>& dst = (depth > 1 ? m_items : m_fields);
+            dst.push_back(std::string(buf, KStringUtility::FormatInt64(val, buf)));
+            return true;
+        }
+
+        virtual bool OnNull(size_t depth)
+        {
+            if (depth == 1)
+                m_fields.push_back(std::string());
+            return true;
+        }
+
+        virtual bool OnReply()
+        {
+            bool rc = m_owner->Dispatch(m_fields, m_items);
+            m_fields.clear();
+            m_items.clear();
+            return rc;
+        }
+
+    private:
+        KRedisSubscriber* m_owner;
+        std::vector<std::string> m_fields;
+        std::vector<std::string> m_items;
+    };
+
+    KRedisSubscriber::KRedisSubscriber(bool master)
+        :KEventObject<RedisMessage>("KRedisSubscriber Thread", 10000),
+        m_master(master), m_connected(false), m_receiving(false), m_receiveThread("KRedisSubscriber receive thread")
+    {
+
+    }
+
+    KRedisSubscriber::~KRedisSubscriber()
+    {
+        Stop();
+    }
+
+    bool KRedisSubscriber::Start(const std::vector<RedisConfig>& confs, const std::vector<std::string>& channels,
+        const std::vector<std::string>& patterns)
+    {
+        if (m_receiving || (channels.empty() && patterns.empty()))
+            return false;
+
+        m_confs = confs;
+        m_channels = channels;
+        m_patterns = patterns;
+        if (!KEventObject<RedisMessage>::Start())
+            return false;
+
+        m_receiving = true;
+        if (m_receiveThread.Run(this, &KRedisSubscriber::ReceiveLoop, 0) != KPthread::Success)
+        {
+            m_receiving = false;
+            KEventObject<RedisMessage>::Stop();
+            KEventObject<RedisMessage>::WaitForStop();
+            return false;
+        }
+        printf("KRedisSubscriber channels:[%d], patterns:[%d] start success\n", int(channels.size()), int(patterns.size()));
+        return true;
+    }
+
+    void KRedisSubscriber::Stop()
+    {
+        if (!m_receiving)
+            return;
+
+        m_receiving = false;
+        m_receiveThread.Join();
+        KEventObject<RedisMessage>::Stop();
+        KEventObject<RedisMessage>::WaitForStop();
+    }
+
+    redisContext* KRedisSubscriber::Connect(const std::vector<RedisConfig>& confs, bool master)
+    {
+        std::vector<RedisConfig>::const_iterator it = confs.begin();
+        while (it != confs.end())
+        {
+            timeval tv = { 3, 0 };
+            redisContext* ctx = redisConnectWithTimeout(it->ip.c_str(), it->port, tv);
+            if (ctx && !ctx->err)
+            {
+                bool ok = true;
+                if (!it->pwd.empty())
+                {
+                    redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(ctx, "auth %s", it->pwd.c_str()));
+                    ok = (reply && reply->type == REDIS_REPLY_STATUS);
+                    if (reply)
+                        freeReplyObject(reply);
+                }
+
+                if (ok && master)
+                {
+                    redisReply* reply = reinterpret_cast<redisReply*>(redisCommand(ctx, "info replication"));
+                    ok = (reply && reply->type == REDIS_REPLY_STRING
+                        && std::string(reply->str, reply->len).find("role:master") != std::string::npos);
+                    if (reply)
+                        freeReplyObject(reply);
+                }
+
+                if (ok)
+                    return ctx;
+            }
+            if (ctx)
+                redisFree(ctx);
+            ++it;
+        }
+        return NULL;
+    }
+
+    int KRedisSubscriber::ReceiveLoop(int)
+    {
+        while (m_receiving)
+        {
+            redisContext* ctx = Connect(m_confs, m_master);
+            if (ctx == NULL)
+            {
+                KTime::MSleep(RedisReconnectInterval);
+                continue;
+            }
+
+            if (!OnConnected(ctx) || !Subscribe(ctx))
+            {
+                redisFree(ctx);
+                OnDisconnected();
+                KTime::MSleep(RedisReconnectInterval);
+                continue;
+            }
+
+            m_connected = true;
+            // 连接只用于订阅，hiredis读缓存为空，直接读socket用KRespDecoder解析 //
+            RedisPushHandler handler(this);
+            KRespDecoder decoder;
+            std::vector<char> buf(RedisReadBufferSize);
+            size_t len = 0;
+            while (m_receiving)
+            {
+                int rc = WaitReadable(ctx, 500);
+                if (rc == 0)
+                    continue;
+                if (rc < 0)
+                    break;
+
+                if (len == buf.size())
+                    buf.resize(buf.size() * 2);
+                int n = ::recv(ctx->fd, &buf[0] + len, int(buf.size() - len), 0);
+                if (n <= 0)
+                    break;
+                len += n;
+
+                int64_t used = decoder.Feed(&buf[0], len, handler);
+                if (used == KRespDecoder::RespError)
+                    break;
+                if (used > 0)
+                {
+                    len -= size_t(used);
+                    if (len > 0)
+                        memmove(&buf[0], &buf[0] + used, len);
+                }
+            }
+            m_connected = false;
+            redisFree(ctx);
+            OnDisconnected();
+            if (m_receiving)
+                printf("KRedisSubscriber disconnected, reconnecting\n");
+        }
+        return 0;
+    }
+
+    bool KRedisSubscriber::Subscribe(redisContext* ctx)
+    {
+        std::string cmd;
+        if (!m_channels.empty())
+        {
+            KRespEncoder::BeginCommand(cmd, m_channels.size() + 1);
+            KRespEncoder::AppendArg(cmd, "SUBSCRIBE", 9);
+            std::vector<std::string>::const_iterator it = m_channels.begin();
+            while (it != m_channels.end())
+            {
+                KRespEncoder::AppendArg(cmd, *it);
+                ++it;
+            }
+        }
+
+        if (!m_patterns.empty())
+        {
+            KRespEncoder::BeginCommand(cmd, m_patterns.size() + 1);
+            KRespEncoder::AppendArg(cmd, "PSUBSCRIBE", 10);
+            std::vector<std::string>::const_iterator it = m_patterns.begin();
+            while (it != m_patterns.end())
+            {
+                KRespEncoder::AppendArg(cmd, *it);
+                ++it;
+            }
+        }
+        return SendAll(ctx, cmd);
+    }
+
+    bool KRedisSubscriber::Dispatch(const std::vector<std::string>& fields, std::vector<std::string>& items)
+    {
+        RedisMessage msg;
+        if (fields.size() == 3 && fields[0] == "message")
+        {
+            msg.channel = fields[1];
+            msg.body = fields[2];
+        }
+        else if (fields.size() == 4 && fields[0] == "pmessage")
+        {
+            msg.pattern = fields[1];
+            msg.channel = fields[2];
+            msg.body = fields[3];
+        }
+        else
+        {
+            // 订阅确认等其它应答 //
+            return true;
+        }
+
+        msg.items.swap(items);
+        // 队列满时等待处理线程，不丢消息 //
+        while (m_receiving && !Post(msg))
+            KTime::MSleep(1);
+        return true;
+    }
+
+    bool KRedisSubscriber::SendAll(redisContext* ctx, const std::string& dat)
+    {
+        size_t sent = 0;
+        while (sent < dat.size())
+        {
+            int rc = ::send(ctx->fd, dat.c_str() + sent, int(dat.size() - sent), 0);
+            if (rc <= 0)
+                return false;
+            sent += rc;
+        }
+        return true;
+    }
+
+    int KRedisSubscriber::WaitReadable(redisContext* ctx, int ms)
+    {
+        pollfd p;
+        p.fd = ctx->fd;
+        p.events = POLLIN;
+        p.revents = 0;
+#if defined(WIN32)
+        int rc = WSAPoll(&p, 1, ms);
+#else
+        int rc = ::poll(&p, 1, ms);
+        if (rc < 0 && errno == EINTR)
+            return 0;
+#endif
+        return rc;
+    }
+
+    KRedisStreamConsumer::KRedisStreamConsumer()
+        :KEventObject<RedisStreamMessage>("KRedisStreamConsumer Thread", 10000),
+        m_count(100), m_blockms(1000), m_connected(false), m_reading(false),
+        m_readThread("KRedisStreamConsumer read thread")
+    {
+
+    }
+
+    KRedisStreamConsumer::~KRedisStreamConsumer()
+    {
+        Stop();
+    }
+
+    bool KRedisStreamConsumer::Start(const std::vector<RedisConfig>& confs, const std::vector<std::string>& streams,
+        const std::string& group, const std::string& consumer, uint32_t count, uint32_t blockms)
+    {
+        if (m_reading || streams.empty() || group.empty() || consumer.empty())
+            return false;
+
+        m_confs = confs;
+        m_streams = streams;
+        m_group = group;
+        m_consumer = consumer;
+        m_count = (count > 0 ? count : 1);
+        m_blockms = blockms;
+        if (!KEventObject<RedisStreamMessage>::Start())
+            return false;
+
+        m_reading = true;
+        if (m_readThread.Run(this, &KRedisStreamConsumer::ReadLoop, 0) != KPthread::Success)
+        {
+            m_reading = false;
+            KEventObject<RedisStreamMessage>::Stop();
+            KEventObject<RedisStreamMessage>::WaitForStop();
+            return false;
+        }
+        printf("KRedisStreamConsumer streams:[%d], group:[%s], consumer:[%s] start success\n",
+            int(streams.size()), group.c_str(), consumer.c_str());
+        return true;
+    }
+
+    void KRedisStreamConsumer::Stop()
+    {
+        if (!m_reading)
+            return;
+
+        m_reading = false;
+        m_readThread.Join();
+        KEventObject<RedisStreamMessage>::Stop();
+        KEventObject<RedisStreamMessage>::WaitForStop();
+    }
+
+    void KRedisStreamConsumer::Ack(const RedisStreamMessage& msg)
+    {
+        KLockGuard<KMutex> lock(m_ackMtx);
+        m_acks[msg.stream].push_back(msg.id);
+    }
+
+    int KRedisStreamConsumer::ReadLoop(int)
+    {
+        while (m_reading)
+        {
+            redisContext* ctx = KRedisSubscriber::Connect(m_confs, true);
+            if (ctx == NULL || !CreateGroups(ctx))
+            {
+                if (ctx)
+                    redisFree(ctx);
+                KTime::MSleep(RedisReconnectInterval);
+                continue;
+            }
+
+            // 读超时要大于BLOCK时间 //
+            timeval tv = { long(m_blockms / 1000 + 3), 0 };
+            redisSetTimeout(ctx, tv);
+            m_connected = true;
+
+            // 每次连接先从头重新投递本消费者未确认的消息 //
+            std::vector<std::string> ids(m_streams.size(), "0");
+            while (m_reading)
+            {
+                if (!FlushAcks(ctx) || ReadBatch(ctx, ids) < 0)
+                    break;
+            }
+
+            // 停止前把已处理的确认发出去 //
+            if (!m_reading)
+                FlushAcks(ctx);
+            m_connected = false;
+            redisFree(ctx);
+            if (m_reading)
+                printf("KRedisStreamConsumer disconnected, reconnecting\n");
+        }
+        return 0;
+    }
+
+    bool KRedisStreamConsumer::CreateGroups(redisContext* ctx)
+    {
+        std::vector<std::string>::const_iterator it = m_streams.begin();
+        while (it != m_streams.end())
+        {
+            const char* argv[] = { "XGROUP", "CREATE", it->c_str(), m_group.c_str(), "$", "MKSTREAM" };
+            size_t lens[] = { 6, 6, it->size(), m_group.size(), 1, 8 };
+            redisReply* reply = reinterpret_cast<redisReply*>(redisCommandArgv(ctx, 6, argv, lens));
+            if (reply == NULL)
+                return false;
+
+            // 已存在返回BUSYGROUP //
+            bool ok = reply->type == REDIS_REPLY_STATUS
+                || (reply->type == REDIS_REPLY_ERROR && strncmp(reply->str, "BUSYGROUP", 9) == 0);
+            if (!ok)
+                printf("KRedisStreamConsumer create group on [%s] failed:[%s]\n", it->c_str(), reply->str);
+            freeReplyObject(reply);
+            if (!ok)
+                return false;
+            ++it;
+        }
+        return true;
+    }
+
+    bool KRedisStreamConsumer::FlushAcks(redisContext* ctx)
+    {
+        std::map<std::string, std::vector<std::string> > acks;
+        {
+            KLockGuard<KMutex> lock(m_ackMtx);
+            if (m_acks.empty())
+                return true;
+            acks.swap(m_acks);
+        }
+
+        // 每个stream的id按批合并为一条XACK，整体管道发送 //
+        size_t cmds = 0;
+        bool rc = true;
+        std::map<std::string, std::vector<std::string> >::const_iterator it = acks.begin();
+        while (rc && it != acks.end())
+        {
+            for (size_t i = 0; rc && i < it->second.size(); i += RedisAckBatchSize)
+            {
+                size_t n = std::min(it->second.size() - i, size_t(RedisAckBatchSize));
+                RedisArgvCmd rmd;
+                rmd.Allocate(int(n + 3));
+                rmd.AddArgv("XACK", 4);
+                rmd.AddArgv(it->first);
+                rmd.AddArgv(m_group);
+                for (size_t j = 0; j < n; ++j)
+                    rmd.AddArgv(it->second[i + j]);
+                rc = redisAppendCommandArgv(ctx, rmd.argc, (const char**)rmd.argv, rmd.argvlen) == REDIS_OK;
+                rmd.Release();
+                ++cmds;
+            }
+            ++it;
+        }
+
+        for (size_t i = 0; rc && i < cmds; ++i)
+        {
+            redisReply* reply = NULL;
+            rc = (redisGetReply(ctx, (void**)&reply) == REDIS_OK && reply != NULL);
+            if (reply)
+                freeReplyObject(reply);
+        }
+
+        if (!rc)
+        {
+            // 连接出错，放回去重连后再确认 //
+            KLockGuard<KMutex> lock(m_ackMtx);
+            std::map<std::string, std::vector<std::string> >::iterator ait = acks.begin();
+            while (ait != acks.end())
+            {
+                std::vector<std::string>& ids = m_acks[ait->first];
+                ids.insert(ids.end(), ait->second.begin(), ait->second.end());
+                ++ait;
+            }
+        }
+        return rc;
+    }
+
+    int KRedisStreamConsumer::ReadBatch(redisContext* ctx, std::vector<std::string>& ids)
+    {
+        bool pending = false;
+        std::vector<std::string>::const_iterator iit = ids.begin();
+        while (iit != ids.end())
+        {
+            pending = pending || (*iit != ">");
+            ++iit;
+        }
+
+        std::string count = KStringUtility::Uint32ToString(m_count);
+        std::string block = KStringUtility::Uint32ToString(m_blockms);
+        RedisArgvCmd rmd;
+        rmd.Allocate(int(8 + (pending ? 0 : 2) + m_streams.size() * 2));
+        rmd.AddArgv("XREADGROUP", 10);
+        rmd.AddArgv("GROUP", 5);
+        rmd.AddArgv(m_group);
+        rmd.AddArgv(m_consumer);
+        rmd.AddArgv("COUNT", 5);
+        rmd.AddArgv(count);
+        // 读取未确认的消息时不阻塞 //
+        if (!pending)
+        {
+            rmd.AddArgv("BLOCK", 5);
+            rmd.AddArgv(block);
+        }
+        rmd.AddArgv("STREAMS", 7);
+        for (size_t i = 0; i < m_streams.size(); ++i)
+            rmd.AddArgv(m_streams[i]);
+        for (size_t i = 0; i < ids.size(); ++i)
+            rmd.AddArgv(ids[i]);
+
+        redisReply* reply = reinterpret_cast<redisReply*>(redisCommandArgv(ctx, rmd.argc, (const char**)rmd.argv, rmd.argvlen));
+        rmd.Release();
+        if (reply == NULL)
+            return -1;
+
+        int total = 0;
+        if (reply->type == REDIS_REPLY_ERROR)
+        {
+            // NOGROUP等错误，重连后重新创建消费组 //
+            printf("KRedisStreamConsumer XREADGROUP failed:[%s]\n", reply->str);
+            total = -1;
+        }
+        else if (reply->type == REDIS_REPLY_ARRAY)
+        {
+            std::vector<size_t> counts(m_streams.size(), 0);
+            for (size_t i = 0; i < reply->elements; ++i)
+            {
+                const redisReply* sr = reply->element[i];
+                if (sr->type != REDIS_REPLY_ARRAY || sr->elements != 2 || sr->element[1]->type != REDIS_REPLY_ARRAY)
+                    continue;
+
+                std::string stream(sr->element[0]->str, sr->element[0]->len);
+                size_t index = std::find(m_streams.begin(), m_streams.end(), stream) - m_streams.begin();
+                const redisReply* entries = sr->element[1];
+                for (size_t j = 0; j < entries->elements && m_reading; ++j)
+                {
+                    const redisReply* entry = entries->element[j];
+                    if (entry->type != REDIS_REPLY_ARRAY || entry->elements != 2)
+                        continue;
+
+                    RedisStreamMessage msg;
+                    msg.stream = stream;
+                    msg.id.assign(entry->element[0]->str, entry->element[0]->len);
+                    if (index < ids.size() && ids[index] != ">")
+                    {
+                        ids[index] = msg.id;
+                        ++counts[index];
+                    }
+
+                    const redisReply* fields = entry->element[1];
+                    if (fields->type != REDIS_REPLY_ARRAY)
+                    {
+                        // 未确认但已被XDEL的消息，直接确认掉 //
+                        Ack(msg);
+                        continue;
+                    }
+
+                    msg.fields.reserve(fields->elements / 2);
+                    for (size_t k = 0; k + 1 < fields->elements; k += 2)
+                    {
+                        msg.fields.push_back(std::make_pair(std::string(fields->element[k]->str, fields->element[k]->len),
+                            std::string(fields->element[k + 1]->str, fields->element[k + 1]->len)));
+                    }
+
+                    // 队列满时等待处理线程，未投递的消息保留在PEL中 //
+                    while (m_reading && !Post(msg))
+                        KTime::MSleep(1);
+                    ++total;
+                }
+            }
+
+            // 未确认的消息已读完的stream切换到读取新消息 //
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                if (ids[i] != ">" && counts[i] == 0)
+                    ids[i] = ">";
+            }
+        }
+        else if (pending)
+        {
+            std::fill(ids.begin(), ids.end(), std::string(">"));
+        }
+        freeReplyObject(reply);
+        return total;
+    }
+};
@@ -0,0 +1,176 @@
+#pragma once
+#ifndef _HIREDIS_SUBSCRIBER_HPP_
+#define _HIREDIS_SUBSCRIBER_HPP_
+
+#include "thirdparty/KRedisClient.h"
+#include "thread/KEventObject.h"
+/**
+redis订阅类
+KRedisSubscriber使用独占连接SUBSCRIBE/PSUBSCRIBE，KRedisStreamConsumer以消费组方式XREADGROUP读取Stream，
+消息投递到KEventObject队列，在ProcessEvent中处理，断线自动重连并重新订阅
+**/
+namespace thirdparty {
+    using namespace klib;
+// 断线重连间隔毫秒 //
+#define RedisReconnectInterval 1000
+// 单次XACK携带的最大id数 //
+#define RedisAckBatchSize 500
+
+    struct RedisMessage
+    {
+        // 匹配的模式，SUBSCRIBE时为空 //
+        std::string pattern;
+        std::string channel;
+        std::string body;
+        // 消息体为数组时的元素，如客户端缓存的失效key //
+        std::vector<std::string> items;
+    };
+
+    class KRedisSubscriber :public KEventObject<RedisMessage>
+    {
+    public:
+        /************************************
+        * Method:    构造
+        * Parameter: master 是否只连接master，客户端缓存失效通知需要与数据连接在同一节点
+        *************************************/
+        KRedisSubscriber(bool master = false);
+
+        virtual ~KRedisSubscriber();
+
+        /************************************
+        * Method:    启动
+        * Returns:
+        * Parameter: confs redis地址，可以订阅从节点
+        * Parameter: channels SUBSCRIBE的频道
+        * Parameter: patterns PSUBSCRIBE的模式
+        *************************************/
+        bool Start(const std::vector<RedisConfig>& confs, const std::vector<std::string>& channels,
+            const std::vector<std::string>& patterns = std::vector<std::string>());
+
+        void Stop();
+
+        inline bool IsConnected() const { return m_connected; }
+
+        /************************************
+        * Method:    建立连接并认证
+        * Returns:   失败返回NULL
+        * Parameter: confs
+        * Parameter: master 是否只连接master
+        *************************************/
+        static redisContext* Connect(const std::vector<RedisConfig>& confs, bool master);
+
+    protected:
+        virtual void ProcessEvent(const RedisMessage& /*ev*/)
+        {
+
+        }
+
+        /************************************
+        * Method:    连接建立后订阅前调用，在接收线程中执行
+        * Returns:   返回false断开重连
+        * Parameter: ctx
+        *************************************/
+        virtual bool OnConnected(redisContext* /*ctx*/) { return true; }
+
+        // 连接断开或订阅失败后调用，在接收线程中执行 //
+        virtual void OnDisconnected() {}
+
+    private:
+        int ReceiveLoop(int);
+
+        bool Subscribe(redisContext* ctx);
+
+        bool Dispatch(const std::vector<std::string>& fields, std::vector<std::string>& items);
+
+        static bool SendAll(redisContext* ctx, const std::string& dat);
+
+        static int WaitReadable(redisContext* ctx, int ms);
+
+        friend class RedisPushHandler;
+
+    private:
+        std::vector<RedisConfig> m_confs;
+        std::vector<std::string> m_channels;
+        std::vector<std::string> m_patterns;
+        bool m_master;
+        volatile bool m_connected;
+        volatile bool m_receiving;
+        KPthread m_receiveThread;
+    };
+
+    struct RedisStreamMessage
+    {
+        std::string stream;
+        std::string id;
+        // 字段和值 //
+        std::vector<std::pair<std::string, std::string> > fields;
+    };
+
+    class KRedisStreamConsumer :public KEventObject<RedisStreamMessage>
+    {
+    public:
+        KRedisStreamConsumer();
+
+        virtual ~KRedisStreamConsumer();
+
+        /************************************
+        * Method:    启动，消费组不存在时创建，先重新投递本消费者未确认的消息
+        * Returns:
+        * Parameter: confs redis地址，连接master
+        * Parameter: streams
+        * Parameter: group 消费组
+        * Parameter: consumer 消费者名称，同组内唯一
+        * Parameter: count 每次读取的最大条数
+        * Parameter: blockms 没有消息时的阻塞毫秒数
+        *************************************/
+        bool Start(const std::vector<RedisConfig>& confs, const std::vector<std::string>& streams,
+            const std::string& group, const std::string& consumer, uint32_t count = 100, uint32_t blockms = 1000);
+
+        void Stop();
+
+        /************************************
+        * Method:    确认消息，在ProcessEvent处理完成后调用，按stream合并后在读取前批量XACK
+        * Returns:
+        * Parameter: msg
+        *************************************/
+        void Ack(const RedisStreamMessage& msg);
+
+        inline bool IsConnected() const { return m_connected; }
+
+    protected:
+        virtual void ProcessEvent(const RedisStreamMessage& /*ev*/)
+        {
+
+        }
+
+    private:
+        int ReadLoop(int);
+
+        bool CreateGroups(redisContext* ctx);
+
+        bool FlushAcks(redisContext* ctx);
+
+        /************************************
+        * Method:    读取一批消息并投递
+        * Returns:   出错返回-1，否则返回读取的条数
+        * Parameter: ctx
+        * Parameter: ids 与m_streams对应，">"读取新消息，否则读取本消费者该id之后未确认的消息并更新为最后一条的id
+        *************************************/
+        int ReadBatch(redisContext* ctx, std::vector<std::string>& ids);
+
+    private:
+        std::vector<RedisConfig> m_confs;
+        std::vector<std::string> m_streams;
+        std::string m_group;
+        std::string m_consumer;
+        uint32_t m_count;
+        uint32_t m_blockms;
+        // stream -> 待确认的id //
+        std::map<std::string, std::vector<std::string> > m_acks;
+        KMutex m_ackMtx;
+        volatile bool m_connected;
+        volatile bool m_reading;
+        KPthread m_readThread;
+    };
+};
+#endif
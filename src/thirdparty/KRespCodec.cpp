@@ -0,0 +1,197 @@
+#include "KRespCodec.h"
+#include <cstdlib>
+
+namespace thirdparty {
+
+    KRespDecoder::KRespDecoder()
+    {
+
+    }
+
+    void KRespDecoder::Reset()
+    {
+        m_stack.clear();
+    }
+
+    bool KRespDecoder::ParseInteger(const char* b, const char* e, int64_t& val)
+    {
+        if (b >= e)
+            return false;
+        bool neg = false;
+        if (*b == '-' || *b == '+')
+        {
+            neg = (*b == '-');
+            if (++b >= e)
+                return false;
+        }
+        uint64_t v = 0;
+        while (b < e)
+        {
+            if (*b < '0' || *b > '9')
+                return false;
+            v = v * 10 + uint64_t(*b - '0');
+            ++b;
+        }
+        val = neg ? -int64_t(v) : int64_t(v);
+        return true;
+    }
+
+    bool KRespDecoder::Complete(KRespHandler& handler)
+    {
+        // 一个元素完成，逐层减少剩余个数 //
+        while (!m_stack.empty())
+        {
+            if (--m_stack.back() > 0)
+                return true;
+            m_stack.pop_back();
+        }
+        return handler.OnReply();
+    }
+
+    int64_t KRespDecoder::Feed(const char* dat, size_t sz, KRespHandler& handler)
+    {
+        const char* p = dat;
+        const char* end = dat + sz;
+        while (p < end)
+        {
+            const char* cr = reinterpret_cast<const char*>(memchr(p, '\r', end - p));
+            if (cr == NULL || cr + 1 >= end)
+                break;
+            if (cr[1] != '\n')
+                return RespError;
+            char type = *p;
+            const char* b = p + 1;
+            const char* next = cr + 2;
+            size_t depth = m_stack.size();
+            bool ok = true;
+            switch (type)
+            {
+            case '+':
+            case '-':
+                ok = handler.OnString(type, RespView(b, cr - b), depth) && Complete(handler);
+                break;
+            case ':':
+            {
+                int64_t val = 0;
+                if (!ParseInteger(b, cr, val))
+                    return RespError;
+                ok = handler.OnInteger(val, depth) && Complete(handler);
+                break;
+            }
+            case '_':
+                ok = handler.OnNull(depth) && Complete(handler);
+                break;
+            case '#':
+                if (cr - b != 1 || (*b != 't' && *b != 'f'))
+                    return RespError;
+                ok = handler.OnBool(*b == 't', depth) && Complete(handler);
+                break;
+            case ',':
+            {
+                char buf[64] = { 0 };
+                size_t len = cr - b;
+                if (len == 0 || len >= sizeof(buf))
+                    return RespError;
+                memcpy(buf, b, len);
+                ok = handler.OnDouble(strtod(buf, NULL), depth) && Complete(handler);
+                break;
+            }
+            case '(':
+                ok = handler.OnString(type, RespView(b, cr - b), depth) && Complete(handler);
+                break;
+            case '$':
+            case '!':
+            case '=':
+            {
+                int64_t len = 0;
+                // 只有-1表示null，过大的长度视为协议错误，避免len + 2溢出 //
+                if (!ParseInteger(b, cr, len) || len < -1 || len > RespMaxBulkLength)
+                    return RespError;
+                if (len < 0)
+                {
+                    ok = handler.OnNull(depth) && Complete(handler);
+                    break;
+                }
+                // 数据不完整，等待后续数据 //
+                if (end - next < len + 2)
+                    return p - dat;
+                if (next[len] != '\r' || next[len + 1] != '\n')
+                    return RespError;
+                RespView view(next, size_t(len));
+                // verbatim格式为"txt:"前缀加内容 //
+                if (type == '=' && len >= 4)
+                {
+                    view.data += 4;
+                    view.size -= 4;
+                }
+                next += len + 2;
+                ok = handler.OnString(type, view, depth) && Complete(handler);
+                break;
+            }
+            case '*':
+            case '%':
+            case '~':
+            case '>':
+            case '|':
+            {
+                int64_t count = 0;
+                if (!ParseInteger(b, cr, count) || count < -1 || count > RespMaxAggregateCount)
+                    return RespError;
+                if (count < 0)
+                {
+                    ok = handler.OnNull(depth) && Complete(handler);
+                    break;
+                }
+                if (type == '%' || type == '|')
+                    count *= 2;
+                ok = handler.OnAggregate(type, count, depth);
+                if (ok)
+                {
+                    if (count == 0)
+                        ok = Complete(handler);
+                    else if (type == '|')
+                        // 属性后面紧跟真正的应答，多计一个元素 //
+                        m_stack.push_back(count + 1);
+                    else
+                        m_stack.push_back(count);
+                }
+                break;
+            }
+            default:
+                return RespError;
+            }
+            if (!ok)
+                return RespError;
+            p = next;
+        }
+        return p - dat;
+    }
+
+    void KRespEncoder::BeginCommand(std::string& out, size_t argc)
+    {
+        char buf[32];
+        buf[0] = '*';
+        size_t len = KStringUtility::FormatInt64(int64_t(argc), buf + 1) + 1;
+        buf[len++] = '\r';
+        buf[len++] = '\n';
+        out.append(buf, len);
+    }
+
+    void KRespEncoder::AppendArg(std::string& out, const char* dat, size_t sz)
+    {
+        char buf[32];
+        buf[0] = '$';
+        size_t len = KStringUtility::FormatInt64(int64_t(sz), buf + 1) + 1;
+        buf[len++] = '\r';
+        buf[len++] = '\n';
+        out.append(buf, len);
+        out.append(dat, sz);
+        out.append("\r\n", 2);
+    }
+
+    void KRespEncoder::AppendArg(std::string& out, int64_t val)
+    {
+        char buf[24];
+        AppendArg(out, buf, KStringUtility::FormatInt64(val, buf));
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+#ifndef _RESP_CODEC_HPP_
+#define _RESP_CODEC_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cstring>
+#include "util/KStringUtility.h"
+/**
+RESP2/RESP3编解码类
+解码不分配内存，字符串以视图的形式指向接收缓存，聚合类型按元素流式回调，
+超大数组不需要整体缓存；编码直接写入发送缓存
+**/
+namespace thirdparty {
+    using namespace klib;
+// bulk字符串最大长度，与redis的proto-max-bulk-len默认值一致 //
+#define RespMaxBulkLength (512LL * 1024 * 1024)
+// 聚合类型最大元素数 //
+#define RespMaxAggregateCount (1024LL * 1024 * 1024)
+
+    /**
+    字符串视图，只在回调期间有效，需要保留时调用ToString/CopyTo
+    **/
+    struct RespView
+    {
+        const char* data;
+        size_t size;
+
+        RespView()
+            :data(NULL), size(0)
+        {
+
+        }
+
+        RespView(const char* d, size_t sz)
+            :data(d), size(sz)
+        {
+
+        }
+
+        inline std::string ToString() const { return std::string(data, size); }
+
+        inline void CopyTo(std::string& dst) const { dst.assign(data, size); }
+
+        inline bool Equals(const char* s) const { return strlen(s) == size && memcmp(data, s, size) == 0; }
+    };
+
+    /**
+    解码回调，返回false停止解码
+    **/
+    class KRespHandler
+    {
+    public:
+        virtual ~KRespHandler() {}
+
+        /************************************
+        * Method:    聚合类型开始
+        * Parameter: type '*'数组 '%'map '~'set '>'push '|'属性
+        * Parameter: count 元素个数，map和属性为键值总数，-1为null
+        * Parameter: depth 嵌套深度，顶层为0
+        *************************************/
+        virtual bool OnAggregate(char /*type*/, int64_t /*count*/, size_t /*depth*/) { return true; }
+
+        /************************************
+        * Method:    字符串类型
+        * Parameter: type '$'二进制串 '+'状态 '-'错误 '!'二进制错误 '='verbatim '('大数
+        * Parameter: view 指向接收缓存
+        * Parameter: depth 嵌套深度
+        *************************************/
+        virtual bool OnString(char /*type*/, const RespView& /*view*/, size_t /*depth*/) { return true; }
+
+        virtual bool OnInteger(int64_t /*val*/, size_t /*depth*/) { return true; }
+
+        virtual bool OnDouble(double /*val*/, size_t /*depth*/) { return true; }
+
+        virtual bool OnBool(bool /*val*/, size_t /*depth*/) { return true; }
+
+        // RESP2的$-1、*-1也按null回调 //
+        virtual bool OnNull(size_t /*depth*/) { return true; }
+
+        // 一个完整的顶层应答结束 //
+        virtual bool OnReply() { return true; }
+    };
+
+    class KRespDecoder
+    {
+    public:
+        enum { RespError = -1 };
+
+        KRespDecoder();
+
+        /************************************
+        * Method:    解析数据
+        * Returns:   返回已消费的字节数，协议错误或回调返回false时返回RespError；
+        *            未消费的部分是不完整的元素，调用者保留并与后续数据一起再次传入
+        * Parameter: dat
+        * Parameter: sz
+        * Parameter: handler
+        *************************************/
+        int64_t Feed(const char* dat, size_t sz, KRespHandler& handler);
+
+        /************************************
+        * Method:    是否正在解析一个应答
+        * Returns:
+        *************************************/
+        inline bool InReply() const { return !m_stack.empty(); }
+
+        void Reset();
+
+    private:
+        bool Complete(KRespHandler& handler);
+
+        static bool ParseInteger(const char* b, const char* e, int64_t& val);
+
+    private:
+        // 每层聚合剩余的元素个数 //
+        std::vector<int64_t> m_stack;
+    };
+
+    class KRespEncoder
+    {
+    public:
+        /************************************
+        * Method:    写入命令头 *argc
+        * Returns:
+        * Parameter: out 发送缓存
+        * Parameter: argc
+        *************************************/
+        static void BeginCommand(std::string& out, size_t argc);
+
+        /************************************
+        * Method:    写入一个参数 $len arg
+        * Returns:
+        * Parameter: out
+        * Parameter: dat
+        * Parameter: sz
+        *************************************/
+        static void AppendArg(std::string& out, const char* dat, size_t sz);
+
+        static inline void AppendArg(std::string& out, const std::string& arg) { AppendArg(out, arg.c_str(), arg.size()); }
+
+        static void AppendArg(std::string& out, int64_t val);
+
+        /************************************
+        * Method:    编码整个命令
+        * Returns:
+        * Parameter: out
+        * Parameter: argv 字符串容器
+        *************************************/
+        template<typename StringContainer>
+        static void Encode(std::string& out, const StringContainer& argv)
+        {
+            BeginCommand(out, argv.size());
+            typename StringContainer::const_iterator it = argv.begin();
+            while (it != argv.end())
+            {
+                AppendArg(out, *it);
+                ++it;
+            }
+        }
+    };
+
+    /**
+    把应答中的字符串拷贝到vector，null为空串，数组展开
+    **/
+    class KRespStringCollector :public KRespHandler
+    {
+    public:
+        KRespStringCollector(std::vector<std::string>& vals)
+            :m_vals(vals), m_type(0)
+        {
+
+        }
+
+        // 顶层类型 //
+        inline char GetType() const { return m_type; }
+
+        // 顶层或元素中的错误 //
+        inline const std::string& GetError() const { return m_error; }
+
+        virtual bool OnAggregate(char type, int64_t count, size_t depth)
+        {
+            if (depth == 0)
+            {
+                m_type = type;
+                if (count > 0)
+                    m_vals.reserve(m_vals.size() + size_t(count));
+            }
+            return true;
+        }
+
+        virtual bool OnString(char type, const RespView& view, size_t depth)
+        {
+            if (depth == 0)
+                m_type = type;
+            if (type == '-' || type == '!')
+                view.CopyTo(m_error);
+            m_vals.push_back(std::string());
+            view.CopyTo(m_vals.back());
+            return true;
+        }
+
+        virtual bool OnInteger(int64_t val, size_t depth)
+        {
+            if (depth == 0)
+                m_type = ':';
+            char buf[24];
+            m_vals.push_back(std::string(buf, KStringUtility::FormatInt64(val, buf)));
+            return true;
+        }
+
+        virtual bool OnNull(size_t depth)
+        {
+            if (depth == 0)
+                m_type = '_';
+            else
+                m_vals.push_back(std::string());
+            return true;
+        }
+
+    private:
+        std::vector<std::string>& m_vals;
+        std::string m_error;
+        char m_type;
+    };
+};
+#endif
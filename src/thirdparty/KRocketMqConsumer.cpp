@@ -1,12 +1,28 @@
 #include "thirdparty/KRocketMqConsumer.h"
 
 namespace thirdparty {
-    KRocketMqConsumer* KRocketMqConsumer::m_self = NULL;
+    KRocketMqLane::KRocketMqLane(KRocketMqConsumer& owner, size_t batchSize, size_t maxSize)
+        :KBatchEventObject<RocketMqMessage>("KRocketMqLane Thread", batchSize, maxSize), m_owner(owner)
+    {
+
+    }
+
+    void KRocketMqLane::ProcessBatch(const std::vector<RocketMqMessage>& msgs)
+    {
+        m_owner.ProcessMessages(msgs);
+    }
+
+    KRocketMqConsumer::KRocketMqConsumer(const RocketMqConsumerOptions& opts)
+        : m_consumer(NULL), KEventObject<RocketMqMessage>("KRocketMqConsumer Thread", opts.queueSize), m_opts(opts)
+    {
+        // 并发回调时同一队列的消息到达处理线程的顺序不确定 //
+        if (m_opts.lanes > 0)
+            m_opts.orderly = true;
+    }
 
-    KRocketMqConsumer::KRocketMqConsumer()
-        : m_consumer(NULL), KEventObject<RocketMqMessage>("KRocketMqConsumer Thread", 1000)
+    KRocketMqConsumer::~KRocketMqConsumer()
     {
-        m_self = this;
+        Stop();
     }
 
     bool KRocketMqConsumer::Start(const std::string& brokers, const std::vector<std::string>& topics, const std::string& groupid)
@@ -16,16 +32,34 @@ namespace thirdparty {
             return false;
         }
 
+        for (size_t i = 0; i < m_opts.lanes; ++i)
+        {
+            KRocketMqLane* lane = new KRocketMqLane(*this, m_opts.batchSize, m_opts.laneQueueSize);
+            lane->Start();
+            m_lanes.push_back(lane);
+        }
+
         m_consumer = CreatePushConsumer(groupid.c_str());
         if (!m_consumer)
         {
+            StopLanes();
+            ReleaseLanes();
             KEventObject<RocketMqMessage>::Stop();
             KEventObject<RocketMqMessage>::WaitForStop();
             return false;
         }
 
+        // 回调中通过用户数据找到对象，可以有多个实例 //
+        SetPushConsumerUserData(m_consumer, this);
+        if (m_opts.threads > 0)
+            SetPushConsumerThreadCount(m_consumer, m_opts.threads);
+        if (m_opts.pullBatchSize > 1)
+            SetPushConsumerMessageBatchMaxSize(m_consumer, m_opts.pullBatchSize);
+
+        int rc = (m_opts.orderly ? RegisterMessageCallbackOrderly(m_consumer, ProcessMessage)
+            : RegisterMessageCallback(m_consumer, ProcessMessage));
         if (SubscribeTopics(topics)
-            && RegisterMessageCallback(m_consumer, ProcessMessage) == 0
+            && rc == 0
             && SetPushConsumerNameServerAddress(m_consumer, brokers.c_str()) == 0
             && StartPushConsumer(m_consumer) == 0)
         {
@@ -42,23 +76,74 @@ namespace thirdparty {
     {
         if (NULL != m_consumer)
         {
+            // 先停止处理，消费线程可能阻塞在入队 //
+            KEventObject<RocketMqMessage>::Stop();
+            StopLanes();
+
             ShutdownPushConsumer(m_consumer);
-            UnregisterMessageCallback(m_consumer);
+            if (m_opts.orderly)
+                UnregisterMessageCallbackOrderly(m_consumer);
+            else
+                UnregisterMessageCallback(m_consumer);
             DestroyPushConsumer(m_consumer);
             m_consumer = NULL;
 
-            KEventObject<RocketMqMessage>::Stop();
+            // 消费线程已退出，不会再访问处理线程 //
+            KEventObject<RocketMqMessage>::WaitForStop();
+            ReleaseLanes();
         }
     }
 
+    void KRocketMqConsumer::StopLanes()
+    {
+        std::vector<KRocketMqLane*>::iterator it = m_lanes.begin();
+        while (it != m_lanes.end())
+        {
+            (*it)->Stop();
+            ++it;
+        }
+    }
+
+    void KRocketMqConsumer::ReleaseLanes()
+    {
+        DrainAndRelease(m_lanes);
+    }
+
     int KRocketMqConsumer::ProcessMessage(struct CPushConsumer* consumer, CMessageExt* msg)
     {
+        KRocketMqConsumer* self = static_cast<KRocketMqConsumer*>(GetPushConsumerUserData(consumer));
+        if (self == NULL)
+            return E_RECONSUME_LATER;
+
         RocketMqMessage rmsg;
         rmsg.topic = GetMessageTopic(msg);
         rmsg.keys = GetMessageKeys(msg);
         rmsg.tags = GetMessageTags(msg);
         rmsg.body = GetMessageBody(msg);
-        return !Post(m_self->GetID(), rmsg);
+        rmsg.queueId = GetMessageQueueId(msg);
+        return (self->Deliver(rmsg) ? E_CONSUME_SUCCESS : E_RECONSUME_LATER);
+    }
+
+    bool KRocketMqConsumer::Deliver(const RocketMqMessage& rmsg)
+    {
+        if (!m_lanes.empty())
+        {
+            // 同一主题的同一队列进入同一个处理线程 //
+            size_t h = size_t(rmsg.queueId);
+            for (size_t i = 0; i < rmsg.topic.size(); ++i)
+                h = h * 31 + (unsigned char)rmsg.topic[i];
+            // 处理完成后才返回消费成功，停止或处理异常时由broker重新投递 //
+            return m_lanes[h % m_lanes.size()]->DeliverAndWait(rmsg);
+        }
+
+        // 队列满时阻塞，暂停拉取而不是让broker重新投递 //
+        while (!Post(rmsg))
+        {
+            if (!IsRunning())
+                return false;
+            KTime::MSleep(1);
+        }
+        return true;
     }
 
     bool KRocketMqConsumer::SubscribeTopics(const std::vector<std::string>& topics)
@@ -4,7 +4,7 @@
 #include <stdint.h>
 #include <sstream>
 #include <vector>
-#include "thread/KEventObject.h"
+#include "thread/KBatchEventObject.h"
 
 namespace thirdparty {
     using namespace klib;
@@ -14,12 +14,55 @@ namespace thirdparty {
         std::string tags;
         std::string keys;
         std::string body;
+        int queueId;
+    };
+
+    struct RocketMqConsumerOptions
+    {
+        // 消息队列大小，满时暂停消费 //
+        size_t queueSize;
+        // 每次拉取交给回调的最大消息数 //
+        int pullBatchSize;
+        // 客户端消费线程数，0为默认 //
+        int threads;
+        // 顺序消费，同一队列的消息在客户端单线程回调 //
+        bool orderly;
+        // 大于0时按队列分配到多个处理线程，ProcessMessages批量处理，此时强制使用顺序消费， //
+        // 处理完成后才确认消费；为0时入队即确认，进程退出时队列中的消息丢失 //
+        size_t lanes;
+        size_t laneQueueSize;
+        // ProcessMessages每批最多消息数 //
+        size_t batchSize;
+
+        RocketMqConsumerOptions()
+            :queueSize(1000), pullBatchSize(1), threads(0), orderly(false), lanes(0), laneQueueSize(1000), batchSize(100)
+        {
+
+        }
+    };
+
+    class KRocketMqConsumer;
+
+    // 处理线程，同一队列的消息顺序处理 //
+    class KRocketMqLane :public KBatchEventObject<RocketMqMessage>
+    {
+    public:
+        KRocketMqLane(KRocketMqConsumer& owner, size_t batchSize, size_t maxSize);
+
+    protected:
+        virtual void ProcessBatch(const std::vector<RocketMqMessage>& msgs);
+
+    private:
+        KRocketMqConsumer& m_owner;
     };
 
     class KRocketMqConsumer :public KEventObject<RocketMqMessage>
     {
+        friend class KRocketMqLane;
     public:
-        KRocketMqConsumer();
+        KRocketMqConsumer(const RocketMqConsumerOptions& opts = RocketMqConsumerOptions());
+
+        virtual ~KRocketMqConsumer();
 
         bool Start(const std::string& brokers, const std::vector<std::string>& topics, const std::string& groupid);
 
@@ -31,6 +74,21 @@ namespace thirdparty {
 
         }
 
+        /************************************
+        * Method:    lanes大于0时在处理线程中调用，默认逐条调用ProcessEvent
+        * Returns:
+        * Parameter: msgs 顺序消费时同一队列的消息有序
+        *************************************/
+        virtual void ProcessMessages(const std::vector<RocketMqMessage>& msgs)
+        {
+            std::vector<RocketMqMessage>::const_iterator it = msgs.begin();
+            while (it != msgs.end())
+            {
+                ProcessEvent(*it);
+                ++it;
+            }
+        }
+
     private:
         //************************************
         // Method:    处理接收到的rocketmq消息
@@ -43,6 +101,16 @@ namespace thirdparty {
         //************************************
         static int ProcessMessage(struct CPushConsumer* consumer, CMessageExt* msg);
 
+        //************************************
+        // Method:    消息入队，队列满时阻塞消费线程，有处理线程时等待处理完成
+        // FullName:  KRocketMqConsumer::Deliver
+        // Access:    private 
+        // Returns:   bool
+        // Qualifier:
+        // Parameter: const RocketMqMessage & rmsg
+        //************************************
+        bool Deliver(const RocketMqMessage& rmsg);
+
         //************************************
         // Method:    订阅主题
         // FullName:  KRocketMqConsumer::SubscribeTopics
@@ -53,8 +121,15 @@ namespace thirdparty {
         //************************************
         bool SubscribeTopics(const std::vector<std::string>& topics);
 
+        // 停止处理线程，不释放 //
+        void StopLanes();
+
+        // 等待处理线程退出并释放，消费者关闭后调用 //
+        void ReleaseLanes();
+
     private:
         CPushConsumer* m_consumer;
-        static KRocketMqConsumer* m_self;
+        RocketMqConsumerOptions m_opts;
+        std::vector<KRocketMqLane*> m_lanes;
     };
 };
@@ -0,0 +1,232 @@
+#include "thirdparty/KRocketMqProducer.h"
+#include "util/KTime.h"
+#include <cstdio>
+
+namespace thirdparty {
+    KRocketMqProducer::KRocketMqProducer()
+        : m_producer(NULL), m_pending(new AtomicInteger<uint32_t>(0))
+    {
+
+    }
+
+    KRocketMqProducer::~KRocketMqProducer()
+    {
+        Stop();
+        delete m_pending;
+    }
+
+    bool KRocketMqProducer::Start(const std::string& brokers, const std::string& groupid, int sendTimeoutMs)
+    {
+        if (m_producer)
+            return true;
+
+        m_producer = CreateProducer(groupid.c_str());
+        if (!m_producer)
+            return false;
+
+        if (SetProducerNameServerAddress(m_producer, brokers.c_str()) == 0
+            && SetProducerSendMsgTimeout(m_producer, sendTimeoutMs) == 0
+            && StartProducer(m_producer) == 0)
+        {
+            printf("KRocketMqProducer brokers:[%s], groupid:[%s] start success\n",
+                brokers.c_str(), groupid.c_str());
+            return true;
+        }
+
+        DestroyProducer(m_producer);
+        m_producer = NULL;
+        return false;
+    }
+
+    void KRocketMqProducer::Stop(int ms)
+    {
+        if (NULL == m_producer)
+            return;
+
+        uint64_t begin = 0, now = 0;
+        KTime::NowMillisecond(begin);
+        now = begin;
+        while (*m_pending > 0 && now - begin < uint64_t(ms))
+        {
+            KTime::MSleep(1);
+            KTime::NowMillisecond(now);
+        }
+
+        ShutdownProducer(m_producer);
+        DestroyProducer(m_producer);
+        m_producer = NULL;
+
+        // 超时未完成的回调仍会访问计数，交给回调持有 //
+        if (*m_pending > 0)
+        {
+            printf("KRocketMqProducer stop with [%u] pending async sends\n", uint32_t(*m_pending));
+            m_pending = new AtomicInteger<uint32_t>(0);
+        }
+    }
+
+    bool KRocketMqProducer::Send(const RocketMqOutMessage& msg, std::string& msgId)
+    {
+        if (!m_producer)
+            return false;
+
+        CMessage* cmsg = CreateMessage(msg);
+        CSendResult result;
+        int rc = SendMessageSync(m_producer, cmsg, &result);
+        DestroyMessage(cmsg);
+        if (rc != 0 || result.sendStatus != E_SEND_OK)
+        {
+            printf("KRocketMqProducer send failed:[%d], topic:[%s]\n", rc, msg.topic.c_str());
+            return false;
+        }
+        msgId = result.msgId;
+        return true;
+    }
+
+    bool KRocketMqProducer::SendAsync(const RocketMqOutMessage& msg, RocketMqSendCb cb, void* param)
+    {
+        if (!m_producer)
+            return false;
+
+        AsyncContext* ctx = new AsyncContext;
+        ctx->pending = m_pending;
+        ctx->cb = cb;
+        ctx->param = param;
+        ++*m_pending;
+
+        // 消息在发送时已复制，调用后即可释放 //
+        CMessage* cmsg = CreateMessage(msg);
+        int rc = SendMessageAsync(m_producer, cmsg, OnSendSuccess, OnSendException, ctx);
+        DestroyMessage(cmsg);
+        if (rc != 0)
+        {
+            --*m_pending;
+            delete ctx;
+            return false;
+        }
+        return true;
+    }
+
+    bool KRocketMqProducer::SendBatch(const std::vector<RocketMqOutMessage>& msgs)
+    {
+        if (!m_producer)
+            return false;
+
+        // 按大小分批 //
+        bool rc = true;
+        size_t begin = 0, bytes = 0;
+        for (size_t i = 0; i < msgs.size(); ++i)
+        {
+            size_t sz = msgs[i].body.size() + msgs[i].keys.size() + msgs[i].tags.size();
+            if (i > begin && bytes + sz > RocketMqBatchMaxBytes)
+            {
+                rc = SendPart(msgs, begin, i) && rc;
+                begin = i;
+                bytes = 0;
+            }
+            bytes += sz;
+        }
+
+        if (begin < msgs.size())
+            rc = SendPart(msgs, begin, msgs.size()) && rc;
+        return rc;
+    }
+
+    bool KRocketMqProducer::SendOrderly(const RocketMqOutMessage& msg, const std::string& key, std::string& msgId,
+        RocketMqQueueSelector selector, void* param)
+    {
+        if (!m_producer)
+            return false;
+
+        SelectorContext ctx;
+        ctx.key = &key;
+        ctx.selector = selector;
+        ctx.param = param;
+        CMessage* cmsg = CreateMessage(msg);
+        CSendResult result;
+        int rc = SendMessageOrderly(m_producer, cmsg, SelectQueue, &ctx, 1, &result);
+        DestroyMessage(cmsg);
+        if (rc != 0 || result.sendStatus != E_SEND_OK)
+        {
+            printf("KRocketMqProducer send orderly failed:[%d], topic:[%s], key:[%s]\n",
+                rc, msg.topic.c_str(), key.c_str());
+            return false;
+        }
+        msgId = result.msgId;
+        return true;
+    }
+
+    CMessage* KRocketMqProducer::CreateMessage(const RocketMqOutMessage& msg)
+    {
+        CMessage* cmsg = ::CreateMessage(msg.topic.c_str());
+        if (!msg.tags.empty())
+            SetMessageTags(cmsg, msg.tags.c_str());
+        if (!msg.keys.empty())
+            SetMessageKeys(cmsg, msg.keys.c_str());
+        SetByteMessageBody(cmsg, msg.body.data(), int(msg.body.size()));
+        return cmsg;
+    }
+
+    bool KRocketMqProducer::SendPart(const std::vector<RocketMqOutMessage>& msgs, size_t begin, size_t end)
+    {
+        CBatchMessage* batch = CreateBatchMessage();
+        std::vector<CMessage*> cmsgs;
+        cmsgs.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i)
+        {
+            CMessage* cmsg = CreateMessage(msgs[i]);
+            AddMessage(batch, cmsg);
+            cmsgs.push_back(cmsg);
+        }
+
+        CSendResult result;
+        int rc = SendBatchMessage(m_producer, batch, &result);
+        DestroyBatchMessage(batch);
+        for (size_t i = 0; i < cmsgs.size(); ++i)
+            DestroyMessage(cmsgs[i]);
+
+        if (rc != 0 || result.sendStatus != E_SEND_OK)
+        {
+            printf("KRocketMqProducer send batch failed:[%d], topic:[%s], count:[%d]\n",
+                rc, msgs[begin].topic.c_str(), int(end - begin));
+            return false;
+        }
+        return true;
+    }
+
+    void KRocketMqProducer::OnSendSuccess(CSendResult result, CMessage* /*msg*/, void* userData)
+    {
+        AsyncContext* ctx = static_cast<AsyncContext*>(userData);
+        if (ctx->cb)
+            ctx->cb(result.sendStatus == E_SEND_OK, result.msgId, ctx->param);
+        --*ctx->pending;
+        delete ctx;
+    }
+
+    void KRocketMqProducer::OnSendException(CMQException e, CMessage* /*msg*/, void* userData)
+    {
+        AsyncContext* ctx = static_cast<AsyncContext*>(userData);
+        printf("KRocketMqProducer async send failed:[%d], [%s]\n", e.error, e.msg);
+        if (ctx->cb)
+            ctx->cb(false, e.msg, ctx->param);
+        --*ctx->pending;
+        delete ctx;
+    }
+
+    int KRocketMqProducer::SelectQueue(int size, CMessage* /*msg*/, void* arg)
+    {
+        SelectorContext* ctx = static_cast<SelectorContext*>(arg);
+        if (size <= 0)
+            return 0;
+
+        if (ctx->selector)
+        {
+            int index = ctx->selector(size, *ctx->key, ctx->param);
+            return (index >= 0 && index < size ? index : 0);
+        }
+
+        uint32_t h = 0;
+        for (size_t i = 0; i < ctx->key->size(); ++i)
+            h = 31 * h + (unsigned char)(*ctx->key)[i];
+        return int(h % uint32_t(size));
+    }
+};
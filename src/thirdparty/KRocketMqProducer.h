@@ -0,0 +1,106 @@
+#pragma once
+#include <CProducer.h>
+#include <string>
+#include <stdint.h>
+#include <vector>
+#include "thread/KAtomic.h"
+
+#define RocketMqBatchMaxBytes (1024 * 1024)
+
+namespace thirdparty {
+    using namespace klib;
+    struct RocketMqOutMessage
+    {
+        std::string topic;
+        std::string tags;
+        std::string keys;
+        std::string body;
+    };
+
+    /************************************
+    * Method:    异步发送结果回调，在客户端线程中执行
+    * Parameter: success
+    * Parameter: result 成功时为消息ID，失败时为错误信息
+    * Parameter: param 发送时传入的参数
+    *************************************/
+    typedef void (*RocketMqSendCb)(bool success, const std::string& result, void* param);
+
+    /************************************
+    * Method:    选择消息队列，相同的key选择相同的队列以保证顺序
+    * Returns:   队列序号 [0, queues)
+    * Parameter: queues 队列数
+    * Parameter: key 发送时传入的key
+    * Parameter: param
+    *************************************/
+    typedef int (*RocketMqQueueSelector)(int queues, const std::string& key, void* param);
+
+    class KRocketMqProducer
+    {
+    public:
+        KRocketMqProducer();
+
+        virtual ~KRocketMqProducer();
+
+        bool Start(const std::string& brokers, const std::string& groupid, int sendTimeoutMs = 3000);
+
+        // 等待异步发送完成后停止，超时后仍未完成的回调不再访问本对象 //
+        void Stop(int ms = 3000);
+
+        // 同步发送 //
+        bool Send(const RocketMqOutMessage& msg, std::string& msgId);
+
+        // 异步发送，cb可以为NULL //
+        bool SendAsync(const RocketMqOutMessage& msg, RocketMqSendCb cb = NULL, void* param = NULL);
+
+        /************************************
+        * Method:    批量同步发送，消息需要是同一个主题，超过RocketMqBatchMaxBytes时分多批
+        * Returns:   全部成功时为true
+        * Parameter: msgs
+        *************************************/
+        bool SendBatch(const std::vector<RocketMqOutMessage>& msgs);
+
+        /************************************
+        * Method:    顺序发送，相同key的消息进入同一个队列
+        * Returns:
+        * Parameter: msg
+        * Parameter: key
+        * Parameter: msgId
+        * Parameter: selector 为NULL时按key的哈希选择
+        * Parameter: param selector的参数
+        *************************************/
+        bool SendOrderly(const RocketMqOutMessage& msg, const std::string& key, std::string& msgId,
+            RocketMqQueueSelector selector = NULL, void* param = NULL);
+
+        inline uint32_t Pending() const { return *m_pending; }
+
+    private:
+        struct AsyncContext
+        {
+            AtomicInteger<uint32_t>* pending;
+            RocketMqSendCb cb;
+            void* param;
+        };
+
+        struct SelectorContext
+        {
+            const std::string* key;
+            RocketMqQueueSelector selector;
+            void* param;
+        };
+
+        CMessage* CreateMessage(const RocketMqOutMessage& msg);
+
+        bool SendPart(const std::vector<RocketMqOutMessage>& msgs, size_t begin, size_t end);
+
+        static void OnSendSuccess(CSendResult result, CMessage* msg, void* userData);
+
+        static void OnSendException(CMQException e, CMessage* msg, void* userData);
+
+        static int SelectQueue(int size, CMessage* msg, void* arg);
+
+    private:
+        CProducer* m_producer;
+        // 异步回调只访问计数，停止时仍有未完成的回调则不释放 //
+        AtomicInteger<uint32_t>* m_pending;
+    };
+};
@@ -0,0 +1,142 @@
+#include "KTDengineAsyncClient.h"
+#include <cstdio>
+
+namespace thirdparty {
+    KTDengineAsyncClient::KTDengineAsyncClient(size_t maxSize)
+        :KEventObject<TDengineAsyncResult>("KTDengineAsyncClient Thread", maxSize),
+        m_pool(NULL), m_pending(0), m_accepting(false)
+    {
+
+    }
+
+    KTDengineAsyncClient::~KTDengineAsyncClient()
+    {
+        Stop();
+    }
+
+    bool KTDengineAsyncClient::Start(KTDenginePool& pool)
+    {
+        if (m_accepting || pool.Size() == 0)
+            return false;
+
+        m_pool = &pool;
+        if (!KEventObject<TDengineAsyncResult>::Start())
+            return false;
+        m_accepting = true;
+        return true;
+    }
+
+    void KTDengineAsyncClient::Stop()
+    {
+        if (!m_accepting)
+            return;
+
+        // 回调中会访问本对象，等全部完成再停止 //
+        m_accepting = false;
+        while (m_pending > 0)
+            KTime::MSleep(10);
+        KEventObject<TDengineAsyncResult>::Stop();
+        KEventObject<TDengineAsyncResult>::WaitForStop();
+    }
+
+    bool KTDengineAsyncClient::Query(const std::string& sql, uint64_t tag)
+    {
+        // 先计数再检查，Stop置位后要么拒绝要么等待本次查询完成 //
+        ++m_pending;
+        KTDEngineClient* client = (m_accepting ? m_pool->Next() : NULL);
+        if (client == NULL)
+        {
+            --m_pending;
+            return false;
+        }
+
+        AsyncContext* ctx = new AsyncContext;
+        ctx->client = this;
+        ctx->tag = tag;
+        taos_query_a(client->GetHandle(), sql.c_str(), QueryCallback, ctx);
+        return true;
+    }
+
+    void KTDengineAsyncClient::QueryCallback(void* param, TAOS_RES* res, int code)
+    {
+        AsyncContext* ctx = static_cast<AsyncContext*>(param);
+        if (code != 0 || res == NULL)
+            ctx->client->Finish(ctx, res, code != 0 ? code : -1, 0);
+        else if (taos_field_count(res) == 0)
+            ctx->client->Finish(ctx, res, 0, taos_affected_rows(res));
+        else
+            taos_fetch_rows_a(res, FetchCallback, ctx);
+    }
+
+    void KTDengineAsyncClient::FetchCallback(void* param, TAOS_RES* res, int rows)
+    {
+        AsyncContext* ctx = static_cast<AsyncContext*>(param);
+        if (rows <= 0)
+        {
+            ctx->client->Finish(ctx, res, rows, 0);
+            return;
+        }
+
+        TDengineAsyncResult ev;
+        ev.tag = ctx->tag;
+        int num = taos_num_fields(res);
+        TAOS_FIELD* fields = taos_fetch_fields(res);
+        ev.fields.assign(fields, fields + num);
+        ev.values.reserve(size_t(rows) * num);
+        for (int r = 0; r < rows; ++r)
+        {
+            TAOS_ROW row = taos_fetch_row(res);
+            if (row == NULL)
+                break;
+
+            // 字符串复制到结果中，结果集释放后仍然有效 //
+            int* lengths = taos_fetch_lengths(res);
+            for (int c = 0; c < num; ++c)
+            {
+                KTDengineValue value;
+                int type = fields[c].type;
+                if (row[c] != NULL && (type == TSDB_DATA_TYPE_BINARY || type == TSDB_DATA_TYPE_NCHAR))
+                {
+                    value.type = type;
+                    value.value.uval = ev.strings.size();
+                    value.size = size_t(lengths[c]);
+                    ev.strings.append(reinterpret_cast<const char*>(row[c]), value.size);
+                }
+                else
+                    KTDEngineQuery::ToValue(row[c], type, value);
+                ev.values.push_back(value);
+            }
+            ++ev.rows;
+        }
+        ctx->client->Deliver(ev);
+        taos_fetch_rows_a(res, FetchCallback, ctx);
+    }
+
+    void KTDengineAsyncClient::Deliver(const TDengineAsyncResult& ev)
+    {
+        // 队列满时阻塞回调线程，形成背压 //
+        while (IsRunning() && !Post(ev))
+            KTime::MSleep(1);
+    }
+
+    void KTDengineAsyncClient::Finish(AsyncContext* ctx, TAOS_RES* res, int code, int affected)
+    {
+        TDengineAsyncResult ev;
+        ev.tag = ctx->tag;
+        ev.code = code;
+        ev.affected = affected;
+        ev.completed = true;
+        if (code != 0)
+        {
+            ev.error = (res != NULL ? taos_errstr(res) : "query failed");
+            printf("KTDengineAsyncClient query error:[%d], [%s]\n", code, ev.error.c_str());
+        }
+        Deliver(ev);
+
+        if (res != NULL)
+            taos_free_result(res);
+        m_pool->ReleaseShared();
+        --m_pending;
+        delete ctx;
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include "thirdparty/KTDenginePool.h"
+#include "thread/KEventObject.h"
+
+namespace thirdparty {
+    using namespace klib;
+
+    // 异步查询结果，一个查询按批投递，最后一批completed为true //
+    struct TDengineAsyncResult
+    {
+        // 提交查询时传入的标识 //
+        uint64_t tag;
+        // 0成功，其它为错误码 //
+        int code;
+        std::string error;
+        std::vector<TAOS_FIELD> fields;
+        // 按行展开，每行fields.size()个值，binary和nchar的value.uval为在strings中的偏移，size为长度 //
+        std::vector<KTDengineValue> values;
+        std::string strings;
+        size_t rows;
+        // 非查询语句的影响行数 //
+        int affected;
+        bool completed;
+
+        TDengineAsyncResult()
+            :tag(0), code(0), rows(0), affected(0), completed(false)
+        {
+
+        }
+
+        inline const char* GetString(const KTDengineValue& v) const { return strings.data() + v.value.uval; }
+    };
+
+    // 使用taos_query_a/taos_fetch_rows_a执行查询，不占用调用线程，结果在ProcessEvent中处理 //
+    class KTDengineAsyncClient :public KEventObject<TDengineAsyncResult>
+    {
+    public:
+        KTDengineAsyncClient(size_t maxSize = 1000);
+
+        virtual ~KTDengineAsyncClient();
+
+        // 查询在连接池的连接上轮询执行 //
+        bool Start(KTDenginePool& pool);
+
+        // 等待进行中的查询完成后停止 //
+        void Stop();
+
+        bool Query(const std::string& sql, uint64_t tag);
+
+        inline uint32_t Pending() const { return m_pending; }
+
+    protected:
+        virtual void ProcessEvent(const TDengineAsyncResult& /*ev*/)
+        {
+
+        }
+
+    private:
+        struct AsyncContext
+        {
+            KTDengineAsyncClient* client;
+            uint64_t tag;
+        };
+
+        static void QueryCallback(void* param, TAOS_RES* res, int code);
+
+        static void FetchCallback(void* param, TAOS_RES* res, int rows);
+
+        // 投递结果，队列满时等待 //
+        void Deliver(const TDengineAsyncResult& ev);
+
+        void Finish(AsyncContext* ctx, TAOS_RES* res, int code, int affected);
+
+    private:
+        KTDenginePool* m_pool;
+        AtomicInteger<uint32_t> m_pending;
+        volatile bool m_accepting;
+    };
+};
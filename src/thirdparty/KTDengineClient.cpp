@@ -1,6 +1,188 @@
 #include "KTDengineClient.h"
 #include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
 namespace thirdparty {
+    static uint32_t TypeSize(int type)
+    {
+        switch (type)
+        {
+        case TSDB_DATA_TYPE_BOOL:
+        case TSDB_DATA_TYPE_TINYINT:
+        case TSDB_DATA_TYPE_UTINYINT:
+            return 1;
+        case TSDB_DATA_TYPE_SMALLINT:
+        case TSDB_DATA_TYPE_USMALLINT:
+            return 2;
+        case TSDB_DATA_TYPE_INT:
+        case TSDB_DATA_TYPE_UINT:
+        case TSDB_DATA_TYPE_FLOAT:
+            return 4;
+        default:
+            return 8;
+        }
+    }
+
+    void KTDengineBatch::AddColumn(int type, uint32_t maxLen)
+    {
+        Column col;
+        col.type = type;
+        bool var = (type == TSDB_DATA_TYPE_BINARY || type == TSDB_DATA_TYPE_NCHAR);
+        col.stride = var ? (maxLen > 0 ? maxLen : 1) : TypeSize(type);
+        m_columns.push_back(col);
+    }
+
+    char* KTDengineBatch::Slot(size_t col)
+    {
+        Column& c = m_columns[col];
+        size_t off = c.buffer.size();
+        c.buffer.resize(off + c.stride);
+        return &c.buffer[off];
+    }
+
+    void KTDengineBatch::Append(size_t col, int64_t val)
+    {
+        if (col >= m_columns.size())
+            return;
+
+        Column& c = m_columns[col];
+        char* slot = Slot(col);
+        switch (c.type)
+        {
+        case TSDB_DATA_TYPE_FLOAT:
+        {
+            float f = float(val);
+            memcpy(slot, &f, sizeof(f));
+            break;
+        }
+        case TSDB_DATA_TYPE_DOUBLE:
+        {
+            double d = double(val);
+            memcpy(slot, &d, sizeof(d));
+            break;
+        }
+        case TSDB_DATA_TYPE_BINARY:
+        case TSDB_DATA_TYPE_NCHAR:
+        {
+            char num[24];
+            int len = sprintf(num, "%lld", static_cast<long long>(val));
+            len = std::min(len, int(c.stride));
+            memcpy(slot, num, len);
+            c.lengths.push_back(int32_t(len));
+            c.nulls.push_back(0);
+            return;
+        }
+        default:
+        {
+            // 小端下取低位字节即为对应宽度的整数 //
+            int8_t v1 = int8_t(val);
+            int16_t v2 = int16_t(val);
+            int32_t v4 = int32_t(val);
+            if (c.stride == 1)
+                memcpy(slot, &v1, 1);
+            else if (c.stride == 2)
+                memcpy(slot, &v2, 2);
+            else if (c.stride == 4)
+                memcpy(slot, &v4, 4);
+            else
+                memcpy(slot, &val, 8);
+            break;
+        }
+        }
+        c.lengths.push_back(int32_t(c.stride));
+        c.nulls.push_back(0);
+    }
+
+    void KTDengineBatch::Append(size_t col, double val)
+    {
+        if (col >= m_columns.size())
+            return;
+
+        Column& c = m_columns[col];
+        if (c.type != TSDB_DATA_TYPE_FLOAT && c.type != TSDB_DATA_TYPE_DOUBLE)
+        {
+            Append(col, int64_t(val));
+            return;
+        }
+
+        char* slot = Slot(col);
+        if (c.type == TSDB_DATA_TYPE_FLOAT)
+        {
+            float f = float(val);
+            memcpy(slot, &f, sizeof(f));
+        }
+        else
+            memcpy(slot, &val, sizeof(val));
+        c.lengths.push_back(int32_t(c.stride));
+        c.nulls.push_back(0);
+    }
+
+    void KTDengineBatch::Append(size_t col, const char* val, size_t len)
+    {
+        if (col >= m_columns.size())
+            return;
+
+        // 超过列宽的截断 //
+        Column& c = m_columns[col];
+        char* slot = Slot(col);
+        len = std::min(len, size_t(c.stride));
+        memcpy(slot, val, len);
+        c.lengths.push_back(int32_t(len));
+        c.nulls.push_back(0);
+    }
+
+    void KTDengineBatch::AppendNull(size_t col)
+    {
+        if (col >= m_columns.size())
+            return;
+
+        Column& c = m_columns[col];
+        Slot(col);
+        c.lengths.push_back(0);
+        c.nulls.push_back(1);
+    }
+
+    void KTDengineBatch::Clear()
+    {
+        std::vector<Column>::iterator it = m_columns.begin();
+        while (it != m_columns.end())
+        {
+            it->buffer.clear();
+            it->lengths.clear();
+            it->nulls.clear();
+            ++it;
+        }
+    }
+
+    TAOS_MULTI_BIND* KTDengineBatch::GetBinds()
+    {
+        size_t rows = Rows();
+        if (rows == 0)
+            return NULL;
+
+        m_binds.resize(m_columns.size());
+        for (size_t i = 0; i < m_columns.size(); ++i)
+        {
+            Column& c = m_columns[i];
+            if (c.nulls.size() != rows)
+            {
+                printf("column [%d] has [%d] values, expect [%d]\n", int(i), int(c.nulls.size()), int(rows));
+                return NULL;
+            }
+
+            TAOS_MULTI_BIND& bind = m_binds[i];
+            memset(&bind, 0, sizeof(bind));
+            bind.buffer_type = c.type;
+            bind.buffer = &c.buffer[0];
+            bind.buffer_length = c.stride;
+            bind.length = &c.lengths[0];
+            bind.is_null = &c.nulls[0];
+            bind.num = int(rows);
+        }
+        return &m_binds[0];
+    }
+
     KTDEngineQuery::KTDEngineQuery(void* stmt, void* res) 
         :m_res(res), m_fields(NULL), m_numFields(0), m_stmt(stmt) 
     { 
@@ -39,6 +221,47 @@ namespace thirdparty {
         }
         return false;
     }
+    bool KTDEngineQuery::SetTableName(const std::string& name, TAOS_BIND* tags)
+    {
+        if (m_stmt == NULL)
+            return false;
+
+        int rc = (tags != NULL ? taos_stmt_set_tbname_tags(m_stmt, name.c_str(), tags)
+            : taos_stmt_set_tbname(m_stmt, name.c_str()));
+        if (rc != 0)
+        {
+            printf("failed to set table name:[%s], error:[%s]\n", name.c_str(), taos_stmt_errstr(m_stmt));
+            return false;
+        }
+        return true;
+    }
+
+    bool KTDEngineQuery::AddBatch(TAOS_MULTI_BIND* columns)
+    {
+        if (m_stmt == NULL || columns == NULL)
+            return false;
+
+        int rc = taos_stmt_bind_param_batch(m_stmt, columns);
+        if (rc != 0)
+        {
+            printf("failed to bind param batch, error:[%s]\n", taos_stmt_errstr(m_stmt));
+            return false;
+        }
+
+        rc = taos_stmt_add_batch(m_stmt);
+        if (rc != 0)
+        {
+            printf("failed to add batch, error:[%s]\n", taos_stmt_errstr(m_stmt));
+            return false;
+        }
+        return true;
+    }
+
+    bool KTDEngineQuery::AddBatch(KTDengineBatch& batch)
+    {
+        return AddBatch(batch.GetBinds());
+    }
+
     bool KTDEngineQuery::Exec()
     {
         if (m_stmt == NULL && m_res == NULL)
@@ -81,88 +304,274 @@ namespace thirdparty {
             for (size_t i = 0; i < m_numFields; i++)
             {
                 KTDengineValue value;
-                value.type = m_fields[i].type;
-                switch (m_fields[i].type)
-                {
-                case TSDB_DATA_TYPE_TIMESTAMP:
-                {
-                    value.value.uval = *reinterpret_cast<uint64_t**>(rowDat)[i];
-                    break;
-                }
-                case TSDB_DATA_TYPE_BINARY:
-                {
-                    value.value.strVal = reinterpret_cast<char**>(rowDat)[i];
-                    break;
-                }
-                case TSDB_DATA_TYPE_NCHAR:
-                {
-                    value.value.strVal = reinterpret_cast<char**>(rowDat)[i];
-                    break;
-                }
-                case TSDB_DATA_TYPE_FLOAT:
+                ToValue(rowDat[i], m_fields[i].type, value);
+                row.push_back(value);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void KTDEngineQuery::ToValue(const void* cell, int type, KTDengineValue& value)
+    {
+        value.type = (cell != NULL ? type : TSDB_DATA_TYPE_NULL);
+        if (cell == NULL)
+            return;
+
+        switch (type)
+        {
+        case TSDB_DATA_TYPE_TIMESTAMP:
+        {
+            value.value.uval = *reinterpret_cast<const uint64_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_BINARY:
+        {
+            value.value.strVal = const_cast<char*>(reinterpret_cast<const char*>(cell));
+            break;
+        }
+        case TSDB_DATA_TYPE_NCHAR:
+        {
+            value.value.strVal = const_cast<char*>(reinterpret_cast<const char*>(cell));
+            break;
+        }
+        case TSDB_DATA_TYPE_FLOAT:
+        {
+            value.value.dval = *reinterpret_cast<const float*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_DOUBLE:
+        {
+            value.value.dval = *reinterpret_cast<const double*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_TINYINT:
+        {
+            value.value.ival = *reinterpret_cast<const int8_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_SMALLINT:
+        {
+            value.value.ival = *reinterpret_cast<const int16_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_INT:
+        {
+            value.value.ival = *reinterpret_cast<const int32_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_BIGINT:
+        {
+            value.value.ival = *reinterpret_cast<const int64_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_UTINYINT:
+        {
+            value.value.uval = *reinterpret_cast<const uint8_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_USMALLINT:
+        {
+            value.value.uval = *reinterpret_cast<const uint16_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_UINT:
+        {
+            value.value.uval = *reinterpret_cast<const uint32_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_UBIGINT:
+        {
+            value.value.uval = *reinterpret_cast<const uint64_t*>(cell);
+            break;
+        }
+        case TSDB_DATA_TYPE_BOOL:
+        {
+            value.value.uval = *reinterpret_cast<const uint8_t*>(cell);
+            break;
+        }
+        default:
+            break;
+        };
+    }
+
+    bool KTDEngineQuery::NextBlock(KTDengineBlock& block)
+    {
+        block.m_rows = 0;
+        if (GetFields() == NULL || GetFieldCount() < 1)
+            return false;
+
+        TAOS_ROW dat = NULL;
+        int rows = taos_fetch_block(m_res, &dat);
+        if (rows <= 0 || dat == NULL)
+            return false;
+
+        // 取块后返回的是每列每个值占用的字节数 //
+        int* lengths = taos_fetch_lengths(m_res);
+        if (lengths == NULL)
+            return false;
+
+        block.m_rows = size_t(rows);
+        block.m_columns.resize(m_numFields);
+        for (int i = 0; i < m_numFields; ++i)
+        {
+            KTDengineColumn& col = block.m_columns[i];
+            col.type = m_fields[i].type;
+            col.rows = size_t(rows);
+            ConvertColumn(col, reinterpret_cast<const char*>(dat[i]), lengths[i]);
+        }
+        return true;
+    }
+
+    void KTDEngineQuery::ConvertColumn(KTDengineColumn& col, const char* dat, int stride)
+    {
+        // 块内的null以每种类型的保留值表示 //
+        static const uint64_t BigintNull = 0x8000000000000000ULL;
+        static const uint64_t DoubleNull = 0x7FFFFF0000000000ULL;
+        static const uint32_t FloatNull = 0x7FF00000;
+
+        size_t rows = col.rows;
+        col.ints = NULL;
+        col.doubles = NULL;
+        col.strs.clear();
+        col.lens.clear();
+        col.nulls.assign((rows + 7) / 8, 0);
+        switch (col.type)
+        {
+        case TSDB_DATA_TYPE_TIMESTAMP:
+        case TSDB_DATA_TYPE_BIGINT:
+        case TSDB_DATA_TYPE_UBIGINT:
+        {
+            uint64_t null = (col.type == TSDB_DATA_TYPE_UBIGINT ? 0xFFFFFFFFFFFFFFFFULL : BigintNull);
+            col.ints = reinterpret_cast<const int64_t*>(dat);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                if (uint64_t(col.ints[r]) == null)
+                    col.nulls[r >> 3] |= uint8_t(1 << (r & 7));
+            }
+            break;
+        }
+        case TSDB_DATA_TYPE_DOUBLE:
+        {
+            col.doubles = reinterpret_cast<const double*>(dat);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                uint64_t bits = 0;
+                memcpy(&bits, dat + r * sizeof(double), sizeof(bits));
+                if (bits == DoubleNull)
+                    col.nulls[r >> 3] |= uint8_t(1 << (r & 7));
+            }
+            break;
+        }
+        case TSDB_DATA_TYPE_FLOAT:
+        {
+            col.doubleBuf.resize(rows);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                uint32_t bits = 0;
+                float f = 0;
+                memcpy(&bits, dat + r * sizeof(float), sizeof(bits));
+                memcpy(&f, &bits, sizeof(f));
+                col.doubleBuf[r] = f;
+                if (bits == FloatNull)
+                    col.nulls[r >> 3] |= uint8_t(1 << (r & 7));
+            }
+            col.doubles = col.doubleBuf.empty() ? NULL : &col.doubleBuf[0];
+            break;
+        }
+        case TSDB_DATA_TYPE_BINARY:
+        case TSDB_DATA_TYPE_NCHAR:
+        {
+            // 每个值前2字节为长度，null时数据首字节为0xFF(nchar为4字节0xFF) //
+            col.strs.resize(rows);
+            col.lens.resize(rows);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                const char* p = dat + r * stride;
+                uint16_t len = 0;
+                memcpy(&len, p, sizeof(len));
+                col.strs[r] = p + sizeof(len);
+                col.lens[r] = len;
+                bool null = (col.type == TSDB_DATA_TYPE_BINARY)
+                    ? (uint8_t(p[2]) == 0xFF)
+                    : (uint8_t(p[2]) == 0xFF && uint8_t(p[3]) == 0xFF && uint8_t(p[4]) == 0xFF && uint8_t(p[5]) == 0xFF);
+                if (null)
                 {
-                    value.value.dval = *reinterpret_cast<float**>(rowDat)[i];
-                    break;
+                    col.lens[r] = 0;
+                    col.nulls[r >> 3] |= uint8_t(1 << (r & 7));
                 }
-                case TSDB_DATA_TYPE_DOUBLE:
+            }
+            break;
+        }
+        default:
+        {
+            // 较窄的整数和布尔值转换为int64 //
+            col.intBuf.resize(rows);
+            for (size_t r = 0; r < rows; ++r)
+            {
+                const char* p = dat + r * stride;
+                int64_t v = 0;
+                bool null = false;
+                switch (col.type)
                 {
-                    value.value.dval = *reinterpret_cast<double**>(rowDat)[i];
+                case TSDB_DATA_TYPE_BOOL:
+                    v = int8_t(p[0]);
+                    null = (uint8_t(p[0]) == 0x02);
                     break;
-                }
                 case TSDB_DATA_TYPE_TINYINT:
-                {
-                    value.value.ival = *reinterpret_cast<int8_t**>(rowDat)[i];
-                    break;
-                }
-                case TSDB_DATA_TYPE_SMALLINT:
-                {
-                    value.value.ival = *reinterpret_cast<int16_t**>(rowDat)[i];
-                    break;
-                }
-                case TSDB_DATA_TYPE_INT:
-                {
-                    value.value.ival = *reinterpret_cast<int32_t**>(rowDat)[i];
-                    break;
-                }
-                case TSDB_DATA_TYPE_BIGINT:
-                {
-                    value.value.ival = *reinterpret_cast<int64_t**>(rowDat)[i];
+                    v = int8_t(p[0]);
+                    null = (uint8_t(p[0]) == 0x80);
                     break;
-                }
                 case TSDB_DATA_TYPE_UTINYINT:
+                    v = uint8_t(p[0]);
+                    null = (uint8_t(p[0]) == 0xFF);
+                    break;
+                case TSDB_DATA_TYPE_SMALLINT:
                 {
-                    value.value.uval = *reinterpret_cast<uint8_t**>(rowDat)[i];
+                    int16_t x = 0;
+                    memcpy(&x, p, sizeof(x));
+                    v = x;
+                    null = (uint16_t(x) == 0x8000);
                     break;
                 }
                 case TSDB_DATA_TYPE_USMALLINT:
                 {
-                    value.value.uval = *reinterpret_cast<uint16_t**>(rowDat)[i];
+                    uint16_t x = 0;
+                    memcpy(&x, p, sizeof(x));
+                    v = x;
+                    null = (x == 0xFFFF);
                     break;
                 }
-                case TSDB_DATA_TYPE_UINT:
+                case TSDB_DATA_TYPE_INT:
                 {
-                    value.value.uval = *reinterpret_cast<uint32_t**>(rowDat)[i];
+                    int32_t x = 0;
+                    memcpy(&x, p, sizeof(x));
+                    v = x;
+                    null = (uint32_t(x) == 0x80000000);
                     break;
                 }
-                case TSDB_DATA_TYPE_UBIGINT:
+                case TSDB_DATA_TYPE_UINT:
                 {
-                    value.value.uval = *reinterpret_cast<uint64_t**>(rowDat)[i];
+                    uint32_t x = 0;
+                    memcpy(&x, p, sizeof(x));
+                    v = x;
+                    null = (x == 0xFFFFFFFF);
                     break;
                 }
-                case TSDB_DATA_TYPE_BOOL:
-                {
-                    value.value.uval = *reinterpret_cast<uint8_t**>(rowDat)[i];
+                default:
+                    null = true;
                     break;
                 }
-                default:
-                    break;
-                };
-                row.push_back(value);
+                col.intBuf[r] = v;
+                if (null)
+                    col.nulls[r >> 3] |= uint8_t(1 << (r & 7));
             }
-            return true;
+            col.ints = col.intBuf.empty() ? NULL : &col.intBuf[0];
+            break;
+        }
         }
-        return false;
     }
+
     void KTDEngineQuery::Release()
     {
         if (m_stmt != NULL)
@@ -197,12 +606,14 @@ namespace thirdparty {
         return true;
     };
 
-    void KTDEngineClient::Close()
+    void KTDEngineClient::Close(bool cleanup)
     {
         if (m_taos)
         {
             taos_close(m_taos);
-            taos_cleanup();
+            m_taos = NULL;
+            if (cleanup)
+                taos_cleanup();
         }
     };
 
@@ -246,6 +657,37 @@ namespace thirdparty {
         return true;
     }
 
+    bool KTDEngineClient::SchemalessInsert(std::string& lines, int precision)
+    {
+        if (m_taos == NULL || lines.empty())
+            return false;
+
+        // 不复制数据，每行以结束符分隔后直接传入 //
+        std::vector<char*> ptrs;
+        char* start = &lines[0];
+        char* end = start + lines.size();
+        for (char* p = start; p < end; ++p)
+        {
+            if (*p != '\n')
+                continue;
+            *p = '\0';
+            if (p > start)
+                ptrs.push_back(start);
+            start = p + 1;
+        }
+        if (start < end)
+            ptrs.push_back(start);
+        if (ptrs.empty())
+            return true;
+
+        TAOS_RES* res = taos_schemaless_insert(m_taos, &ptrs[0], int(ptrs.size()), TSDB_SML_LINE_PROTOCOL, precision);
+        int rc = taos_errno(res);
+        if (rc != 0)
+            printf("schemaless insert failed, lines:[%d], error:[%s]\n", int(ptrs.size()), taos_errstr(res));
+        taos_free_result(res);
+        return rc == 0;
+    }
+
     int KTDEngineClient::BeginContinuousQuery(const std::string& sql, ContinuousQueryCb cb, int64_t stime, void* param)
     {
         TAOS_STREAM * ts = taos_open_stream(m_taos, sql.c_str(), cb, 0, param, ContinuousQueryStopCb);
@@ -35,6 +35,99 @@ namespace thirdparty {
         }
     };
 
+    // 一个块中的一列，数据指向结果集内部，下一次取块或释放前有效 //
+    struct KTDengineColumn
+    {
+        int type;
+        size_t rows;
+        // 整数、布尔和时间戳列，bigint和timestamp直接指向块内数据，其它宽度转换为int64 //
+        const int64_t* ints;
+        // 浮点列，double直接指向块内数据，float转换为double //
+        const double* doubles;
+        // binary和nchar列 //
+        std::vector<const char*> strs;
+        std::vector<uint16_t> lens;
+        // 按位保存，1为null //
+        std::vector<uint8_t> nulls;
+
+        KTDengineColumn()
+            :type(TSDB_DATA_TYPE_NULL), rows(0), ints(NULL), doubles(NULL)
+        {
+
+        }
+
+        inline bool IsNull(size_t row) const { return (nulls[row >> 3] & (1 << (row & 7))) != 0; }
+
+        // 转换宽度用的缓存，块之间复用 //
+        std::vector<int64_t> intBuf;
+        std::vector<double> doubleBuf;
+    };
+
+    class KTDengineBlock
+    {
+    public:
+        KTDengineBlock()
+            :m_rows(0)
+        {
+
+        }
+
+        inline size_t Rows() const { return m_rows; }
+
+        inline size_t Columns() const { return m_columns.size(); }
+
+        inline const KTDengineColumn& Column(size_t i) const { return m_columns[i]; }
+
+    private:
+        size_t m_rows;
+        std::vector<KTDengineColumn> m_columns;
+        friend class KTDEngineQuery;
+    };
+
+    // 按列保存的批量绑定数据，每行每列追加一个值 //
+    class KTDengineBatch
+    {
+    public:
+        // type为TSDB_DATA_TYPE_*，binary和nchar需要指定最大长度 //
+        void AddColumn(int type, uint32_t maxLen = 0);
+
+        void Append(size_t col, int64_t val);
+
+        void Append(size_t col, double val);
+
+        void Append(size_t col, const char* val, size_t len);
+
+        inline void Append(size_t col, const std::string& val) { Append(col, val.c_str(), val.size()); }
+
+        void AppendNull(size_t col);
+
+        inline size_t Rows() const { return m_columns.empty() ? 0 : m_columns[0].nulls.size(); }
+
+        inline size_t Columns() const { return m_columns.size(); }
+
+        // 清空数据，保留列定义和容量 //
+        void Clear();
+
+        TAOS_MULTI_BIND* GetBinds();
+
+    private:
+        struct Column
+        {
+            int type;
+            // 每个值占用的字节数 //
+            uint32_t stride;
+            std::vector<char> buffer;
+            std::vector<int32_t> lengths;
+            std::vector<char> nulls;
+        };
+
+        char* Slot(size_t col);
+
+    private:
+        std::vector<Column> m_columns;
+        std::vector<TAOS_MULTI_BIND> m_binds;
+    };
+
     class KTDEngineQuery
     {
     public:
@@ -50,15 +143,31 @@ namespace thirdparty {
 
         bool BindParams(TAOS_BIND* params);
 
+        // 设置子表名，tags不为空时子表不存在则自动创建 //
+        bool SetTableName(const std::string& name, TAOS_BIND* tags = NULL);
+
+        // 按列绑定多行并加入批次，可以多次设置表名和加入批次后一次Exec //
+        bool AddBatch(TAOS_MULTI_BIND* columns);
+
+        bool AddBatch(KTDengineBatch& batch);
+
         bool Exec();
 
         bool Next(std::vector<KTDengineValue>& row);
 
+        // 按块取数据，返回按列的数组，没有更多数据时返回false //
+        bool NextBlock(KTDengineBlock& block);
+
         void Release();
 
+        // 转换一个值，cell为NULL时为null //
+        static void ToValue(const void* cell, int type, KTDengineValue& value);
+
     private:
         void Reset();
 
+        static void ConvertColumn(KTDengineColumn& col, const char* dat, int stride);
+
     private:
         void* m_stmt;
         void* m_res;
@@ -77,7 +186,10 @@ namespace thirdparty {
 
         bool Connect(const KTDendgineConfig& conf);
 
-        void Close();
+        // cleanup为true时同时释放客户端库，连接池中的连接不释放 //
+        void Close(bool cleanup = true);
+
+        inline void* GetHandle() const { return m_taos; }
 
         KTDEngineQuery Prepare(const std::string& sql);
 
@@ -85,6 +197,9 @@ namespace thirdparty {
 
         bool Exec(const std::string& sql);
 
+        // 无模式写入行协议数据，换行在lines中原地替换为结束符，precision为TSDB_SML_TIMESTAMP_* //
+        bool SchemalessInsert(std::string& lines, int precision = TSDB_SML_TIMESTAMP_NANO_SECONDS);
+
         int BeginContinuousQuery(const std::string& sql, ContinuousQueryCb cb, int64_t stime, void* param);
 
         void EndContinuousQuery(int);
@@ -0,0 +1,118 @@
+#include "KTDenginePool.h"
+#include <cstdio>
+
+namespace thirdparty {
+    KTDenginePool::KTDenginePool()
+        :m_next(0), m_shared(0), m_running(false)
+    {
+
+    }
+
+    KTDenginePool::~KTDenginePool()
+    {
+        Stop();
+    }
+
+    bool KTDenginePool::Start(const KTDendgineConfig& conf, size_t size)
+    {
+        KLockGuard<KMutex> lock(m_mtx);
+        if (m_running || size == 0)
+            return false;
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            KTDEngineClient* client = new KTDEngineClient;
+            if (!client->Connect(conf)
+                || (!conf.db.empty() && taos_select_db(client->GetHandle(), conf.db.c_str()) != 0))
+            {
+                printf("KTDenginePool connect failed:[%s], db:[%s]\n", conf.host.c_str(), conf.db.c_str());
+                client->Close(false);
+                delete client;
+                continue;
+            }
+            m_clients.push_back(client);
+        }
+
+        if (m_clients.empty())
+            return false;
+        m_idle = m_clients;
+        m_running = true;
+        return true;
+    }
+
+    void KTDenginePool::Stop()
+    {
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            if (!m_running)
+                return;
+
+            m_running = false;
+            m_cond.NotifyAll();
+            while (m_idle.size() < m_clients.size() || m_shared > 0)
+                m_cond.Wait(lock);
+        }
+
+        std::vector<KTDEngineClient*>::iterator it = m_clients.begin();
+        while (it != m_clients.end())
+        {
+            (*it)->Close(false);
+            delete *it;
+            ++it;
+        }
+        m_clients.clear();
+        m_idle.clear();
+    }
+
+    KTDEngineClient* KTDenginePool::Acquire(int ms)
+    {
+        KLockGuard<KMutex> lock(m_mtx);
+        if (ms < 0)
+        {
+            while (m_running && m_idle.empty())
+                m_cond.Wait(lock);
+        }
+        else if (m_running && m_idle.empty())
+        {
+            m_cond.TimedWait(lock, ms);
+        }
+
+        if (!m_running || m_idle.empty())
+            return NULL;
+
+        KTDEngineClient* client = m_idle.back();
+        m_idle.pop_back();
+        return client;
+    }
+
+    void KTDenginePool::Release(KTDEngineClient* client)
+    {
+        if (client == NULL)
+            return;
+
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            m_idle.push_back(client);
+        }
+        m_cond.NotifyAll();
+    }
+
+    KTDEngineClient* KTDenginePool::Next()
+    {
+        KLockGuard<KMutex> lock(m_mtx);
+        if (!m_running || m_clients.empty())
+            return NULL;
+        ++m_shared;
+        return m_clients[uint32_t(m_next++) % m_clients.size()];
+    }
+
+    void KTDenginePool::ReleaseShared()
+    {
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            if (m_shared > 0)
+                --m_shared;
+        }
+        m_cond.NotifyAll();
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+#include "thirdparty/KTDengineClient.h"
+#include "thread/KMutex.h"
+#include "thread/KLockGuard.h"
+#include "thread/KCondVariable.h"
+#include "thread/KAtomic.h"
+
+namespace thirdparty {
+    using namespace klib;
+
+    // 线程安全的连接池，连接创建时选择conf.db //
+    class KTDenginePool
+    {
+    public:
+        KTDenginePool();
+
+        ~KTDenginePool();
+
+        bool Start(const KTDendgineConfig& conf, size_t size);
+
+        // 等待所有连接归还且共享使用结束后关闭 //
+        void Stop();
+
+        // 独占一个连接，ms小于0一直等待，超时或已停止返回NULL //
+        KTDEngineClient* Acquire(int ms = -1);
+
+        void Release(KTDEngineClient* client);
+
+        // 轮询取一个连接共享使用，用于异步查询，用完调用ReleaseShared //
+        KTDEngineClient* Next();
+
+        void ReleaseShared();
+
+        inline size_t Size() const { return m_clients.size(); }
+
+    private:
+        KTDenginePool(const KTDenginePool&);
+        KTDenginePool& operator=(const KTDenginePool&);
+
+    private:
+        std::vector<KTDEngineClient*> m_clients;
+        std::vector<KTDEngineClient*> m_idle;
+        KMutex m_mtx;
+        KCondVariable m_cond;
+        AtomicInteger<uint32_t> m_next;
+        // Next取出还未ReleaseShared的次数 //
+        size_t m_shared;
+        volatile bool m_running;
+    };
+
+    // 作用域内独占连接池中的一个连接 //
+    class KTDengineConnection
+    {
+    public:
+        KTDengineConnection(KTDenginePool& pool, int ms = -1)
+            :m_pool(pool), m_client(pool.Acquire(ms))
+        {
+
+        }
+
+        ~KTDengineConnection()
+        {
+            if (m_client)
+                m_pool.Release(m_client);
+        }
+
+        inline bool IsValid() const { return m_client != NULL; }
+
+        inline KTDEngineClient* operator->() const { return m_client; }
+
+    private:
+        KTDengineConnection(const KTDengineConnection&);
+        KTDengineConnection& operator=(const KTDengineConnection&);
+
+    private:
+        KTDenginePool& m_pool;
+        KTDEngineClient* m_client;
+    };
+};
@@ -0,0 +1,141 @@
+#include "KTDengineWriter.h"
+#include <cstdio>
+
+namespace thirdparty {
+    KTDengineWriter::KTDengineWriter()
+        :m_client(NULL), m_running(false), m_urgent(false), m_flushThread("KTDengineWriter flush thread"),
+        m_sentBytes(0), m_sentBatches(0), m_failedBatches(0), m_droppedBytes(0)
+    {
+
+    }
+
+    KTDengineWriter::~KTDengineWriter()
+    {
+        Stop();
+    }
+
+    bool KTDengineWriter::Start(KTDEngineClient& client, const TDengineWriterOptions& opts)
+    {
+        if (m_running || client.GetHandle() == NULL)
+            return false;
+
+        m_client = &client;
+        m_opts = opts;
+        m_buffer.reserve(m_opts.batchBytes);
+        m_running = true;
+        if (m_flushThread.Run(this, &KTDengineWriter::FlushLoop, 0) != KPthread::Success)
+        {
+            m_running = false;
+            return false;
+        }
+        return true;
+    }
+
+    void KTDengineWriter::Stop()
+    {
+        if (!m_running)
+            return;
+
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            m_running = false;
+        }
+        m_cond.NotifyAll();
+        m_flushThread.Join();
+    }
+
+    bool KTDengineWriter::Write(const std::string& lines)
+    {
+        return Write(lines.c_str(), lines.size());
+    }
+
+    bool KTDengineWriter::Write(KInfluxLineBuilder& points)
+    {
+        const std::string& lines = points.Str();
+        return Write(lines.c_str(), lines.size());
+    }
+
+    bool KTDengineWriter::Write(const char* lines, size_t sz)
+    {
+        if (!m_running || sz == 0)
+            return false;
+
+        bool newline = (lines[sz - 1] != '\n');
+        size_t size = 0;
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            if (m_buffer.size() + sz + 1 > m_opts.maxBufferBytes)
+            {
+                m_droppedBytes += sz;
+                return false;
+            }
+            m_buffer.append(lines, sz);
+            if (newline)
+                m_buffer.push_back('\n');
+            size = m_buffer.size();
+        }
+
+        if (size >= m_opts.batchBytes)
+            Flush();
+        return true;
+    }
+
+    void KTDengineWriter::Flush()
+    {
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            m_urgent = true;
+        }
+        m_cond.Notify();
+    }
+
+    TDengineWriterStats KTDengineWriter::GetStats() const
+    {
+        TDengineWriterStats stats;
+        stats.sentBytes = m_sentBytes;
+        stats.sentBatches = m_sentBatches;
+        stats.failedBatches = m_failedBatches;
+        stats.droppedBytes = m_droppedBytes;
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            stats.bufferedBytes = m_buffer.size();
+        }
+        return stats;
+    }
+
+    int KTDengineWriter::FlushLoop(int)
+    {
+        // 两个缓存交替使用，写入期间不阻塞调用线程 //
+        std::string batch;
+        batch.reserve(m_opts.batchBytes);
+        while (true)
+        {
+            bool running = true;
+            {
+                KLockGuard<KMutex> lock(m_mtx);
+                if (m_running && !m_urgent)
+                    m_cond.TimedWait(lock, m_opts.lingerMs);
+                m_urgent = false;
+                running = m_running;
+                batch.clear();
+                batch.swap(m_buffer);
+            }
+
+            if (!batch.empty())
+            {
+                size_t sz = batch.size();
+                if (m_client->SchemalessInsert(batch, m_opts.precision))
+                {
+                    m_sentBytes += sz;
+                    ++m_sentBatches;
+                }
+                else
+                    ++m_failedBatches;
+            }
+
+            if (!running)
+                break;
+        }
+        return 0;
+    }
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include "thirdparty/KTDengineClient.h"
+#include "thirdparty/KInfluxLineBuilder.h"
+#include "thread/KPthread.h"
+#include "thread/KMutex.h"
+#include "thread/KLockGuard.h"
+#include "thread/KCondVariable.h"
+#include "thread/KAtomic.h"
+
+namespace thirdparty {
+    using namespace klib;
+
+    struct TDengineWriterOptions
+    {
+        // 缓存达到该大小时立即写入 //
+        size_t batchBytes;
+        // 最长等待毫秒数 //
+        uint32_t lingerMs;
+        // 内存中最多缓存的字节数，超过时丢弃 //
+        size_t maxBufferBytes;
+        // 时间戳精度，TSDB_SML_TIMESTAMP_* //
+        int precision;
+
+        TDengineWriterOptions()
+            :batchBytes(1024 * 1024), lingerMs(100), maxBufferBytes(64 * 1024 * 1024),
+            precision(TSDB_SML_TIMESTAMP_NANO_SECONDS)
+        {
+
+        }
+    };
+
+    struct TDengineWriterStats
+    {
+        uint64_t sentBytes;
+        uint64_t sentBatches;
+        uint64_t failedBatches;
+        uint64_t droppedBytes;
+        size_t bufferedBytes;
+    };
+
+    // 行协议无模式批量写入，与KInfluxDbWriter使用相同的数据，后台线程按大小或时间合并写入 //
+    class KTDengineWriter
+    {
+    public:
+        KTDengineWriter();
+
+        ~KTDengineWriter();
+
+        // client需要在写入期间保持连接 //
+        bool Start(KTDEngineClient& client, const TDengineWriterOptions& opts = TDengineWriterOptions());
+
+        // 停止，写入剩余数据 //
+        void Stop();
+
+        // 写入一行或多行，可以多线程调用 //
+        bool Write(const std::string& lines);
+
+        bool Write(const char* lines, size_t sz);
+
+        bool Write(KInfluxLineBuilder& points);
+
+        void Flush();
+
+        TDengineWriterStats GetStats() const;
+
+    private:
+        int FlushLoop(int);
+
+    private:
+        KTDEngineClient* m_client;
+        TDengineWriterOptions m_opts;
+        KMutex m_mtx;
+        KCondVariable m_cond;
+        std::string m_buffer;
+        volatile bool m_running;
+        volatile bool m_urgent;
+        KPthread m_flushThread;
+
+        AtomicInteger<uint64_t> m_sentBytes;
+        AtomicInteger<uint64_t> m_sentBatches;
+        AtomicInteger<uint64_t> m_failedBatches;
+        AtomicInteger<uint64_t> m_droppedBytes;
+    };
+};
@@ -124,6 +124,8 @@ namespace klib {
         inline IntegerType operator--() { return FetchSub(1) - 1; }//prefix
         inline IntegerType operator++(int) { return FetchAdd(1); }//suffix
         inline IntegerType operator--(int) { return FetchSub(1); }//suffix
+        inline IntegerType operator+=(IntegerType v) { return FetchAdd(v) + v; }
+        inline IntegerType operator-=(IntegerType v) { return FetchSub(v) - v; }
         inline bool operator==(IntegerType v){ return Load() == v; }
         inline bool operator==(const AtomicInteger& rh){ return Load() == rh.Load(); }
 
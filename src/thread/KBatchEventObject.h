@@ -0,0 +1,179 @@
+#ifndef _BATCHEVENTOBJECT_HPP_
+#define _BATCHEVENTOBJECT_HPP_
+#include "thread/KEventObject.h"
+#include "thread/KFuture.h"
+#include "util/KTime.h"
+
+namespace klib {
+    /************************************
+    * Method:    事件处理完成回调，在处理线程或停止的线程中执行
+    * Parameter: success 处理完成为true，停止时未处理或处理异常为false
+    * Parameter: param 投递时传入的参数
+    *************************************/
+    typedef void (*BatchDoneCb)(bool success, void* param);
+
+    template<typename EventType>
+    struct BatchEvent
+    {
+        EventType ev;
+        BatchDoneCb cb;
+        void* param;
+
+        BatchEvent()
+            :cb(NULL), param(NULL)
+        {
+
+        }
+    };
+
+    /*
+    批量处理类，把队列中已到达的事件按批交给ProcessBatch，处理完成后回调各事件
+    停止时队列中未处理的事件以失败回调，投递成功的事件一定会回调一次
+    */
+    template<typename EventType>
+    class KBatchEventObject :public KEventObject<BatchEvent<EventType> >
+    {
+        typedef KEventObject<BatchEvent<EventType> > BaseType;
+    public:
+        KBatchEventObject(const std::string& name, size_t batchSize, size_t maxSize)
+            :BaseType(name, maxSize), m_batchSize(batchSize > 0 ? batchSize : 1)
+        {
+
+        }
+
+        /************************************
+        * Method:    入队，队列满时返回false
+        * Returns:
+        * Parameter: ev
+        * Parameter: cb 为NULL时不回调
+        * Parameter: param
+        *************************************/
+        bool TryDeliver(const EventType& ev, BatchDoneCb cb = NULL, void* param = NULL)
+        {
+            BatchEvent<EventType> item;
+            item.ev = ev;
+            item.cb = cb;
+            item.param = param;
+            return Post(item);
+        }
+
+        // 队列满时等待，停止时返回false，返回false时不回调 //
+        bool Deliver(const EventType& ev, BatchDoneCb cb = NULL, void* param = NULL)
+        {
+            BatchEvent<EventType> item;
+            item.ev = ev;
+            item.cb = cb;
+            item.param = param;
+            while (!Post(item))
+            {
+                if (!this->IsRunning())
+                    return false;
+                KTime::MSleep(1);
+            }
+            return true;
+        }
+
+        // 投递并等待处理完成，处理完成返回true //
+        bool DeliverAndWait(const EventType& ev)
+        {
+            KFuture<bool> done;
+            done.SetSubmitted(true);
+            if (!Deliver(ev, CompleteFuture, &done))
+            {
+                done.SetSubmitted(false);
+                return false;
+            }
+
+            bool success = false;
+            done.Wait(-1);
+            done.Get(success);
+            return success;
+        }
+
+        virtual bool Post(const BatchEvent<EventType>& ev)
+        {
+            // 与Stop互斥，停止后不会再有事件入队 //
+            KLockGuard<KMutex> lock(m_postMtx);
+            return BaseType::Post(ev);
+        }
+
+        virtual void Stop()
+        {
+            {
+                KLockGuard<KMutex> lock(m_postMtx);
+                BaseType::Stop();
+            }
+
+            std::vector<BatchEvent<EventType> > left;
+            this->Flush(left);
+            Done(left, 0, left.size(), false);
+        }
+
+    protected:
+        /************************************
+        * Method:    处理一批事件，抛出异常时这批事件以失败回调
+        * Returns:
+        * Parameter: evs 按入队顺序
+        *************************************/
+        virtual void ProcessBatch(const std::vector<EventType>& evs) = 0;
+
+        virtual void ProcessEvent(const BatchEvent<EventType>& ev)
+        {
+            // 取出已到达的事件，按批处理 //
+            m_items.clear();
+            m_items.push_back(ev);
+            m_rest.clear();
+            this->Flush(m_rest);
+            m_items.insert(m_items.end(), m_rest.begin(), m_rest.end());
+
+            for (size_t i = 0; i < m_items.size(); i += m_batchSize)
+            {
+                size_t end = (i + m_batchSize < m_items.size() ? i + m_batchSize : m_items.size());
+                m_batch.clear();
+                for (size_t j = i; j < end; ++j)
+                    m_batch.push_back(m_items[j].ev);
+
+                bool success = true;
+                try
+                {
+                    ProcessBatch(m_batch);
+                }
+                catch (const std::exception& e)
+                {
+                    printf("KBatchEventObject exception:[%s]\n", e.what());
+                    success = false;
+                }
+                catch (...)
+                {
+                    printf("KBatchEventObject unknown exception\n");
+                    success = false;
+                }
+                Done(m_items, i, end, success);
+            }
+        }
+
+    private:
+        static void Done(const std::vector<BatchEvent<EventType> >& items, size_t begin, size_t end, bool success)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (items[i].cb)
+                    items[i].cb(success, items[i].param);
+            }
+        }
+
+        static void CompleteFuture(bool success, void* param)
+        {
+            static_cast<KFuture<bool>*>(param)->Complete(success);
+        }
+
+    private:
+        size_t m_batchSize;
+        KMutex m_postMtx;
+        std::vector<BatchEvent<EventType> > m_items;
+        std::vector<BatchEvent<EventType> > m_rest;
+        std::vector<EventType> m_batch;
+    };
+};
+#endif // !_BATCHEVENTOBJECT_HPP_
+
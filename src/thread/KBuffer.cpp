@@ -30,6 +30,15 @@ namespace klib {
         }
     }
 
+    char* KBuffer::Detach()
+    {
+        char* dat = m_dat;
+        m_dat = NULL;
+        m_size = 0;
+        m_capacity = 0;
+        return dat;
+    }
+
     bool KBuffer::ApendBuffer(const char* d, size_t sz)
     {
         if (m_capacity - m_size < sz)
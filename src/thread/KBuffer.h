@@ -23,6 +23,9 @@ namespace klib {
         // 释放内存 //
         void Release();
 
+        // 交出数据，由调用者用free释放，缓存变为空 //
+        char* Detach();
+
         // 将数据追加到缓存最后面 //
         bool ApendBuffer(const char* d, size_t sz);
 
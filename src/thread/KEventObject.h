@@ -258,6 +258,27 @@ namespace klib {
     private:
         KQueue<EventType> m_eventQueue;
     };
+
+    /************************************
+    * Method:    等待队列中的事件处理完成后停止并释放
+    * Returns:
+    * Parameter: objs 释放后清空
+    *************************************/
+    template<typename ObjectType>
+    void DrainAndRelease(std::vector<ObjectType*>& objs)
+    {
+        typename std::vector<ObjectType*>::iterator it = objs.begin();
+        while (it != objs.end())
+        {
+            while ((*it)->IsRunning() && !(*it)->IsEmpty())
+                KTime::MSleep(1);
+            (*it)->Stop();
+            (*it)->WaitForStop();
+            delete *it;
+            ++it;
+        }
+        objs.clear();
+    }
 };
 #endif // !_EVENTOBJECT_HPP_
 
@@ -0,0 +1,125 @@
+#ifndef _FUTURE_HPP_
+#define _FUTURE_HPP_
+
+#include "thread/KMutex.h"
+#include "thread/KLockGuard.h"
+#include "thread/KCondVariable.h"
+/**
+异步结果类，提交后由执行线程设置结果，调用线程等待
+**/
+namespace klib {
+    template<typename ValueType>
+    class KFuture
+    {
+    public:
+        KFuture()
+            :m_submitted(false), m_ready(false), m_value()
+        {
+
+        }
+
+        // 析构时等待完成 //
+        virtual ~KFuture()
+        {
+            Wait(-1);
+        }
+
+        /************************************
+        * Method:    等待结果
+        * Returns:   完成返回true超时返回false，未提交时不等待
+        * Parameter: ms 小于0一直等待
+        *************************************/
+        bool Wait(int ms = -1) const
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            if (!m_submitted)
+                return m_ready;
+
+            if (ms < 0)
+            {
+                while (!m_ready)
+                    m_cond.Wait(lock);
+            }
+            else if (!m_ready)
+            {
+                m_cond.TimedWait(lock, ms);
+            }
+            return m_ready;
+        }
+
+        /************************************
+        * Method:    是否已完成
+        * Returns:
+        *************************************/
+        bool IsReady() const
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            return m_ready;
+        }
+
+        /************************************
+        * Method:    获取结果
+        * Returns:   是否已完成，未完成时为默认值
+        * Parameter: value
+        *************************************/
+        bool Get(ValueType& value) const
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            value = m_value;
+            return m_ready;
+        }
+
+        /************************************
+        * Method:    设置是否已提交，提交后Wait才会等待
+        * Returns:
+        * Parameter: submitted
+        *************************************/
+        void SetSubmitted(bool submitted)
+        {
+            KLockGuard<KMutex> lock(m_mtx);
+            m_submitted = submitted;
+        }
+
+        /************************************
+        * Method:    设置结果并通知等待方
+        * Returns:
+        * Parameter: value
+        *************************************/
+        void Complete(const ValueType& value)
+        {
+            // 在锁内通知，等待方返回后可能立即销毁future //
+            KLockGuard<KMutex> lock(m_mtx);
+            m_value = value;
+            m_ready = true;
+            m_cond.NotifyAll();
+        }
+
+        /************************************
+        * Method:    重置以便复用，未完成时等待完成
+        * Returns:
+        * Parameter: old 原来的结果，由调用者释放其中的资源
+        *************************************/
+        void Reset(ValueType& old)
+        {
+            Wait(-1);
+            KLockGuard<KMutex> lock(m_mtx);
+            old = m_value;
+            m_value = ValueType();
+            m_submitted = false;
+            m_ready = false;
+        }
+
+    private:
+        KFuture(const KFuture&);
+        KFuture& operator=(const KFuture&);
+
+    private:
+        KMutex m_mtx;
+        KCondVariable m_cond;
+        volatile bool m_submitted;
+        volatile bool m_ready;
+        ValueType m_value;
+    };
+};
+#endif // !_FUTURE_HPP_
+
@@ -113,6 +113,23 @@ namespace klib {
         return std::string(buf);
     }
 
+    size_t KStringUtility::FormatInt64(int64_t ival, char* buf)
+    {
+        char tmp[24];
+        char* t = tmp + sizeof(tmp);
+        uint64_t v = ival < 0 ? uint64_t(0) - uint64_t(ival) : uint64_t(ival);
+        do
+        {
+            *--t = char('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        if (ival < 0)
+            *--t = '-';
+        size_t len = tmp + sizeof(tmp) - t;
+        memcpy(buf, t, len);
+        return len;
+    }
+
     std::string KStringUtility::Int32ToString(int32_t ival)
     {
         char buf[64] = { 0 };
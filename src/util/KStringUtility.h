@@ -39,6 +39,8 @@ namespace klib {
         static std::string Int64ToString(int64_t ival);
         static std::string Int32ToString(int32_t ival);
         static std::string Uint32ToString(uint32_t ival);
+        // 整数转十进制写入buf，不加结束符，buf至少21字节，返回写入的字节数 //
+        static size_t FormatInt64(int64_t ival, char* buf);
     };
 
     template <typename StringContainer>